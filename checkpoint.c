@@ -1282,6 +1282,9 @@ static int do_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	if (unlikely(f2fs_cp_error(sbi)))
 		return -EIO;
 
+	/* node chain restarts after this checkpoint */
+	clear_sbi_flag(sbi, SBI_CACHED_NODE);
+
 	/* flush all device cache */
 	err = f2fs_flush_device_cache(sbi);
 	if (err)
@@ -1371,7 +1374,7 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 
 	if (!is_sbi_flag_set(sbi, SBI_IS_DIRTY) &&
 		((cpc->reason & CP_FASTBOOT) || (cpc->reason & CP_SYNC) ||
-		((cpc->reason & CP_DISCARD) && !sbi->discard_blks)))
+		((cpc->reason & CP_DISCARD) && !discard_blocks(sbi))))
 		goto out;
 	if (unlikely(f2fs_cp_error(sbi))) {
 		err = -EIO;
@@ -1392,6 +1395,8 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 
 	f2fs_flush_merged_writes(sbi);
 
+	close_volatile_logs(sbi);
+
 	/* this is the case of multiple fstrims without any changes */
 	if (cpc->reason & CP_DISCARD) {
 		if (!exist_trim_candidates(sbi, cpc)) {
@@ -1400,7 +1405,8 @@ int write_checkpoint(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 		}
 
 		if (NM_I(sbi)->dirty_nat_cnt == 0 &&
-				SIT_I(sbi)->dirty_sentries == 0 &&
+				nr_dirty_sentries(sbi) == 0 &&
+				SIT_I(sbi)->early_blocks == 0 &&
 				prefree_segments(sbi) == 0) {
 			flush_sit_entries(sbi, cpc);
 			clear_prefree_segments(sbi, cpc);
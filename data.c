@@ -298,7 +298,7 @@ static bool has_merged_page(struct f2fs_sb_info *sbi, struct inode *inode,
 	struct f2fs_bio_info *io;
 	bool ret = false;
 
-	for (temp = HOT; temp < NR_TEMP_TYPE; temp++) {
+	for (temp = HOT; temp < nr_write_io(sbi, btype); temp++) {
 		io = sbi->write_io[btype] + temp;
 
 		down_read(&io->io_rwsem);
@@ -341,7 +341,8 @@ static void __submit_merged_write_cond(struct f2fs_sb_info *sbi,
 	if (!force && !has_merged_page(sbi, inode, ino, idx, type))
 		return;
 
-	for (temp = HOT; temp < NR_TEMP_TYPE; temp++) {
+	for (temp = HOT; temp < nr_write_io(sbi, PAGE_TYPE_OF_BIO(type));
+								temp++) {
 
 		__f2fs_submit_merged_write(sbi, type, temp);
 
@@ -1724,6 +1725,13 @@ pr_notice("Enter __write_data_page()--------------------\n");
 
 	trace_f2fs_writepage(page, DATA);
 
+	if (f2fs_fua_fsync(sbi) && S_ISREG(inode->i_mode)) {
+		if (is_inode_flag_set(inode, FI_FUA_WRITE))
+			fio.op_flags |= REQ_FUA;
+		else
+			set_inode_flag(inode, FI_CACHED_WRITE);
+	}
+
 	/* we should bypass data pages to proceed the kworkder jobs */
 	if (unlikely(f2fs_cp_error(sbi))) {
 		mapping_set_error(page->mapping, -EIO);
@@ -2015,6 +2023,10 @@ int __f2fs_write_data_pages(struct address_space *mapping,
 
 	trace_f2fs_writepages(mapping->host, wbc, DATA);
 
+	/* size rules need the file size known by the first writeback */
+	if (S_ISREG(inode->i_mode) && !is_inode_flag_set(inode, FI_TEMP_RULED))
+		apply_temp_rules(inode, NULL, NULL);
+
 	/* to avoid spliting IOs due to mixed WB_SYNC_ALL and WB_SYNC_NONE */
 	if (wbc->sync_mode == WB_SYNC_ALL)
 		atomic_inc(&sbi->wb_sync_req);
@@ -2318,6 +2330,7 @@ static ssize_t f2fs_direct_IO(struct kiocb *iocb, struct iov_iter *iter)
 			f2fs_update_iostat(F2FS_I_SB(inode), APP_DIRECT_IO,
 									err);
 			set_inode_flag(inode, FI_UPDATE_WRITE);
+			set_inode_flag(inode, FI_CACHED_WRITE);
 		} else if (err < 0) {
 			f2fs_write_failed(mapping, offset + count);
 		}
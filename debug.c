@@ -64,7 +64,7 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 		si->nr_flushing =
 			atomic_read(&SM_I(sbi)->fcc_info->issing_flush);
 		si->flush_list_empty =
-			llist_empty(&SM_I(sbi)->fcc_info->issue_list);
+			flush_lists_empty(SM_I(sbi)->fcc_info);
 	}
 	if (SM_I(sbi) && SM_I(sbi)->dcc_info) {
 		si->nr_discarded =
@@ -73,7 +73,14 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 			atomic_read(&SM_I(sbi)->dcc_info->issing_discard);
 		si->nr_discard_cmd =
 			atomic_read(&SM_I(sbi)->dcc_info->discard_cmd_cnt);
-		si->undiscard_blks = SM_I(sbi)->dcc_info->undiscard_blks;
+		si->undiscard_blks = 0;
+		for (i = 0; i < SM_I(sbi)->dcc_info->nr_shards; i++)
+			si->undiscard_blks +=
+				SM_I(sbi)->dcc_info->shards[i].undiscard_blks;
+		si->nr_merged_discard =
+			atomic_read(&SM_I(sbi)->dcc_info->merged_discard);
+		si->nr_deferred_discard =
+			atomic_read(&SM_I(sbi)->dcc_info->deferred_discard);
 	}
 	si->total_count = (int)sbi->user_block_count / sbi->blocks_per_seg;
 	si->rsvd_segs = reserved_segments(sbi);
@@ -99,7 +106,7 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->nats = NM_I(sbi)->nat_cnt;
 	si->dirty_nats = NM_I(sbi)->dirty_nat_cnt;
 	si->sits = MAIN_SEGS(sbi);
-	si->dirty_sits = SIT_I(sbi)->dirty_sentries;
+	si->dirty_sits = nr_dirty_sentries(sbi);
 	si->free_nids = NM_I(sbi)->nid_cnt[FREE_NID];
 	si->avail_nids = NM_I(sbi)->available_nids;
 	si->alloc_nids = NM_I(sbi)->nid_cnt[PREALLOC_NID];
@@ -135,6 +142,7 @@ static void update_sit_info(struct f2fs_sb_info *sbi)
 	struct f2fs_stat_info *si = F2FS_STAT(sbi);
 	unsigned long long blks_per_sec, hblks_per_sec, total_vblocks;
 	unsigned long long bimodal, dist;
+	unsigned long long now = get_mtime(sbi);
 	unsigned int segno, vblocks;
 	int ndirty = 0;
 
@@ -142,14 +150,24 @@ static void update_sit_info(struct f2fs_sb_info *sbi)
 	total_vblocks = 0;
 	blks_per_sec = BLKS_PER_SEC(sbi);
 	hblks_per_sec = blks_per_sec / 2;
+	memset(si->age_hist, 0, sizeof(si->age_hist));
 	for (segno = 0; segno < MAIN_SEGS(sbi); segno += sbi->segs_per_sec) {
 		vblocks = get_valid_blocks(sbi, segno, true);
 		dist = abs(vblocks - hblks_per_sec);
 		bimodal += dist * dist;
 
 		if (vblocks > 0 && vblocks < blks_per_sec) {
+			unsigned long long mtime = 0;
+			unsigned int i;
+
 			total_vblocks += vblocks;
 			ndirty++;
+
+			for (i = 0; i < sbi->segs_per_sec; i++)
+				mtime += get_seg_entry(sbi, segno + i)->mtime;
+			mtime = div_u64(mtime, sbi->segs_per_sec);
+			si->age_hist[gc_age_bucket(sbi,
+					now > mtime ? now - mtime : 0)]++;
 		}
 	}
 	dist = div_u64(MAIN_SECS(sbi) * hblks_per_sec * hblks_per_sec, 100);
@@ -186,8 +204,14 @@ static void update_mem_info(struct f2fs_sb_info *sbi)
 	/* build sit */
 	si->base_mem += sizeof(struct sit_info);
 	si->base_mem += MAIN_SEGS(sbi) * sizeof(struct seg_entry);
-	si->base_mem += f2fs_bitmap_size(MAIN_SEGS(sbi));
-	si->base_mem += 2 * SIT_VBLOCK_MAP_SIZE * MAIN_SEGS(sbi);
+	si->base_mem += 2 * f2fs_bitmap_size(MAIN_SEGS(sbi));
+	si->base_mem += f2fs_bitmap_size(SIT_BLK_CNT(sbi));
+	if (SIT_I(sbi)->loaded_blocks_bitmap)
+		si->base_mem += f2fs_bitmap_size(SIT_BLK_CNT(sbi));
+	si->base_mem += SIT_VBLOCK_MAP_SIZE * MAIN_SEGS(sbi);
+#ifdef CONFIG_F2FS_CHECK_FS
+	si->base_mem += SIT_VBLOCK_MAP_SIZE * MAIN_SEGS(sbi);
+#endif
 	if (f2fs_discard_en(sbi))
 		si->base_mem += SIT_VBLOCK_MAP_SIZE * MAIN_SEGS(sbi);
 	si->base_mem += SIT_VBLOCK_MAP_SIZE;
@@ -199,15 +223,26 @@ static void update_mem_info(struct f2fs_sb_info *sbi)
 	si->base_mem += sizeof(struct free_segmap_info);
 	si->base_mem += f2fs_bitmap_size(MAIN_SEGS(sbi));
 	si->base_mem += f2fs_bitmap_size(MAIN_SECS(sbi));
+	si->base_mem += f2fs_bitmap_size(BITS_TO_LONGS(MAIN_SECS(sbi)));
 
 	/* build curseg */
-	si->base_mem += sizeof(struct curseg_info) * NR_CURSEG_TYPE;
-	si->base_mem += PAGE_SIZE * NR_CURSEG_TYPE;
+	si->base_mem += sizeof(struct curseg_info) * NO_CHECK_TYPE;
+	si->base_mem += sizeof(struct f2fs_journal) * NR_CURSEG_TYPE;
+	for (i = 0; i < NO_CHECK_TYPE; i++)
+		if (CURSEG_I(sbi, i)->sum_blk)
+			si->base_mem += PAGE_SIZE;
 
 	/* build dirty segmap */
 	si->base_mem += sizeof(struct dirty_seglist_info);
 	si->base_mem += NR_DIRTY_TYPE * f2fs_bitmap_size(MAIN_SEGS(sbi));
 	si->base_mem += f2fs_bitmap_size(MAIN_SECS(sbi));
+	si->base_mem += MAIN_SECS(sbi) * sizeof(struct victim_entry);
+	si->base_mem += (BLKS_PER_SEC(sbi) + 1) * sizeof(struct list_head);
+	si->base_mem += f2fs_bitmap_size(BLKS_PER_SEC(sbi) + 1);
+	si->base_mem += MAIN_SEGS(sbi) * sizeof(struct victim_entry);
+	si->base_mem += DIRTY * (sbi->blocks_per_seg + 1) *
+						sizeof(struct list_head);
+	si->base_mem += DIRTY * f2fs_bitmap_size(sbi->blocks_per_seg + 1);
 
 	/* build nm */
 	si->base_mem += sizeof(struct f2fs_nm_info);
@@ -220,6 +255,10 @@ static void update_mem_info(struct f2fs_sb_info *sbi)
 get_cache:
 	si->cache_mem = 0;
 
+	/* private ckpt_valid_maps of segments changed since last cp */
+	si->cache_mem += atomic_read(&SIT_I(sbi)->nr_ckpt_maps) *
+						SIT_VBLOCK_MAP_SIZE;
+
 	/* build gc */
 	if (sbi->gc_thread)
 		si->cache_mem += sizeof(struct f2fs_gc_kthread);
@@ -342,6 +381,14 @@ static int stat_show(struct seq_file *s, void *v)
 				si->bg_data_blks);
 		seq_printf(s, "  - node blocks : %d (%d)\n", si->node_blks,
 				si->bg_node_blks);
+		seq_printf(s, "GC section time: %d sections\n",
+				si->gc_timed_secs);
+		seq_printf(s, "  - read wait : %llu us (avg: %llu us)\n",
+				si->gc_read_time, !si->gc_timed_secs ? 0 :
+				div_u64(si->gc_read_time, si->gc_timed_secs));
+		seq_printf(s, "  - write : %llu us (avg: %llu us)\n",
+				si->gc_write_time, !si->gc_timed_secs ? 0 :
+				div_u64(si->gc_write_time, si->gc_timed_secs));
 		seq_puts(s, "\nExtent Cache:\n");
 		seq_printf(s, "  - Hit Count: L1-1:%llu L1-2:%llu L2:%llu\n",
 				si->hit_largest, si->hit_cached,
@@ -360,6 +407,8 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->flush_list_empty,
 			   si->nr_discarding, si->nr_discarded,
 			   si->nr_discard_cmd, si->undiscard_blks);
+		seq_printf(s, "  - Discard merged: %4d, deferred: %4d\n",
+			   si->nr_merged_discard, si->nr_deferred_discard);
 		seq_printf(s, "  - inmem: %4d, atomic IO: %4d (Max. %4d), "
 			"volatile IO: %4d (Max. %4d)\n",
 			   si->inmem_pages, si->aw_cnt, si->max_aw_cnt,
@@ -405,6 +454,11 @@ static int stat_show(struct seq_file *s, void *v)
 		update_sit_info(si->sbi);
 		seq_printf(s, "\nBDF: %u, avg. vblocks: %u\n",
 			   si->bimodal, si->avg_vblocks);
+		seq_printf(s, "Dirty section age (threshold: %u s):",
+			   si->sbi->gc_age_threshold);
+		for (j = 0; j < GC_AGE_HIST_BUCKETS; j++)
+			seq_printf(s, " %u", si->age_hist[j]);
+		seq_putc(s, '\n');
 
 		/* memory footprint */
 		update_mem_info(si->sbi);
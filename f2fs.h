@@ -24,6 +24,7 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/quotaops.h>
+#include <linux/hashtable.h>
 #include <crypto/hash.h>
 
 #define __FS_HAS_ENCRYPTION IS_ENABLED(CONFIG_F2FS_FS_ENCRYPTION)
@@ -99,6 +100,8 @@ extern char *fault_name[FAULT_MAX];
 #define F2FS_MOUNT_QUOTA		0x00400000
 #define F2FS_MOUNT_INLINE_XATTR_SIZE	0x00800000
 #define F2FS_MOUNT_RESERVE_ROOT		0x01000000
+#define F2FS_MOUNT_LAZY_SIT		0x02000000
+#define F2FS_MOUNT_FUA_FSYNC		0x04000000
 
 #define clear_opt(sbi, option)	((sbi)->mount_opt.opt &= ~F2FS_MOUNT_##option)
 #define set_opt(sbi, option)	((sbi)->mount_opt.opt |= F2FS_MOUNT_##option)
@@ -163,6 +166,9 @@ enum {
 		(BATCHED_TRIM_SEGMENTS(sbi) << (sbi)->log_blocks_per_seg)
 #define MAX_DISCARD_BLOCKS(sbi)		BLKS_PER_SEC(sbi)
 #define DEF_MAX_DISCARD_REQUEST		8	/* issue 8 discards per round */
+#define DEF_MAX_DISCARD_INFLIGHT	32	/* per-device discard depth */
+#define MAX_DISCARD_SHARDS		16	/* partitions of discard tree */
+#define DEF_DISCARD_LATENCY		20	/* 20 ms, discard latency goal */
 #define DEF_MIN_DISCARD_ISSUE_TIME	50	/* 50 ms, if exists */
 #define DEF_MAX_DISCARD_ISSUE_TIME	60000	/* 60 s, if no candidates */
 #define DEF_CP_INTERVAL			60	/* 60 secs */
@@ -235,6 +241,9 @@ struct discard_info {
 	block_t start;			/* actual start address in dev */
 };
 
+struct discard_dev_queue;
+struct discard_shard;
+
 struct discard_cmd {
 	struct rb_node rb_node;		/* rb node located in rb-tree */
 	union {
@@ -249,6 +258,9 @@ struct discard_cmd {
 	struct list_head list;		/* command list */
 	struct completion wait;		/* compleation */
 	struct block_device *bdev;	/* bdev */
+	struct discard_dev_queue *dq;	/* queue of bdev */
+	struct discard_shard *ds;	/* shard covering lstart */
+	ktime_t issue_time;		/* submission time */
 	unsigned short ref;		/* reference count */
 	unsigned char state;		/* state */
 	int error;			/* bio error */
@@ -273,23 +285,49 @@ struct discard_policy {
 	unsigned int granularity;	/* discard granularity */
 };
 
+/* discards of one device, issued under its own depth */
+struct discard_dev_queue {
+	struct block_device *bdev;		/* target device */
+	unsigned int index;			/* index in dev_queue */
+	atomic_t inflight;			/* # of discards in flight */
+	unsigned int depth;			/* current in-flight cap */
+	unsigned int avg_lat_us;		/* average completion latency */
+};
+
+/*
+ * The discard tree is split by logical address into shards, so that
+ * queueing a discard or checking one on the write path only locks the
+ * shard covering that address.
+ */
+struct discard_shard {
+	struct mutex cmd_lock;			/* protects the shard */
+	struct rb_root root;			/* root of discard rb-tree */
+	struct list_head *pend_list;		/* [device][size] pending */
+	struct list_head wait_list;		/* store on-flushing entries */
+	struct list_head fstrim_list;		/* in-flight discard from fstrim */
+	unsigned int undiscard_blks;		/* # of undiscard blocks */
+};
+
 struct discard_cmd_control {
 	struct task_struct *f2fs_issue_discard;	/* discard thread */
 	struct list_head entry_list;		/* 4KB discard entry list */
-	struct list_head pend_list[MAX_PLIST_NUM];/* store pending entries */
-	struct list_head wait_list;		/* store on-flushing entries */
-	struct list_head fstrim_list;		/* in-flight discard from fstrim */
+	struct discard_dev_queue *dev_queue;	/* per-device queues */
+	unsigned int nr_dev_queues;		/* # of device queues */
+	struct discard_shard *shards;		/* address-range shards */
+	unsigned int nr_shards;			/* # of shards */
+	unsigned int shard_shift;		/* log2 of blocks per shard */
 	wait_queue_head_t discard_wait_queue;	/* waiting queue for wake-up */
 	unsigned int discard_wake;		/* to wake up discard thread */
-	struct mutex cmd_lock;
 	unsigned int nr_discards;		/* # of discards in the list */
 	unsigned int max_discards;		/* max. discards to be issued */
 	unsigned int discard_granularity;	/* discard granularity */
-	unsigned int undiscard_blks;		/* # of undiscard blocks */
 	atomic_t issued_discard;		/* # of issued discard */
 	atomic_t issing_discard;		/* # of issing discard */
 	atomic_t discard_cmd_cnt;		/* # of cached cmd count */
-	struct rb_root root;			/* root of discard rb-tree */
+	atomic_t merged_discard;		/* # of merged ranges */
+	atomic_t deferred_discard;		/* # of deferred by depth */
+	unsigned int max_inflight;		/* max. depth per device */
+	unsigned int discard_latency;		/* latency target in ms */
 };
 
 /* for the list of fsync inodes, used only during recovery */
@@ -362,6 +400,8 @@ static inline bool __has_cursum_space(struct f2fs_journal *journal,
 #define F2FS_IOC_SET_PIN_FILE		_IOW(F2FS_IOCTL_MAGIC, 13, __u32)
 #define F2FS_IOC_GET_PIN_FILE		_IOR(F2FS_IOCTL_MAGIC, 14, __u32)
 #define F2FS_IOC_PRECACHE_EXTENTS	_IO(F2FS_IOCTL_MAGIC, 15)
+#define F2FS_IOC_SET_STREAM		_IOW(F2FS_IOCTL_MAGIC, 16, __u32)
+#define F2FS_IOC_GET_STREAM		_IOR(F2FS_IOCTL_MAGIC, 17, __u32)
 
 #define F2FS_IOC_SET_ENCRYPTION_POLICY	FS_IOC_SET_ENCRYPTION_POLICY
 #define F2FS_IOC_GET_ENCRYPTION_POLICY	FS_IOC_GET_ENCRYPTION_POLICY
@@ -578,6 +618,7 @@ enum {
 #define FADVISE_ENCRYPT_BIT	0x04
 #define FADVISE_ENC_NAME_BIT	0x08
 #define FADVISE_KEEP_SIZE_BIT	0x10
+#define FADVISE_HOT_BIT		0x20
 
 #define file_is_cold(inode)	is_file(inode, FADVISE_COLD_BIT)
 #define file_wrong_pino(inode)	is_file(inode, FADVISE_LOST_PINO_BIT)
@@ -592,6 +633,7 @@ enum {
 #define file_set_enc_name(inode) set_file(inode, FADVISE_ENC_NAME_BIT)
 #define file_keep_isize(inode)	is_file(inode, FADVISE_KEEP_SIZE_BIT)
 #define file_set_keep_isize(inode) set_file(inode, FADVISE_KEEP_SIZE_BIT)
+#define file_is_hot(inode)	is_file(inode, FADVISE_HOT_BIT)
 
 #define DEF_DIR_LEVEL		0
 
@@ -638,6 +680,11 @@ struct f2fs_inode_info {
 	int i_extra_isize;		/* size of extra space located in i_addr */
 	kprojid_t i_projid;		/* id for project quota */
 	int i_inline_xattr_size;	/* inline xattr size */
+	unsigned int i_stream;		/* stream id given by ioctl */
+	unsigned long long i_temp_pass;	/* start of current data write pass */
+	unsigned long long i_temp_prev;	/* start of previous write pass */
+	unsigned long long i_temp_last;	/* time of last data write */
+	unsigned int i_temp_age;	/* average rewrite interval in secs */
 	struct timespec i_crtime;	/* inode creation time */
 };
 
@@ -721,6 +768,10 @@ enum nid_state {
 	MAX_NID_STATE,
 };
 
+/* NAT address changes are sequenced per slot of nids */
+#define NAT_SEQ_SLOTS		64
+#define NAT_SEQ_SLOT(nid)	((nid) % NAT_SEQ_SLOTS)
+
 struct f2fs_nm_info {
 	block_t nat_blkaddr;		/* base disk address of NAT */
 	nid_t max_nid;			/* maximum possible node ids  ‭4193280‬*/
@@ -738,6 +789,8 @@ struct f2fs_nm_info {
 	unsigned int nat_cnt;		/* the # of cached nat entries */
 	unsigned int dirty_nat_cnt;	/* total num of nat entries in set */
 	unsigned int nat_blocks;	/* # of nat blocks =9216*/
+	unsigned long nat_seq;		/* # of NAT address changes */
+	unsigned long nat_slot_seq[NAT_SEQ_SLOTS]; /* nat_seq of last change */
 
 	/* free node ids management */
 	struct radix_tree_root free_nid_root;/* root of the free_nid cache */
@@ -807,6 +860,15 @@ static inline void set_new_dnode(struct dnode_of_data *dn, struct inode *inode,
 #define NR_CURSEG_NODE_TYPE	(3)
 #define NR_CURSEG_TYPE	(NR_CURSEG_DATA_TYPE + NR_CURSEG_NODE_TYPE)
 
+/*
+ * On top of them, stream_logs=x opens up to 8 more data logs for write
+ * streams, and alloc_shards=x up to 8 sub-logs of warm data, picked by
+ * inode number. These volatile logs live in memory only and are closed at
+ * every checkpoint.
+ */
+#define MAX_STREAM_LOGS	(8)
+#define MAX_ALLOC_SHARDS	(8)
+
 enum {
 	CURSEG_HOT_DATA	= 0,	/* directory entry blocks */
 	CURSEG_WARM_DATA,	/* data blocks */
@@ -814,23 +876,36 @@ enum {
 	CURSEG_HOT_NODE,	/* direct node blocks of directory files */
 	CURSEG_WARM_NODE,	/* direct node blocks of normal files */
 	CURSEG_COLD_NODE,	/* indirect node blocks */
-	NO_CHECK_TYPE,
+	CURSEG_STREAM_DATA,	/* first of the stream data logs */
+	CURSEG_SHARD_DATA = CURSEG_STREAM_DATA + MAX_STREAM_LOGS,
+				/* first of the warm data sub-logs */
+	NO_CHECK_TYPE = CURSEG_SHARD_DATA + MAX_ALLOC_SHARDS,
 };
 
 struct flush_cmd {
 	struct completion wait;
 	struct llist_node llnode;
 	nid_t ino;
+	unsigned int devi;		/* device to be flushed */
 	int ret;
 };
 
+/* flush merging of one device, flushes of devices run in parallel */
+struct flush_dev_queue {
+	struct block_device *bdev;		/* target device */
+	struct llist_head issue_list;		/* list for command issue */
+	struct llist_node *dispatch_list;	/* list for command dispatch */
+	struct completion done;			/* dispatched flush ended */
+	int ret;				/* result of dispatched flush */
+};
+
 struct flush_cmd_control {
 	struct task_struct *f2fs_issue_flush;	/* flush thread */
 	wait_queue_head_t flush_wait_queue;	/* waiting queue for wake-up */
 	atomic_t issued_flush;			/* # of issued flushes */
 	atomic_t issing_flush;			/* # of issing flushes */
-	struct llist_head issue_list;		/* list for command issue */
-	struct llist_node *dispatch_list;	/* list for command dispatch */
+	struct flush_dev_queue queue[MAX_DEVICES];/* per-device queues */
+	unsigned int nr_queues;			/* # of queues in use */
 };
 
 struct f2fs_sm_info {
@@ -862,6 +937,8 @@ struct f2fs_sm_info {
 	unsigned int min_ipu_util;	/* in-place-update threshold */
 	unsigned int min_fsync_blocks;	/* threshold for fsync */
 	unsigned int min_hot_blocks;	/* threshold for hot block allocation */
+	unsigned int bg_sit_flush_blocks;	/* SIT blocks written before CP */
+	unsigned int bg_sit_flush_dirty;	/* dirty entries to flush busy */
 	unsigned int min_ssr_sections;	/* threshold to trigger SSR allocation */
 
 	/* for flush command control */
@@ -1031,6 +1108,7 @@ enum {
 	SBI_POR_DOING,				/* recovery is doing or not */
 	SBI_NEED_SB_WRITE,			/* need to recover superblock */
 	SBI_NEED_CP,				/* need to checkpoint */
+	SBI_CACHED_NODE,			/* fsync chain written w/o FUA */
 };
 
 enum {
@@ -1039,6 +1117,55 @@ enum {
 	MAX_TIME,
 };
 
+/* mount phases timed in mount_time_us */
+enum {
+	MOUNT_SIT_ENTRIES,	/* decode SIT blocks and build discard maps */
+	MOUNT_FREE_SEGMAP,	/* free segment and section maps */
+	MOUNT_DIRTY_SEGMAP,	/* dirty segmaps and victim indexes */
+	MOUNT_SEGMENT_MANAGER,	/* whole build_segment_manager() */
+	MOUNT_NODE_MANAGER,	/* whole build_node_manager() */
+	NR_MOUNT_PHASES
+};
+
+/*
+ * Temperature rules given through sysfs. Suffix rules are hashed and checked
+ * with the file name at create, then uid, project and parent rules in the
+ * order they were added; size rules are checked at the first writeback.
+ */
+#define MAX_TEMP_RULES		128
+#define TEMP_RULE_HASH_BITS	6
+#define TEMP_RULE_SUFFIX_LEN	16	/* including the trailing NUL */
+
+enum {
+	TEMP_RULE_SUFFIX,	/* name has .suffix */
+	TEMP_RULE_UID,		/* owned by uid */
+	TEMP_RULE_PROJID,	/* in project */
+	TEMP_RULE_PARENT,	/* created in directory of inode number */
+	TEMP_RULE_SIZE,		/* at least this many bytes */
+	NR_TEMP_RULE_KINDS
+};
+
+struct temp_rule {
+	struct hlist_node hnode;		/* suffix hash chain */
+	unsigned char kind;			/* TEMP_RULE_XXX */
+	unsigned char temp;			/* HOT, WARM or COLD */
+	union {
+		char suffix[TEMP_RULE_SUFFIX_LEN];	/* in lower case */
+		u64 value;				/* for other kinds */
+	};
+};
+
+/*
+ * Dirty section ages of GC_AT, bucket i ends at gc_age_threshold *
+ * 2^(i + 1 - GC_AGE_HIST_YOUNG); buckets below GC_AGE_HIST_YOUNG are younger
+ * than gc_age_threshold.
+ */
+#define GC_AGE_HIST_BUCKETS	8
+#define GC_AGE_HIST_YOUNG	3
+
+/* maximum # of victims a FG_GC round, or a FG_GC slice, collects */
+#define MAX_GC_FG_VICTIMS	16
+
 struct f2fs_sb_info {
 	struct super_block *sb;			/* pointer to VFS super block */
 	struct proc_dir_entry *s_proc;		/* proc entry */
@@ -1113,6 +1240,8 @@ struct f2fs_sb_info {
 	unsigned int total_valid_node_count;	/* valid node block count */
 	loff_t max_file_blocks;			/* max block index of file 由inode中索引决定，2个直接，2间接，1三级 = 2*1018+2*1018*1018+1018*1018*1018 */
 	int active_logs;			/* # of active logs = 6 */
+	unsigned int nr_stream_logs;		/* # of stream data logs */
+	unsigned int nr_alloc_shards;		/* # of warm data sub-logs */
 	int dir_level;				/* directory level */
 	int inline_xattr_size;			/* inline xattr size = 50 */
 	unsigned int trigger_ssr_threshold;	/* threshold to trigger ssr */
@@ -1120,7 +1249,7 @@ struct f2fs_sb_info {
 
 	block_t user_block_count;		/* # of user blocks */
 	block_t total_valid_block_count;	/* # of valid blocks */
-	block_t discard_blks;			/* discard command candidats */
+	struct percpu_counter discard_blks;	/* discard command candidats */
 	block_t last_valid_block_count;		/* for recovery */
 	block_t reserved_blocks;		/* configurable reserved blocks */
 	block_t current_reserved_blocks;	/* current reserved blocks */
@@ -1139,6 +1268,7 @@ struct f2fs_sb_info {
 
 	/* writeback control */
 	atomic_t wb_sync_req;			/* count # of WB_SYNC threads */
+	atomic_t fua_flush_pending;		/* fsyncs owing a cache flush */
 
 	/* valid inode count */
 	struct percpu_counter total_valid_inode_count;
@@ -1159,6 +1289,49 @@ struct f2fs_sb_info {
 	/* maximum # of trials to find a victim segment for SSR and GC */
 	unsigned int max_victim_search;
 
+	/* minimum age in seconds of a GC_AT victim section */
+	unsigned int gc_age_threshold;
+	/* dirty section ages per gc_age_bucket(), rebuilt by GC_AT */
+	unsigned int gc_age_hist[GC_AGE_HIST_BUCKETS];
+	unsigned long long gc_age_hist_time;	/* mtime of the rebuild */
+
+	/* GC moves data modified within this many seconds to the warm log */
+	unsigned int gc_warm_data_age;
+
+	/* select LFS victims from the victim index instead of scanning */
+	unsigned int gc_victim_index;
+
+	/* select SSR segments from the per-type SSR index */
+	unsigned int ssr_victim_index;
+
+	/* learn data temperature from rewrite intervals of unhinted files */
+	unsigned int temp_classify;
+	unsigned int temp_hot_age;		/* hot if rewritten sooner */
+	unsigned int temp_cold_age;		/* cold if rewritten later */
+	atomic64_t temp_hit[NR_TEMP_TYPE];	/* blocks placed right */
+	atomic64_t temp_miss[NR_TEMP_TYPE];	/* blocks placed wrong */
+
+	/* temperature rules applied to new and first written files */
+	rwlock_t temp_rule_lock;
+	DECLARE_HASHTABLE(temp_rule_hash, TEMP_RULE_HASH_BITS);
+	struct temp_rule temp_rules[MAX_TEMP_RULES];
+	unsigned int nr_temp_rules;
+
+	/* time taken by each mount phase, and # of workers building SIT */
+	s64 mount_time_us[NR_MOUNT_PHASES];
+	unsigned int mount_workers;
+
+	/* FG_GC victims per round and data migration workers */
+	unsigned int gc_fg_victims;
+	unsigned int gc_migrate_workers;
+	struct workqueue_struct *gc_migrate_wq;
+	atomic64_t gc_read_wait_us;		/* blocking page reads of GC */
+
+	/* time slice of FG_GC in f2fs_balance_fs(), and where it stopped */
+	unsigned int gc_fg_slice_ms;
+	unsigned int gc_resume_segno[MAX_GC_FG_VICTIMS];
+	unsigned int gc_resume_nr;
+
 	/*
 	 * for stat information.
 	 * one is for the LFS mode, and the other is for the SSR mode.
@@ -1267,9 +1440,9 @@ static inline bool f2fs_time_over(struct f2fs_sb_info *sbi, int type)
 	return time_after(jiffies, sbi->last_time[type] + interval);
 }
 
-static inline bool is_idle(struct f2fs_sb_info *sbi)
+static inline bool is_bdev_idle(struct f2fs_sb_info *sbi,
+					struct block_device *bdev)
 {
-	struct block_device *bdev = sbi->sb->s_bdev;
 	struct request_queue *q = bdev_get_queue(bdev);
 	struct request_list *rl = &q->root_rl;
 
@@ -1279,6 +1452,11 @@ static inline bool is_idle(struct f2fs_sb_info *sbi)
 	return f2fs_time_over(sbi, REQ_TIME);
 }
 
+static inline bool is_idle(struct f2fs_sb_info *sbi)
+{
+	return is_bdev_idle(sbi, sbi->sb->s_bdev);
+}
+
 /*
  * Inline functions
  */
@@ -1331,6 +1509,16 @@ static inline struct f2fs_sb_info *F2FS_SB(struct super_block *sb)
 	return sb->s_fs_info;
 }
 
+/* DATA has a write bio per temperature, then one per volatile log */
+static inline int nr_write_io(struct f2fs_sb_info *sbi, enum page_type type)
+{
+	if (type == META)
+		return 1;
+	if (type == NODE)
+		return NR_TEMP_TYPE;
+	return NR_TEMP_TYPE + sbi->nr_stream_logs + sbi->nr_alloc_shards;
+}
+
 static inline struct f2fs_sb_info *F2FS_I_SB(struct inode *inode)
 {
 	return F2FS_SB(inode->i_sb);
@@ -1416,6 +1604,15 @@ static inline void clear_sbi_flag(struct f2fs_sb_info *sbi, unsigned int type)
 	clear_bit(type, &sbi->s_flag);
 }
 
+/*
+ * With fua_fsync, fsync writes its data and node chain with REQ_FUA and
+ * leaves full cache flushes to checkpoints.
+ */
+static inline bool f2fs_fua_fsync(struct f2fs_sb_info *sbi)
+{
+	return test_opt(sbi, FUA_FSYNC) && !test_opt(sbi, NOBARRIER);
+}
+
 static inline unsigned long long cur_cp_version(struct f2fs_checkpoint *cp)
 {
 	return le64_to_cpu(cp->checkpoint_ver);
@@ -1738,7 +1935,7 @@ static inline block_t valid_user_blocks(struct f2fs_sb_info *sbi)
 
 static inline block_t discard_blocks(struct f2fs_sb_info *sbi)
 {
-	return sbi->discard_blks;
+	return percpu_counter_sum_positive(&sbi->discard_blks);
 }
 
 static inline unsigned long __bitmap_size(struct f2fs_sb_info *sbi, int flag)
@@ -2116,6 +2313,26 @@ static inline void f2fs_change_bit(unsigned int nr, char *addr)
 	*addr ^= mask;
 }
 
+/*
+ * f2fs_set_bit() puts bit 0 in the MSB of the first byte, so a word of such
+ * bitmap loaded in big-endian order has bit 0 in its MSB, which lets us scan
+ * it a word at a time with __fls().
+ */
+static inline unsigned long f2fs_bitmap_word(const unsigned long *p)
+{
+#if BITS_PER_LONG == 64
+	return be64_to_cpu(*(const __be64 *)p);
+#else
+	return be32_to_cpu(*(const __be32 *)p);
+#endif
+}
+
+/* bit number of the first set bit in a word from f2fs_bitmap_word() */
+static inline unsigned long f2fs_first_bit(unsigned long word)
+{
+	return BITS_PER_LONG - 1 - __fls(word);
+}
+
 #define F2FS_REG_FLMASK		(~(FS_DIRSYNC_FL | FS_TOPDIR_FL))
 #define F2FS_OTHER_FLMASK	(FS_NODUMP_FL | FS_NOATIME_FL)
 #define F2FS_FL_INHERITED	(FS_PROJINHERIT_FL)
@@ -2161,6 +2378,9 @@ enum {
 	FI_EXTRA_ATTR,		/* indicate file has extra attribute */
 	FI_PROJ_INHERIT,	/* indicate file inherits projectid */
 	FI_PIN_FILE,		/* indicate file should not be gced */
+	FI_TEMP_RULED,		/* indicate size rules were checked */
+	FI_FUA_WRITE,		/* write data with REQ_FUA for fsync */
+	FI_CACHED_WRITE,	/* data written w/o FUA since last flush */
 };
 
 static inline void __mark_inode_dirty_flag(struct inode *inode,
@@ -2598,6 +2818,11 @@ void handle_failed_inode(struct inode *inode);
 /*
  * namei.c
  */
+void init_temp_rules(struct f2fs_sb_info *sbi);
+void apply_temp_rules(struct inode *inode, struct inode *dir,
+			const unsigned char *name);
+int update_temp_rules(struct f2fs_sb_info *sbi, char *cmd);
+int show_temp_rules(struct f2fs_sb_info *sbi, char *buf);
 struct dentry *f2fs_get_parent(struct dentry *child);
 
 /*
@@ -2679,6 +2904,8 @@ int need_dentry_mark(struct f2fs_sb_info *sbi, nid_t nid);
 bool is_checkpointed_node(struct f2fs_sb_info *sbi, nid_t nid);
 bool need_inode_block_update(struct f2fs_sb_info *sbi, nid_t ino);
 void get_node_info(struct f2fs_sb_info *sbi, nid_t nid, struct node_info *ni);
+unsigned long get_node_info_batch(struct f2fs_sb_info *sbi,
+				struct node_info *nis, unsigned int count);
 pgoff_t get_next_page_offset(struct dnode_of_data *dn, pgoff_t pgofs);
 int get_dnode_of_data(struct dnode_of_data *dn, pgoff_t index, int mode);
 int truncate_inode_blocks(struct inode *inode, pgoff_t from);
@@ -2688,7 +2915,11 @@ int remove_inode_page(struct inode *inode);
 struct page *new_inode_page(struct inode *inode);
 struct page *new_node_page(struct dnode_of_data *dn, unsigned int ofs);
 void ra_node_page(struct f2fs_sb_info *sbi, nid_t nid);
+void ra_node_page_ni(struct f2fs_sb_info *sbi, struct node_info *ni,
+						unsigned long nat_seq);
 struct page *get_node_page(struct f2fs_sb_info *sbi, pgoff_t nid);
+struct page *get_node_page_ni(struct f2fs_sb_info *sbi, struct node_info *ni,
+						unsigned long nat_seq);
 struct page *get_node_page_ra(struct page *parent, int start);
 void move_node_page(struct page *node_page, int gc_type);
 int fsync_node_pages(struct f2fs_sb_info *sbi, struct inode *inode,
@@ -2726,7 +2957,9 @@ int f2fs_issue_flush(struct f2fs_sb_info *sbi, nid_t ino);
 int create_flush_cmd_control(struct f2fs_sb_info *sbi);
 int f2fs_flush_device_cache(struct f2fs_sb_info *sbi);
 void destroy_flush_cmd_control(struct f2fs_sb_info *sbi, bool free);
+void refresh_stale_victims(struct f2fs_sb_info *sbi);
 void invalidate_blocks(struct f2fs_sb_info *sbi, block_t addr);
+void load_sit_block(struct f2fs_sb_info *sbi, unsigned int blk);
 bool is_checkpointed_data(struct f2fs_sb_info *sbi, block_t blkaddr);
 void init_discard_policy(struct discard_policy *dpolicy, int discard_type,
 						unsigned int granularity);
@@ -2737,6 +2970,7 @@ void clear_prefree_segments(struct f2fs_sb_info *sbi, struct cp_control *cpc);
 void release_discard_addrs(struct f2fs_sb_info *sbi);
 int npages_for_summary_flush(struct f2fs_sb_info *sbi, bool for_ra);
 void allocate_new_segments(struct f2fs_sb_info *sbi);
+void close_volatile_logs(struct f2fs_sb_info *sbi);
 int f2fs_trim_fs(struct f2fs_sb_info *sbi, struct fstrim_range *range);
 bool exist_trim_candidates(struct f2fs_sb_info *sbi, struct cp_control *cpc);
 struct page *get_sum_page(struct f2fs_sb_info *sbi, unsigned int segno);
@@ -2764,6 +2998,7 @@ void write_data_summaries(struct f2fs_sb_info *sbi, block_t start_blk);
 void write_node_summaries(struct f2fs_sb_info *sbi, block_t start_blk);
 int lookup_journal_in_cursum(struct f2fs_journal *journal, int type,
 			unsigned int val, int alloc);
+void flush_sit_entries_bg(struct f2fs_sb_info *sbi);
 void flush_sit_entries(struct f2fs_sb_info *sbi, struct cp_control *cpc);
 int build_segment_manager(struct f2fs_sb_info *sbi);
 void destroy_segment_manager(struct f2fs_sb_info *sbi);
@@ -2858,10 +3093,14 @@ int f2fs_migrate_page(struct address_space *mapping, struct page *newpage,
  */
 int start_gc_thread(struct f2fs_sb_info *sbi);
 void stop_gc_thread(struct f2fs_sb_info *sbi);
+unsigned int gc_age_bucket(struct f2fs_sb_info *sbi,
+					unsigned long long age);
+int get_gc_data_type(struct inode *inode);
 block_t start_bidx_of_node(unsigned int node_ofs, struct inode *inode);
 int f2fs_gc(struct f2fs_sb_info *sbi, bool sync, bool background,
 			unsigned int segno);
-void build_gc_manager(struct f2fs_sb_info *sbi);
+int build_gc_manager(struct f2fs_sb_info *sbi);
+void destroy_gc_manager(struct f2fs_sb_info *sbi);
 
 /*
  * recovery.c
@@ -2892,11 +3131,13 @@ struct f2fs_stat_info {
 	int nr_flushing, nr_flushed, flush_list_empty;
 	int nr_discarding, nr_discarded;
 	int nr_discard_cmd;
+	int nr_merged_discard, nr_deferred_discard;
 	unsigned int undiscard_blks;
 	int inline_xattr, inline_inode, inline_dir, append, update, orphans;
 	int aw_cnt, max_aw_cnt, vw_cnt, max_vw_cnt;
 	unsigned int valid_count, valid_node_count, valid_inode_count, discard_blks;
 	unsigned int bimodal, avg_vblocks;
+	unsigned int age_hist[GC_AGE_HIST_BUCKETS];
 	int util_free, util_valid, util_invalid;
 	int rsvd_segs, overp_segs;
 	int dirty_count, node_pages, meta_pages;
@@ -2905,6 +3146,8 @@ struct f2fs_stat_info {
 	int bg_node_segs, bg_data_segs;
 	int tot_blks, data_blks, node_blks;
 	int bg_data_blks, bg_node_blks;
+	int gc_timed_secs;
+	unsigned long long gc_read_time, gc_write_time;	/* in us */
 	int curseg[NR_CURSEG_TYPE];
 	int cursec[NR_CURSEG_TYPE];
 	int curzone[NR_CURSEG_TYPE];
@@ -3020,6 +3263,14 @@ static inline struct f2fs_stat_info *F2FS_STAT(struct f2fs_sb_info *sbi)
 		si->bg_node_blks += ((gc_type) == BG_GC) ? (blks) : 0;	\
 	} while (0)
 
+#define stat_inc_gc_sec_time(sbi, secs, read_us, write_us)		\
+	do {								\
+		struct f2fs_stat_info *si = F2FS_STAT(sbi);		\
+		si->gc_timed_secs += (secs);				\
+		si->gc_read_time += (read_us);				\
+		si->gc_write_time += (write_us);			\
+	} while (0)
+
 int f2fs_build_stats(struct f2fs_sb_info *sbi);
 void f2fs_destroy_stats(struct f2fs_sb_info *sbi);
 int __init f2fs_create_root_stats(void);
@@ -3055,6 +3306,7 @@ void f2fs_destroy_root_stats(void);
 #define stat_inc_tot_blk_count(si, blks)		do { } while (0)
 #define stat_inc_data_blk_count(sbi, blks, gc_type)	do { } while (0)
 #define stat_inc_node_blk_count(sbi, blks, gc_type)	do { } while (0)
+#define stat_inc_gc_sec_time(sbi, secs, read_us, write_us)	do { } while (0)
 
 static inline int f2fs_build_stats(struct f2fs_sb_info *sbi) { return 0; }
 static inline void f2fs_destroy_stats(struct f2fs_sb_info *sbi) { }
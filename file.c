@@ -197,6 +197,55 @@ static void try_to_fix_pino(struct inode *inode)
 	up_write(&fi->i_sem);
 }
 
+/*
+ * With fua_fsync the blocks written by this fsync are already durable,
+ * so flush the cache only if data of the inode or the node chain went
+ * through it since the last flush.
+ *
+ * The flags are taken before writeback starts: writes racing with this
+ * fsync set them again, and this fsync owes a flush for what it took.
+ * fua_flush_pending counts such fsyncs, so that others running meanwhile
+ * don't return before the cache holding their node chain is flushed.
+ */
+static bool fsync_take_cached(struct f2fs_sb_info *sbi, struct inode *inode)
+{
+	bool cached;
+
+	if (!f2fs_fua_fsync(sbi))
+		return false;
+
+	cached = is_inode_flag_set(inode, FI_CACHED_WRITE) ||
+			is_sbi_flag_set(sbi, SBI_CACHED_NODE);
+	if (cached) {
+		atomic_inc(&sbi->fua_flush_pending);
+		clear_inode_flag(inode, FI_CACHED_WRITE);
+		clear_sbi_flag(sbi, SBI_CACHED_NODE);
+	}
+	return cached;
+}
+
+/* settle what fsync_take_cached() took, once the flush is done or not */
+static void fsync_put_cached(struct f2fs_sb_info *sbi, struct inode *inode,
+						bool flushed)
+{
+	if (!flushed) {
+		set_inode_flag(inode, FI_CACHED_WRITE);
+		set_sbi_flag(sbi, SBI_CACHED_NODE);
+	}
+	atomic_dec(&sbi->fua_flush_pending);
+}
+
+static bool fsync_need_flush(struct f2fs_sb_info *sbi, struct inode *inode,
+						bool cached)
+{
+	if (!f2fs_fua_fsync(sbi))
+		return true;
+
+	return cached || is_inode_flag_set(inode, FI_CACHED_WRITE) ||
+			is_sbi_flag_set(sbi, SBI_CACHED_NODE) ||
+			atomic_read(&sbi->fua_flush_pending);
+}
+
 static int f2fs_do_sync_file(struct file *file, loff_t start, loff_t end,
 						int datasync, bool atomic)
 {
@@ -204,6 +253,7 @@ static int f2fs_do_sync_file(struct file *file, loff_t start, loff_t end,
 	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
 	nid_t ino = inode->i_ino;
 	int ret = 0;
+	bool cached = false, flushed = false;
 	enum cp_reason_type cp_reason = 0;
 	struct writeback_control wbc = {
 		.sync_mode = WB_SYNC_ALL,
@@ -219,10 +269,17 @@ static int f2fs_do_sync_file(struct file *file, loff_t start, loff_t end,
 	/* if fdatasync is triggered, let's do in-place-update */
 	if (datasync || get_dirty_pages(inode) <= SM_I(sbi)->min_fsync_blocks)
 		set_inode_flag(inode, FI_NEED_IPU);
+	if (f2fs_fua_fsync(sbi) && !atomic) {
+		cached = fsync_take_cached(sbi, inode);
+		set_inode_flag(inode, FI_FUA_WRITE);
+	}
 	ret = file_write_and_wait_range(file, start, end);
 	clear_inode_flag(inode, FI_NEED_IPU);
+	clear_inode_flag(inode, FI_FUA_WRITE);
 
 	if (ret) {
+		if (cached)
+			fsync_put_cached(sbi, inode, false);
 		trace_f2fs_sync_file_exit(inode, cp_reason, datasync, ret);
 		return ret;
 	}
@@ -305,8 +362,10 @@ sync_nodes:
 	remove_ino_entry(sbi, ino, APPEND_INO);
 	clear_inode_flag(inode, FI_APPEND_WRITE);
 flush_out:
-	if (!atomic)
+	if (!atomic && fsync_need_flush(sbi, inode, cached)) {
 		ret = f2fs_issue_flush(sbi, inode->i_ino);
+		flushed = !ret;
+	}
 	if (!ret) {
 		remove_ino_entry(sbi, ino, UPDATE_INO);
 		clear_inode_flag(inode, FI_UPDATE_WRITE);
@@ -314,6 +373,8 @@ flush_out:
 	}
 	f2fs_update_time(sbi, REQ_TIME);
 out:
+	if (cached)
+		fsync_put_cached(sbi, inode, flushed);
 	trace_f2fs_sync_file_exit(inode, cp_reason, datasync, ret);
 	f2fs_trace_ios(NULL, 1);
 	return ret;
@@ -2477,6 +2538,7 @@ static int f2fs_ioc_flush_device(struct file *filp, unsigned long arg)
 		}
 		sm->last_victim[GC_CB] = end_segno + 1;
 		sm->last_victim[GC_GREEDY] = end_segno + 1;
+		sm->last_victim[GC_AT] = end_segno + 1;
 		sm->last_victim[ALLOC_NEXT] = end_segno + 1;
 		ret = f2fs_gc(sbi, true, true, start_segno);
 		if (ret == -EAGAIN)
@@ -2777,6 +2839,32 @@ static int f2fs_ioc_get_pin_file(struct file *filp, unsigned long arg)
 	return put_user(pin, (u32 __user *)arg);
 }
 
+static int f2fs_ioc_set_stream(struct file *filp, unsigned long arg)
+{
+	struct inode *inode = file_inode(filp);
+	__u32 stream;
+
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+
+	if (get_user(stream, (__u32 __user *)arg))
+		return -EFAULT;
+
+	if (!S_ISREG(inode->i_mode) || stream > MAX_STREAM_LOGS)
+		return -EINVAL;
+
+	/* stream ids are folded onto the stream logs being mounted */
+	F2FS_I(inode)->i_stream = stream;
+	return 0;
+}
+
+static int f2fs_ioc_get_stream(struct file *filp, unsigned long arg)
+{
+	struct inode *inode = file_inode(filp);
+
+	return put_user(F2FS_I(inode)->i_stream, (u32 __user *)arg);
+}
+
 int f2fs_precache_extents(struct inode *inode)
 {
 	struct f2fs_inode_info *fi = F2FS_I(inode);
@@ -2868,6 +2956,10 @@ long f2fs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		return f2fs_ioc_get_pin_file(filp, arg);
 	case F2FS_IOC_SET_PIN_FILE:
 		return f2fs_ioc_set_pin_file(filp, arg);
+	case F2FS_IOC_SET_STREAM:
+		return f2fs_ioc_set_stream(filp, arg);
+	case F2FS_IOC_GET_STREAM:
+		return f2fs_ioc_get_stream(filp, arg);
 	case F2FS_IOC_PRECACHE_EXTENTS:
 		return f2fs_ioc_precache_extents(filp, arg);
 	default:
@@ -2947,6 +3039,8 @@ long f2fs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case F2FS_IOC_FSSETXATTR:
 	case F2FS_IOC_GET_PIN_FILE:
 	case F2FS_IOC_SET_PIN_FILE:
+	case F2FS_IOC_SET_STREAM:
+	case F2FS_IOC_GET_STREAM:
 	case F2FS_IOC_PRECACHE_EXTENTS:
 		break;
 	default:
@@ -84,6 +84,20 @@ static int gc_thread_func(void *data)
 			goto do_gc;
 		}
 
+		/*
+		 * QoS mode paces BG_GC with its budget instead of idleness.
+		 * Without any limit the budget is unlimited, so BG_GC stays
+		 * gated on idleness as usual.
+		 */
+		if (gc_qos_limited(gc_th)) {
+			wait_ms = DEF_GC_THREAD_QOS_SLEEP_TIME;
+			if (!gc_qos_refill(gc_th)) {
+				mutex_unlock(&sbi->gc_mutex);
+				goto next;
+			}
+			goto do_gc;
+		}
+
 		if (!is_idle(sbi)) {
 			increase_sleep_time(gc_th, &wait_ms);
 			mutex_unlock(&sbi->gc_mutex);
@@ -134,6 +148,14 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 	gc_th->gc_urgent = 0;
 	gc_th->gc_wake= 0;
 
+	gc_th->gc_qos = 0;
+	gc_th->qos_mbps = 0;
+	gc_th->qos_iops = 0;
+	gc_th->qos_exhausted = 0;
+	gc_th->qos_bytes = 0;
+	gc_th->qos_ios = 0;
+	gc_th->qos_refill_time = jiffies;
+
 	sbi->gc_thread = gc_th;
 	init_waitqueue_head(&sbi->gc_thread->gc_wait_queue_head);
 	sbi->gc_thread->f2fs_gc_task = kthread_run(gc_thread_func, sbi,
@@ -166,6 +188,8 @@ static int select_gc_type(struct f2fs_gc_kthread *gc_th, int gc_type)
 			gc_mode = GC_CB;
 		else if (gc_th->gc_idle == 2)
 			gc_mode = GC_GREEDY;
+		else if (gc_th->gc_idle == 3)
+			gc_mode = GC_AT;
 	}
 	return gc_mode;
 }
@@ -192,7 +216,8 @@ static void select_policy(struct f2fs_sb_info *sbi, int gc_type,
 		p->max_search = sbi->max_victim_search;
 
 	/* let's select beginning hot/small space first */
-	if (type == CURSEG_HOT_DATA || IS_NODESEG(type))
+	if (type == CURSEG_HOT_DATA || IS_NODESEG(type) ||
+						type == NO_CHECK_TYPE)
 		p->offset = 0;
 	else
 		p->offset = SIT_I(sbi)->last_victim[p->gc_mode];
@@ -206,6 +231,9 @@ static unsigned int get_max_cost(struct f2fs_sb_info *sbi,
 		return sbi->blocks_per_seg;
 	if (p->gc_mode == GC_GREEDY)
 		return 2 * sbi->blocks_per_seg * p->ofs_unit;
+	else if (p->gc_mode == GC_AT)
+		return 2 * sbi->blocks_per_seg * p->ofs_unit *
+				(GC_AGE_HIST_BUCKETS - GC_AGE_HIST_YOUNG);
 	else if (p->gc_mode == GC_CB)
 		return UINT_MAX;
 	else /* No other gc_mode */
@@ -235,22 +263,100 @@ static unsigned int check_bg_victims(struct f2fs_sb_info *sbi)
 	return NULL_SEGNO;
 }
 
+static unsigned long long get_section_mtime(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	unsigned int start = GET_SEG_FROM_SEC(sbi,
+					GET_SEC_FROM_SEG(sbi, segno));
+	unsigned long long mtime = 0;
+	unsigned int i;
+
+	for (i = 0; i < sbi->segs_per_sec; i++)
+		mtime += get_seg_entry(sbi, start + i)->mtime;
+	return div_u64(mtime, sbi->segs_per_sec);
+}
+
+/*
+ * Bucket i ends at gc_age_threshold * 2^(i + 1 - GC_AGE_HIST_YOUNG), so
+ * bucket GC_AGE_HIST_YOUNG is the first to start at gc_age_threshold.
+ */
+unsigned int gc_age_bucket(struct f2fs_sb_info *sbi, unsigned long long age)
+{
+	unsigned long long limit = max_t(unsigned int,
+			sbi->gc_age_threshold >> (GC_AGE_HIST_YOUNG - 1), 1);
+	unsigned int i;
+
+	for (i = 0; i < GC_AGE_HIST_BUCKETS - 1; i++) {
+		if (age < limit)
+			break;
+		limit <<= 1;
+	}
+	return i;
+}
+
+static unsigned int get_section_age_bucket(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	unsigned long long now = get_mtime(sbi);
+	unsigned long long mtime = get_section_mtime(sbi, segno);
+
+	return gc_age_bucket(sbi, now > mtime ? now - mtime : 0);
+}
+
+/* GC_AT leaves sections alone until they are gc_age_threshold old */
+static bool is_young_section(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	return get_section_age_bucket(sbi, segno) < GC_AGE_HIST_YOUNG;
+}
+
+/*
+ * Rebuild the age histogram of dirty sections, at most once per
+ * GC_AGE_HIST_INTERVAL. Caller should hold seglist_lock.
+ */
+static void update_gc_age_hist(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned long long now = get_mtime(sbi);
+	unsigned int segno = 0;
+
+	if (sbi->gc_age_hist_time && now >= sbi->gc_age_hist_time &&
+		now < sbi->gc_age_hist_time + GC_AGE_HIST_INTERVAL)
+		return;
+
+	memset(sbi->gc_age_hist, 0, sizeof(sbi->gc_age_hist));
+	while (1) {
+		segno = find_next_bit(dirty_i->dirty_segmap[DIRTY],
+						MAIN_SEGS(sbi), segno);
+		if (segno >= MAIN_SEGS(sbi))
+			break;
+		sbi->gc_age_hist[get_section_age_bucket(sbi, segno)]++;
+		/* count each section once */
+		segno = GET_SEG_FROM_SEC(sbi,
+				GET_SEC_FROM_SEG(sbi, segno) + 1);
+	}
+	sbi->gc_age_hist_time = now;
+}
+
+/* number of dirty sections old enough for GC_AT */
+static unsigned int gc_age_hist_old(struct f2fs_sb_info *sbi)
+{
+	unsigned int i, nr = 0;
+
+	for (i = GC_AGE_HIST_YOUNG; i < GC_AGE_HIST_BUCKETS; i++)
+		nr += sbi->gc_age_hist[i];
+	return nr;
+}
+
 static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
 {
 	struct sit_info *sit_i = SIT_I(sbi);
-	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
-	unsigned int start = GET_SEG_FROM_SEC(sbi, secno);
-	unsigned long long mtime = 0;
+	unsigned long long mtime, max_mtime;
 	unsigned int vblocks;
 	unsigned char age = 0;
 	unsigned char u;
-	unsigned int i;
 
-	for (i = 0; i < sbi->segs_per_sec; i++)
-		mtime += get_seg_entry(sbi, start + i)->mtime;
+	mtime = get_section_mtime(sbi, segno);
 	vblocks = get_valid_blocks(sbi, segno, true);
-
-	mtime = div_u64(mtime, sbi->segs_per_sec);
 	vblocks = div_u64(vblocks, sbi->segs_per_sec);
 
 	u = (vblocks * 100) >> sbi->log_blocks_per_seg;
@@ -258,11 +364,11 @@ static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
 	/* Handle if the system time has changed by the user */
 	if (mtime < sit_i->min_mtime)
 		sit_i->min_mtime = mtime;
-	if (mtime > sit_i->max_mtime)
-		sit_i->max_mtime = mtime;
-	if (sit_i->max_mtime != sit_i->min_mtime)
+	update_max_mtime(sit_i, mtime);
+	max_mtime = READ_ONCE(sit_i->max_mtime);
+	if (max_mtime != sit_i->min_mtime)
 		age = 100 - div64_u64(100 * (mtime - sit_i->min_mtime),
-				sit_i->max_mtime - sit_i->min_mtime);
+				max_mtime - sit_i->min_mtime);
 
 	return UINT_MAX - ((100 * (100 - u) * age) / (100 + u));
 }
@@ -276,18 +382,137 @@ static inline unsigned int get_gc_cost(struct f2fs_sb_info *sbi,
 	/* alloc_mode == LFS */
 	if (p->gc_mode == GC_GREEDY)
 		return get_valid_blocks(sbi, segno, true);
+	else if (p->gc_mode == GC_AT)
+		/*
+		 * older buckets weigh valid blocks less, from
+		 * GC_AGE_HIST_BUCKETS - GC_AGE_HIST_YOUNG at gc_age_threshold
+		 * down to one; younger sections are never considered
+		 */
+		return get_valid_blocks(sbi, segno, true) *
+			(GC_AGE_HIST_BUCKETS -
+				get_section_age_bucket(sbi, segno));
 	else
 		return get_cb_cost(sbi, segno);
 }
 
+/*
+ * Lower bound of get_cb_cost() for any section holding @vblocks valid
+ * blocks, i.e. the cost it would have at the maximum age.
+ */
+static unsigned int get_cb_cost_bound(struct f2fs_sb_info *sbi,
+						unsigned int vblocks)
+{
+	unsigned char u;
+
+	vblocks = div_u64(vblocks, sbi->segs_per_sec);
+	u = (vblocks * 100) >> sbi->log_blocks_per_seg;
+
+	return UINT_MAX - ((100 * (100 - u) * 100) / (100 + u));
+}
+
+/* lower bound of get_gc_cost() for any section with @vblocks valid blocks */
+static unsigned int get_gc_cost_bound(struct f2fs_sb_info *sbi,
+			unsigned int vblocks, struct victim_sel_policy *p)
+{
+	if (p->gc_mode == GC_CB)
+		return get_cb_cost_bound(sbi, vblocks);
+	/* GC_AT weighs the oldest bucket by one */
+	return vblocks;
+}
+
+/*
+ * Walk the victim index from the emptiest bucket. Greedy stops at the
+ * first usable section, and cost-benefit and age-threshold stop once no
+ * section in the remaining buckets can beat the current minimum, so all
+ * return the same victim as a full scan of the dirty segmap would.
+ */
+static void lookup_victim_index(struct f2fs_sb_info *sbi, int gc_type,
+					struct victim_sel_policy *p)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_index *vi = &dirty_i->vindex;
+	struct victim_entry *ve;
+	unsigned int vblocks;
+
+	for_each_set_bit(vblocks, vi->bucket_map, vi->nr_buckets) {
+		if (gc_type == FG_GC && vblocks > sbi->fggc_threshold)
+			break;
+		if (p->min_segno != NULL_SEGNO &&
+			get_gc_cost_bound(sbi, vblocks, p) >= p->min_cost)
+			break;
+
+		list_for_each_entry(ve, &vi->buckets[vblocks], list) {
+			unsigned int secno = ve - vi->entries;
+			unsigned int segno = GET_SEG_FROM_SEC(sbi, secno);
+			unsigned long cost;
+
+			if (sec_usage_check(sbi, secno))
+				continue;
+			if (gc_type == BG_GC &&
+				test_bit(secno, dirty_i->victim_secmap))
+				continue;
+			if (p->gc_mode == GC_AT && is_young_section(sbi, segno))
+				continue;
+
+			cost = get_gc_cost(sbi, segno, p);
+			if (p->min_cost > cost) {
+				p->min_segno = segno;
+				p->min_cost = cost;
+				if (p->gc_mode == GC_GREEDY)
+					break;
+			}
+		}
+	}
+}
+
+/*
+ * SSR cost is ckpt_valid_blocks, so the first usable segment in the lowest
+ * non-empty bucket of the SSR index is what a full greedy scan would pick.
+ */
+static void lookup_ssr_index(struct f2fs_sb_info *sbi, int gc_type, int type,
+					struct victim_sel_policy *p)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_index *vi = &dirty_i->ssr_index[type];
+	struct victim_entry *ve;
+	unsigned int vblocks;
+
+	for_each_set_bit(vblocks, vi->bucket_map, vi->nr_buckets) {
+		if (vblocks >= p->min_cost)
+			break;
+
+		list_for_each_entry(ve, &vi->buckets[vblocks], list) {
+			unsigned int segno = ve - dirty_i->ssr_entries;
+			unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
+
+			if (sec_usage_check(sbi, secno))
+				continue;
+			if (gc_type == BG_GC &&
+				test_bit(secno, dirty_i->victim_secmap))
+				continue;
+
+			p->min_segno = segno;
+			p->min_cost = get_gc_cost(sbi, segno, p);
+			return;
+		}
+	}
+}
+
 static unsigned int count_bits(const unsigned long *addr,
 				unsigned int offset, unsigned int len)
 {
 	unsigned int end = offset + len, sum = 0;
 
 	while (offset < end) {
-		if (test_bit(offset++, addr))
-			++sum;
+		unsigned int shift = offset % BITS_PER_LONG;
+		unsigned int bits = min_t(unsigned int, end - offset,
+						BITS_PER_LONG - shift);
+		unsigned long word = addr[BIT_WORD(offset)] >> shift;
+
+		if (bits < BITS_PER_LONG)
+			word &= (1UL << bits) - 1;
+		sum += hweight_long(word);
+		offset += bits;
 	}
 	return sum;
 }
@@ -311,6 +536,7 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 	unsigned int nsearched = 0;
 
 	mutex_lock(&dirty_i->seglist_lock);
+	refresh_stale_victims(sbi);
 
 	p.alloc_mode = alloc_mode;
 	select_policy(sbi, gc_type, type, &p);
@@ -329,13 +555,37 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 	if (p.max_search == 0)
 		goto out;
 
-	last_victim = sm->last_victim[p.gc_mode];
 	if (p.alloc_mode == LFS && gc_type == FG_GC) {
 		p.min_segno = check_bg_victims(sbi);
 		if (p.min_segno != NULL_SEGNO)
 			goto got_it;
 	}
 
+	if (p.alloc_mode == LFS && p.gc_mode == GC_AT) {
+		update_gc_age_hist(sbi);
+		/* no section is old enough, FG_GC falls back to greedy */
+		if (!gc_age_hist_old(sbi)) {
+			if (gc_type == BG_GC)
+				goto out;
+			p.gc_mode = GC_GREEDY;
+			p.max_search = dirty_i->nr_dirty[DIRTY];
+			p.offset = 0;
+		}
+	}
+
+retry:
+	last_victim = sm->last_victim[p.gc_mode];
+
+	if (p.alloc_mode == LFS && sbi->gc_victim_index) {
+		lookup_victim_index(sbi, gc_type, &p);
+		goto found;
+	}
+
+	if (p.alloc_mode == SSR && sbi->ssr_victim_index) {
+		lookup_ssr_index(sbi, gc_type, type, &p);
+		goto found;
+	}
+
 	while (1) {
 		unsigned long cost;
 		unsigned int segno;
@@ -371,6 +621,8 @@ static int get_victim_by_default(struct f2fs_sb_info *sbi,
 		if (gc_type == FG_GC && p.alloc_mode == LFS &&
 					no_fggc_candidate(sbi, secno))
 			goto next;
+		if (p.gc_mode == GC_AT && is_young_section(sbi, segno))
+			goto next;
 
 		cost = get_gc_cost(sbi, segno, &p);
 
@@ -388,13 +640,33 @@ next:
 			break;
 		}
 	}
+found:
+	if (p.min_segno == NULL_SEGNO && p.gc_mode == GC_AT &&
+						gc_type == FG_GC) {
+		/* FG_GC cannot wait for sections to get old enough */
+		p.gc_mode = GC_GREEDY;
+		p.max_search = dirty_i->nr_dirty[DIRTY];
+		p.offset = 0;
+		last_segment = MAIN_SEGS(sbi);
+		nsearched = 0;
+		goto retry;
+	}
+
 	if (p.min_segno != NULL_SEGNO) {
 got_it:
 		if (p.alloc_mode == LFS) {
 			secno = GET_SEC_FROM_SEG(sbi, p.min_segno);
-			if (gc_type == FG_GC)
+			if (p.gc_mode == GC_AT) {
+				unsigned int i = get_section_age_bucket(sbi,
+								p.min_segno);
+
+				if (sbi->gc_age_hist[i])
+					sbi->gc_age_hist[i]--;
+			}
+			if (gc_type == FG_GC) {
 				sbi->cur_victim_sec = secno;
-			else
+				set_bit(secno, dirty_i->cur_victim_secmap);
+			} else
 				set_bit(secno, dirty_i->victim_secmap);
 		}
 		*result = (p.min_segno / p.ofs_unit) * p.ofs_unit;
@@ -463,28 +735,34 @@ static int check_valid_map(struct f2fs_sb_info *sbi,
 	return ret;
 }
 
+/* account the time GC blocked on a page read since @start as read wait */
+static void gc_read_done(struct f2fs_sb_info *sbi, ktime_t start)
+{
+	atomic64_add(ktime_us_delta(ktime_get(), start),
+					&sbi->gc_read_wait_us);
+}
+
 /*
  * This function compares node address got in summary with that in NAT.
  * On validity, copy that node with cold status, otherwise (invalid node)
  * ignore that.
  */
 static void gc_node_segment(struct f2fs_sb_info *sbi,
-		struct f2fs_summary *sum, unsigned int segno, int gc_type)
+		struct f2fs_summary *sum, unsigned int segno, int gc_type,
+		int phase)
 {
 	struct f2fs_summary *entry;
 	block_t start_addr;
 	int off;
-	int phase = 0;
 
 	start_addr = START_BLOCK(sbi, segno);
-
-next_step:
 	entry = sum;
 
 	for (off = 0; off < sbi->blocks_per_seg; off++, entry++) {
 		nid_t nid = le32_to_cpu(entry->nid);
 		struct page *node_page;
 		struct node_info ni;
+		ktime_t read_start;
 
 		/* stop BG_GC if there is not enough free sections. */
 		if (gc_type == BG_GC && has_not_enough_free_secs(sbi, 0, 0))
@@ -505,7 +783,12 @@ next_step:
 		}
 
 		/* phase == 2 */
+		if (!gc_qos_charge(sbi, gc_type))
+			return;
+
+		read_start = ktime_get();
 		node_page = get_node_page(sbi, nid);
+		gc_read_done(sbi, read_start);
 		if (IS_ERR(node_page))
 			continue;
 
@@ -524,9 +807,6 @@ next_step:
 		move_node_page(node_page, gc_type);
 		stat_inc_node_blk_count(sbi, 1, gc_type);
 	}
-
-	if (++phase < 3)
-		goto next_step;
 }
 
 /*
@@ -556,22 +836,38 @@ block_t start_bidx_of_node(unsigned int node_ofs, struct inode *inode)
 	return bidx * ADDRS_PER_BLOCK + ADDRS_PER_INODE(inode);
 }
 
+/*
+ * @dni may hold the dnode info resolved by get_node_info_batch() at
+ * @nat_seq, which then saves the NAT lookups of reading the dnode.
+ */
 static bool is_alive(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
-		struct node_info *dni, block_t blkaddr, unsigned int *nofs)
+		struct node_info *dni, unsigned long nat_seq,
+		block_t blkaddr, unsigned int *nofs)
 {
 	struct page *node_page;
 	nid_t nid;
 	unsigned int ofs_in_node;
 	block_t source_blkaddr;
+	ktime_t read_start = ktime_get();
 
 	nid = le32_to_cpu(sum->nid);
 	ofs_in_node = le16_to_cpu(sum->ofs_in_node);
 
-	node_page = get_node_page(sbi, nid);
+	if (dni->nid == nid)
+		node_page = get_node_page_ni(sbi, dni, nat_seq);
+	else
+		node_page = get_node_page(sbi, nid);
+	gc_read_done(sbi, read_start);
 	if (IS_ERR(node_page))
 		return false;
 
-	get_node_info(sbi, nid, dni);
+	if (dni->nid != nid) {
+		get_node_info(sbi, nid, dni);
+	} else if (dni->ino != ino_of_node(node_page)) {
+		/* the nid was reused since the batch was resolved */
+		f2fs_put_page(node_page, 1);
+		return false;
+	}
 
 	if (sum->version != dni->version) {
 		f2fs_msg(sbi->sb, KERN_WARNING,
@@ -589,6 +885,25 @@ static bool is_alive(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 	return true;
 }
 
+/*
+ * Destination log of the data blocks GC moves out of @inode. Blocks of files
+ * modified within gc_warm_data_age seconds are likely to be updated again
+ * soon, so they go to the warm data log, or to the hot one for files hinted
+ * hot, rather than being sorted into the cold one with everything else.
+ */
+int get_gc_data_type(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+
+	if (!sbi->gc_warm_data_age || sbi->active_logs != NR_CURSEG_TYPE ||
+			file_is_cold(inode) || ktime_get_real_seconds() >=
+			inode->i_mtime.tv_sec + sbi->gc_warm_data_age)
+		return CURSEG_COLD_DATA;
+	if (is_inode_flag_set(inode, FI_HOT_DATA) || file_is_hot(inode))
+		return CURSEG_HOT_DATA;
+	return CURSEG_WARM_DATA;
+}
+
 /*
  * Move data block via META_MAPPING while keeping locked data page.
  * This can be used to move blocks, aka LBAs, directly on disk.
@@ -611,8 +926,12 @@ static void move_data_block(struct inode *inode, block_t bidx,
 	struct node_info ni;
 	struct page *page;
 	block_t newaddr;
+	int type = get_gc_data_type(inode);
+	ktime_t read_start;
 	int err;
 
+	fio.temp = type - CURSEG_HOT_DATA;
+
 	/* do not read out */
 	page = f2fs_grab_cache_page(inode->i_mapping, bidx, false);
 	if (!page)
@@ -630,7 +949,9 @@ static void move_data_block(struct inode *inode, block_t bidx,
 	}
 
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	read_start = ktime_get();
 	err = get_dnode_of_data(&dn, bidx, LOOKUP_NODE);
+	gc_read_done(fio.sbi, read_start);
 	if (err)
 		goto out;
 
@@ -653,7 +974,7 @@ static void move_data_block(struct inode *inode, block_t bidx,
 	fio.new_blkaddr = fio.old_blkaddr = dn.data_blkaddr;
 
 	allocate_data_block(fio.sbi, NULL, fio.old_blkaddr, &newaddr,
-					&sum, CURSEG_COLD_DATA, NULL, false);
+			&sum, type, NULL, false);
 
 	fio.encrypted_page = f2fs_pagecache_get_page(META_MAPPING(fio.sbi),
 				newaddr, FGP_LOCK | FGP_CREAT, GFP_NOFS);
@@ -667,7 +988,9 @@ static void move_data_block(struct inode *inode, block_t bidx,
 		goto put_page_out;
 
 	/* write page */
+	read_start = ktime_get();
 	lock_page(fio.encrypted_page);
+	gc_read_done(fio.sbi, read_start);
 
 	if (unlikely(fio.encrypted_page->mapping != META_MAPPING(fio.sbi))) {
 		err = -EIO;
@@ -704,6 +1027,9 @@ static void move_data_block(struct inode *inode, block_t bidx,
 	set_inode_flag(inode, FI_APPEND_WRITE);
 	if (page->index == 0)
 		set_inode_flag(inode, FI_FIRST_BLOCK_WRITTEN);
+	/* moved through the write cache, see fsync_need_flush() */
+	if (f2fs_fua_fsync(fio.sbi))
+		set_inode_flag(inode, FI_CACHED_WRITE);
 put_page_out:
 	f2fs_put_page(fio.encrypted_page, 1);
 recover_block:
@@ -720,8 +1046,10 @@ static void move_data_page(struct inode *inode, block_t bidx, int gc_type,
 							unsigned int segno, int off)
 {
 	struct page *page;
+	ktime_t read_start = ktime_get();
 
 	page = get_lock_data_page(inode, bidx, true);
+	gc_read_done(F2FS_I_SB(inode), read_start);
 	if (IS_ERR(page))
 		return;
 
@@ -740,6 +1068,7 @@ static void move_data_page(struct inode *inode, block_t bidx, int gc_type,
 		if (PageWriteback(page))
 			goto out;
 		set_page_dirty(page);
+		/* routed by get_gc_data_type() when written back */
 		set_cold_data(page);
 	} else {
 		struct f2fs_io_info fio = {
@@ -773,11 +1102,131 @@ retry:
 			congestion_wait(BLK_RW_ASYNC, HZ/50);
 			goto retry;
 		}
+		if (!err && f2fs_fua_fsync(fio.sbi))
+			set_inode_flag(inode, FI_CACHED_WRITE);
 	}
 out:
 	f2fs_put_page(page, 1);
 }
 
+static int add_gc_migration(struct f2fs_sb_info *sbi,
+		struct gc_inode_list *gc_list, struct inode *inode,
+		block_t bidx, unsigned int segno, int off)
+{
+	struct gc_migrate_work *gw;
+	struct gc_migrate_blk *blk;
+
+	gw = radix_tree_lookup(&gc_list->wroot, inode->i_ino);
+	if (!gw) {
+		gw = f2fs_kzalloc(sbi, sizeof(struct gc_migrate_work),
+								GFP_NOFS);
+		if (!gw)
+			return -ENOMEM;
+		gw->inode = inode;
+		f2fs_radix_tree_insert(&gc_list->wroot, inode->i_ino, gw);
+		list_add_tail(&gw->list, &gc_list->wlist);
+	}
+
+	if (gw->nr_blks == gw->max_blks) {
+		unsigned int max_blks = max_t(unsigned int,
+					2 * gw->max_blks, 16);
+
+		blk = krealloc(gw->blks, max_blks *
+				sizeof(struct gc_migrate_blk), GFP_NOFS);
+		if (!blk)
+			return -ENOMEM;
+		gw->blks = blk;
+		gw->max_blks = max_blks;
+	}
+
+	blk = &gw->blks[gw->nr_blks++];
+	blk->bidx = bidx;
+	blk->segno = segno;
+	blk->off = off;
+	return 0;
+}
+
+static void gc_migrate_work_fn(struct work_struct *work)
+{
+	struct gc_migrate_work *gw = container_of(work,
+					struct gc_migrate_work, work);
+	struct inode *inode = gw->inode;
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	bool locked = false;
+	unsigned int i;
+
+	if (S_ISREG(inode->i_mode)) {
+		if (!down_write_trylock(&fi->dio_rwsem[READ]))
+			return;
+		if (!down_write_trylock(&fi->dio_rwsem[WRITE])) {
+			up_write(&fi->dio_rwsem[READ]);
+			return;
+		}
+		locked = true;
+
+		/* wait for all inflight aio data */
+		inode_dio_wait(inode);
+	}
+
+	for (i = 0; i < gw->nr_blks; i++) {
+		struct gc_migrate_blk *blk = &gw->blks[i];
+
+		if (f2fs_encrypted_file(inode))
+			move_data_block(inode, blk->bidx, blk->segno, blk->off);
+		else
+			move_data_page(inode, blk->bidx, FG_GC,
+						blk->segno, blk->off);
+	}
+	gw->nr_moved = gw->nr_blks;
+
+	if (locked) {
+		up_write(&fi->dio_rwsem[WRITE]);
+		up_write(&fi->dio_rwsem[READ]);
+	}
+}
+
+/*
+ * Migrate the blocks collected by FG_GC, one work per inode, on at most
+ * gc_migrate_workers workers, and wait for all of them.
+ */
+static void run_gc_migrations(struct f2fs_sb_info *sbi,
+				struct gc_inode_list *gc_list)
+{
+	struct gc_migrate_work *gw, *next;
+	unsigned int nr_moved = 0;
+	ktime_t start_time;
+	s64 read_wait, wall;
+
+	if (list_empty(&gc_list->wlist))
+		return;
+
+	start_time = ktime_get();
+	read_wait = atomic64_read(&sbi->gc_read_wait_us);
+
+	list_for_each_entry(gw, &gc_list->wlist, list) {
+		INIT_WORK(&gw->work, gc_migrate_work_fn);
+		queue_work(sbi->gc_migrate_wq, &gw->work);
+	}
+	flush_workqueue(sbi->gc_migrate_wq);
+
+	list_for_each_entry_safe(gw, next, &gc_list->wlist, list) {
+		radix_tree_delete(&gc_list->wroot, gw->inode->i_ino);
+		list_del(&gw->list);
+		nr_moved += gw->nr_moved;
+		kfree(gw->blks);
+		kfree(gw);
+	}
+
+	f2fs_submit_merged_write(sbi, DATA);
+	stat_inc_data_blk_count(sbi, nr_moved, FG_GC);
+
+	/* reads of parallel workers overlap, cap their sum at wall time */
+	wall = ktime_us_delta(ktime_get(), start_time);
+	read_wait = min(atomic64_read(&sbi->gc_read_wait_us) - read_wait,
+									wall);
+	stat_inc_gc_sec_time(sbi, 0, read_wait, wall - read_wait);
+}
+
 /*
  * This function tries to get parent node of victim data block, and identifies
  * data block validity. If the block is valid, copy that with cold status and
@@ -786,23 +1235,43 @@ out:
  * the victim data block is ignored.
  */
 static void gc_data_segment(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
-		struct gc_inode_list *gc_list, unsigned int segno, int gc_type)
+		struct gc_inode_list *gc_list, unsigned int segno, int gc_type,
+		int phase, struct node_info *nis, unsigned long *nat_seq)
 {
 	struct super_block *sb = sbi->sb;
 	struct f2fs_summary *entry;
 	block_t start_addr;
 	int off;
-	int phase = 0;
 
 	start_addr = START_BLOCK(sbi, segno);
-
-next_step:
 	entry = sum;
 
+	/*
+	 * resolve the dnodes of all valid blocks under one sentry_lock and
+	 * one nat_tree_lock, and keep the oldest nat_seq of the section
+	 */
+	if (phase == 0 && nis) {
+		struct sit_info *sit_i = SIT_I(sbi);
+		struct seg_entry *sentry;
+		unsigned long seq;
+
+		down_read(&sit_i->sentry_lock);
+		sentry = get_seg_entry(sbi, segno);
+		for (off = 0; off < sbi->blocks_per_seg; off++, entry++)
+			nis[off].nid = f2fs_test_bit(off,
+					(char *)sentry->cur_valid_map) ?
+					le32_to_cpu(entry->nid) : 0;
+		up_read(&sit_i->sentry_lock);
+
+		seq = get_node_info_batch(sbi, nis, sbi->blocks_per_seg);
+		*nat_seq = min(*nat_seq, seq);
+		return;
+	}
+
 	for (off = 0; off < sbi->blocks_per_seg; off++, entry++) {
 		struct page *data_page;
 		struct inode *inode;
-		struct node_info dni; /* dnode info for the data */
+		struct node_info dni = { .nid = 0 }; /* dnode info for the data */
 		unsigned int ofs_in_node, nofs;
 		block_t start_bidx;
 		nid_t nid = le32_to_cpu(entry->nid);
@@ -820,13 +1289,20 @@ next_step:
 			continue;
 		}
 
+		if (nis)
+			dni = nis[off];
+
 		if (phase == 1) {
-			ra_node_page(sbi, nid);
+			if (dni.nid == nid)
+				ra_node_page_ni(sbi, &dni, *nat_seq);
+			else
+				ra_node_page(sbi, nid);
 			continue;
 		}
 
 		/* Get an inode by ino with checking validity */
-		if (!is_alive(sbi, entry, &dni, start_addr + off, &nofs))
+		if (!is_alive(sbi, entry, &dni, *nat_seq, start_addr + off,
+								&nofs))
 			continue;
 
 		if (phase == 2) {
@@ -874,6 +1350,18 @@ next_step:
 			struct f2fs_inode_info *fi = F2FS_I(inode);
 			bool locked = false;
 
+			if (!gc_qos_charge(sbi, gc_type))
+				return;
+
+			start_bidx = start_bidx_of_node(nofs, inode)
+								+ ofs_in_node;
+
+			/* FG_GC hands the block over to migration workers */
+			if (gc_type == FG_GC && sbi->gc_migrate_workers &&
+				!add_gc_migration(sbi, gc_list, inode,
+						start_bidx, segno, off))
+				continue;
+
 			if (S_ISREG(inode->i_mode)) {
 				if (!down_write_trylock(&fi->dio_rwsem[READ]))
 					continue;
@@ -888,8 +1376,6 @@ next_step:
 				inode_dio_wait(inode);
 			}
 
-			start_bidx = start_bidx_of_node(nofs, inode)
-								+ ofs_in_node;
 			if (f2fs_encrypted_file(inode))
 				move_data_block(inode, start_bidx, segno, off);
 			else
@@ -904,9 +1390,6 @@ next_step:
 			stat_inc_data_blk_count(sbi, 1, gc_type);
 		}
 	}
-
-	if (++phase < 5)
-		goto next_step;
 }
 
 static int __get_victim(struct f2fs_sb_info *sbi, unsigned int *victim,
@@ -915,30 +1398,48 @@ static int __get_victim(struct f2fs_sb_info *sbi, unsigned int *victim,
 	struct sit_info *sit_i = SIT_I(sbi);
 	int ret;
 
-	down_write(&sit_i->sentry_lock);
+	/* SIT updates of allocation and invalidation go on in stripes */
+	down_read(&sit_i->sentry_lock);
 	ret = DIRTY_I(sbi)->v_ops->get_victim(sbi, victim, gc_type,
 					      NO_CHECK_TYPE, LFS);
-	up_write(&sit_i->sentry_lock);
+	up_read(&sit_i->sentry_lock);
 	return ret;
 }
 
-static int do_garbage_collect(struct f2fs_sb_info *sbi,
-				unsigned int start_segno,
+/*
+ * Collect @nr_segs segments of a victim section starting at @start_segno;
+ * a sliced FG_GC passes a part of the section at a time.
+ */
+static void do_garbage_collect(struct f2fs_sb_info *sbi,
+				unsigned int start_segno, unsigned int nr_segs,
 				struct gc_inode_list *gc_list, int gc_type)
 {
 	struct page *sum_page;
 	struct f2fs_summary_block *sum;
+	struct node_info *nis = NULL;
+	unsigned long nat_seq = ULONG_MAX;
 	struct blk_plug plug;
 	unsigned int segno = start_segno;
-	unsigned int end_segno = start_segno + sbi->segs_per_sec;
-	int seg_freed = 0;
+	unsigned int end_segno = start_segno + nr_segs;
 	unsigned char type = IS_DATASEG(get_seg_entry(sbi, segno)->type) ?
 						SUM_TYPE_DATA : SUM_TYPE_NODE;
+	int phase, nr_phases = (type == SUM_TYPE_DATA) ?
+				GC_DATA_PHASES : GC_NODE_PHASES;
+	ktime_t start_time = ktime_get(), move_time = start_time;
+	s64 read_wait = 0, move_us;
 
 	/* readahead multi ssa blocks those have contiguous address */
-	if (sbi->segs_per_sec > 1)
+	if (nr_segs > 1)
 		ra_meta_pages(sbi, GET_SUM_BLOCK(sbi, segno),
-					sbi->segs_per_sec, META_SSA, true);
+					nr_segs, META_SSA, true);
+
+	/*
+	 * dnode info of every block in a data section, resolved in batches by
+	 * the first phase; without it each block is looked up on its own.
+	 */
+	if (type == SUM_TYPE_DATA)
+		nis = f2fs_kvzalloc(sbi, (nr_segs << sbi->log_blocks_per_seg) *
+				sizeof(struct node_info), GFP_NOFS);
 
 	/* reference all summary page */
 	while (segno < end_segno) {
@@ -948,41 +1449,56 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi,
 
 	blk_start_plug(&plug);
 
-	for (segno = start_segno; segno < end_segno; segno++) {
-
-		/* find segment summary of victim */
-		sum_page = find_get_page(META_MAPPING(sbi),
-					GET_SUM_BLOCK(sbi, segno));
-		f2fs_put_page(sum_page, 0);
-
-		if (get_valid_blocks(sbi, segno, false) == 0 ||
-				!PageUptodate(sum_page) ||
-				unlikely(f2fs_cp_error(sbi)))
-			goto next;
-
-		sum = page_address(sum_page);
-		f2fs_bug_on(sbi, type != GET_SUM_TYPE((&sum->footer)));
-
-		/*
-		 * this is to avoid deadlock:
-		 * - lock_page(sum_page)         - f2fs_replace_block
-		 *  - check_valid_map()            - down_write(sentry_lock)
-		 *   - down_read(sentry_lock)     - change_curseg()
-		 *                                  - lock_page(sum_page)
-		 */
-		if (type == SUM_TYPE_NODE)
-			gc_node_segment(sbi, sum->entries, segno, gc_type);
-		else
-			gc_data_segment(sbi, sum->entries, gc_list, segno,
-								gc_type);
-
-		stat_inc_seg_count(sbi, type, gc_type);
+	/*
+	 * Run each phase over the whole section before the next one, so that
+	 * the reads of all its segments are in flight together and can be
+	 * merged, and only the last phase waits for them and moves blocks.
+	 */
+	for (phase = 0; phase < nr_phases; phase++) {
+		if (phase == nr_phases - 1) {
+			move_time = ktime_get();
+			read_wait = atomic64_read(&sbi->gc_read_wait_us);
+		}
 
-		if (gc_type == FG_GC &&
-				get_valid_blocks(sbi, segno, false) == 0)
-			seg_freed++;
+		for (segno = start_segno; segno < end_segno; segno++) {
+
+			/* find segment summary of victim */
+			sum_page = find_get_page(META_MAPPING(sbi),
+						GET_SUM_BLOCK(sbi, segno));
+			f2fs_put_page(sum_page, 0);
+
+			if (get_valid_blocks(sbi, segno, false) == 0 ||
+					!PageUptodate(sum_page) ||
+					unlikely(f2fs_cp_error(sbi)))
+				goto next;
+
+			sum = page_address(sum_page);
+			f2fs_bug_on(sbi, type != GET_SUM_TYPE((&sum->footer)));
+
+			/*
+			 * this is to avoid deadlock:
+			 * - lock_page(sum_page)         - f2fs_replace_block
+			 *  - check_valid_map()            - down_write(sentry_lock)
+			 *   - down_read(sentry_lock)     - change_curseg()
+			 *                                  - lock_page(sum_page)
+			 */
+			if (type == SUM_TYPE_NODE)
+				gc_node_segment(sbi, sum->entries, segno,
+							gc_type, phase);
+			else
+				gc_data_segment(sbi, sum->entries, gc_list,
+						segno, gc_type, phase, nis ? nis +
+						(segno - start_segno) *
+						sbi->blocks_per_seg : NULL,
+						&nat_seq);
+
+			if (phase == nr_phases - 1)
+				stat_inc_seg_count(sbi, type, gc_type);
 next:
-		f2fs_put_page(sum_page, 0);
+			/* the last phase drops the reference of get_sum_page */
+			if (phase == nr_phases - 1)
+				f2fs_put_page(sum_page, 0);
+		}
 	}
 
 	if (gc_type == FG_GC)
@@ -991,8 +1507,119 @@ next:
 
 	blk_finish_plug(&plug);
 
+	kvfree(nis);
+
 	stat_inc_call_count(sbi->stat_info);
 
+	/*
+	 * Readahead phases count as read wait, and so do the page reads the
+	 * move phase blocks on; only the rest of the move phase is write.
+	 */
+	move_us = ktime_us_delta(ktime_get(), move_time);
+	read_wait = min(atomic64_read(&sbi->gc_read_wait_us) - read_wait,
+								move_us);
+	/* a sliced section is counted once, by its last slice */
+	stat_inc_gc_sec_time(sbi, !((start_segno + nr_segs) %
+				sbi->segs_per_sec),
+				ktime_us_delta(move_time, start_time) +
+				read_wait, move_us - read_wait);
+}
+
+static int get_freed_segs(struct f2fs_sb_info *sbi, unsigned int start_segno)
+{
+	unsigned int segno;
+	int seg_freed = 0;
+
+	for (segno = start_segno; segno < start_segno + sbi->segs_per_sec;
+								segno++)
+		if (get_valid_blocks(sbi, segno, false) == 0)
+			seg_freed++;
+	return seg_freed;
+}
+
+/*
+ * A sliced FG_GC may return before the GC reserve is refilled, but keeps
+ * going while the writers could eat into more than half of it.
+ */
+static bool gc_can_yield(struct f2fs_sb_info *sbi)
+{
+	int node_secs = get_blocktype_secs(sbi, F2FS_DIRTY_NODES);
+	int dent_secs = get_blocktype_secs(sbi, F2FS_DIRTY_DENTS);
+	int imeta_secs = get_blocktype_secs(sbi, F2FS_DIRTY_IMETA);
+
+	return free_sections(sbi) > node_secs + 2 * dent_secs + imeta_secs +
+					reserved_sections(sbi) / 2;
+}
+
+/*
+ * Collect up to gc_fg_victims victims of a sliced FG_GC, a segment of each
+ * at a time, until @deadline. Unfinished victims are unpinned when the
+ * slice yields and kept in sbi->gc_resume_segno, so the next call can pin
+ * them again and go on where this one stopped. Returns the number of freed
+ * segments of the victims, or -ENODATA.
+ */
+static int do_sliced_gc(struct f2fs_sb_info *sbi,
+			struct gc_inode_list *gc_list, unsigned long deadline,
+			int *sec_freed)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int *resume = sbi->gc_resume_segno;
+	unsigned int start[MAX_GC_FG_VICTIMS];
+	unsigned int i, nr = 0, pending, segno, secno;
+	int seg_freed = 0, freed;
+
+	/* drop the progress of victims freed or reused meanwhile */
+	for (i = 0; i < sbi->gc_resume_nr; i++) {
+		segno = resume[i];
+		secno = GET_SEC_FROM_SEG(sbi, segno);
+		if (sec_usage_check(sbi, secno) ||
+				!get_valid_blocks(sbi, segno, true))
+			continue;
+		set_bit(secno, dirty_i->cur_victim_secmap);
+		resume[nr++] = segno;
+	}
+
+	for (; nr < sbi->gc_fg_victims; nr++) {
+		segno = NULL_SEGNO;
+		if (!__get_victim(sbi, &segno, FG_GC))
+			break;
+		resume[nr] = segno;
+	}
+
+	sbi->gc_resume_nr = 0;
+	if (!nr)
+		return -ENODATA;
+
+	for (i = 0; i < nr; i++)
+		start[i] = GET_SEG_FROM_SEC(sbi,
+				GET_SEC_FROM_SEG(sbi, resume[i]));
+
+	do {
+		pending = 0;
+		for (i = 0; i < nr; i++) {
+			if (resume[i] == NULL_SEGNO)
+				continue;
+			do_garbage_collect(sbi, resume[i]++, 1, gc_list, FG_GC);
+			if (resume[i] == start[i] + sbi->segs_per_sec)
+				resume[i] = NULL_SEGNO;
+			else
+				pending++;
+		}
+	} while (pending && time_before(jiffies, deadline));
+	run_gc_migrations(sbi, gc_list);
+
+	for (i = 0; i < nr; i++) {
+		clear_bit(GET_SEC_FROM_SEG(sbi, start[i]),
+					dirty_i->cur_victim_secmap);
+
+		freed = get_freed_segs(sbi, start[i]);
+		seg_freed += freed;
+		if (resume[i] != NULL_SEGNO)
+			resume[sbi->gc_resume_nr++] = resume[i];
+		else if (freed == sbi->segs_per_sec)
+			(*sec_freed)++;
+	}
+
 	return seg_freed;
 }
 
@@ -1007,7 +1634,14 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 	struct gc_inode_list gc_list = {
 		.ilist = LIST_HEAD_INIT(gc_list.ilist),
 		.iroot = RADIX_TREE_INIT(GFP_NOFS),
+		.wlist = LIST_HEAD_INIT(gc_list.wlist),
+		.wroot = RADIX_TREE_INIT(GFP_NOFS),
 	};
+	unsigned int victims[MAX_GC_FG_VICTIMS];
+	int nr_victims, max_victims, i;
+	unsigned long deadline = jiffies +
+				msecs_to_jiffies(sbi->gc_fg_slice_ms);
+	bool sliced = false;
 
 	trace_f2fs_gc_begin(sbi->sb, sync, background,
 				get_pages(sbi, F2FS_DIRTY_NODES),
@@ -1019,6 +1653,9 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 				prefree_segments(sbi));
 
 	cpc.reason = __get_cp_reason(sbi);
+
+	/* a given victim may be in a SIT block lazy_sit has not decoded */
+	materialize_sit_entry(sbi, segno);
 gc_more:
 	if (unlikely(!(sbi->sb->s_flags & SB_ACTIVE))) {
 		ret = -EINVAL;
@@ -1049,26 +1686,61 @@ gc_more:
 		ret = -EINVAL;
 		goto stop;
 	}
-	if (!__get_victim(sbi, &segno, gc_type)) {
+
+	/* f2fs_balance_fs() runs FG_GC in time slices, if enabled */
+	if (gc_type == FG_GC && !background && sbi->gc_fg_slice_ms) {
+		sliced = true;
+		seg_freed = do_sliced_gc(sbi, &gc_list, deadline, &sec_freed);
+		if (seg_freed < 0) {
+			ret = -ENODATA;
+			goto stop;
+		}
+		total_freed += seg_freed;
+		goto collected;
+	}
+
+	/* unless a specific section is requested, FG_GC cleans in batches */
+	max_victims = (gc_type == FG_GC && !sync) ? sbi->gc_fg_victims : 1;
+	for (nr_victims = 0; nr_victims < max_victims; nr_victims++) {
+		if (!__get_victim(sbi, &segno, gc_type))
+			break;
+		victims[nr_victims] = segno;
+		segno = NULL_SEGNO;
+	}
+	if (!nr_victims) {
 		ret = -ENODATA;
 		goto stop;
 	}
 
-	seg_freed = do_garbage_collect(sbi, segno, &gc_list, gc_type);
-	if (gc_type == FG_GC && seg_freed == sbi->segs_per_sec)
-		sec_freed++;
-	total_freed += seg_freed;
+	for (i = 0; i < nr_victims; i++)
+		do_garbage_collect(sbi, victims[i], sbi->segs_per_sec,
+						&gc_list, gc_type);
+	run_gc_migrations(sbi, &gc_list);
 
+	for (i = 0; i < nr_victims && gc_type == FG_GC; i++) {
+		seg_freed = get_freed_segs(sbi, victims[i]);
+		if (seg_freed == sbi->segs_per_sec)
+			sec_freed++;
+		total_freed += seg_freed;
+
+		clear_bit(GET_SEC_FROM_SEG(sbi, victims[i]),
+					DIRTY_I(sbi)->cur_victim_secmap);
+	}
+
+collected:
 	if (gc_type == FG_GC)
 		sbi->cur_victim_sec = NULL_SEGNO;
 
 	if (!sync) {
-		if (has_not_enough_free_secs(sbi, sec_freed, 0)) {
+		if (has_not_enough_free_secs(sbi, sec_freed, 0) &&
+				(!sliced || time_before(jiffies, deadline) ||
+				!gc_can_yield(sbi))) {
 			segno = NULL_SEGNO;
 			goto gc_more;
 		}
 
-		if (gc_type == FG_GC)
+		/* a slice which freed nothing has no need of a checkpoint */
+		if (gc_type == FG_GC && (!sliced || sec_freed))
 			ret = write_checkpoint(sbi, &cpc);
 	}
 stop:
@@ -1093,7 +1765,7 @@ stop:
 	return ret;
 }
 
-void build_gc_manager(struct f2fs_sb_info *sbi)
+int build_gc_manager(struct f2fs_sb_info *sbi)
 {//设定GC的ops
 	u64 main_count, resv_count, ovp_count;
 
@@ -1108,10 +1780,34 @@ void build_gc_manager(struct f2fs_sb_info *sbi)
 	sbi->fggc_threshold = div64_u64((main_count - ovp_count) *
 				BLKS_PER_SEC(sbi), (main_count - resv_count));//0x1f8 = 504
 	sbi->gc_pin_file_threshold = DEF_GC_FAILED_PINNED_FILES;
+	sbi->gc_age_threshold = DEF_GC_AGE_THRESHOLD;
+	sbi->gc_age_hist_time = 0;
+	sbi->gc_warm_data_age = DEF_GC_WARM_DATA_AGE;
 	//pr_notice("sbi->fggc_threshold = 0x%x\n", sbi->fggc_threshold);
 
 	/* give warm/cold data area from slower device */
 	if (sbi->s_ndevs && sbi->segs_per_sec == 1)
 		SIT_I(sbi)->last_victim[ALLOC_NEXT] =
 				GET_SEGNO(sbi, FDEV(0).end_blk) + 1;
+
+	sbi->gc_fg_victims = DEF_GC_FG_VICTIMS;
+	sbi->gc_fg_slice_ms = DEF_GC_FG_SLICE_MS;
+	sbi->gc_resume_nr = 0;
+	sbi->gc_migrate_workers = DEF_GC_MIGRATE_WORKERS;
+	atomic64_set(&sbi->gc_read_wait_us, 0);
+	sbi->gc_migrate_wq = alloc_workqueue("f2fs_gc_migrate-%u:%u",
+				WQ_UNBOUND, sbi->gc_migrate_workers,
+				MAJOR(sbi->sb->s_bdev->bd_dev),
+				MINOR(sbi->sb->s_bdev->bd_dev));
+	if (!sbi->gc_migrate_wq)
+		return -ENOMEM;
+	return 0;
+}
+
+void destroy_gc_manager(struct f2fs_sb_info *sbi)
+{
+	if (!sbi->gc_migrate_wq)
+		return;
+	destroy_workqueue(sbi->gc_migrate_wq);
+	sbi->gc_migrate_wq = NULL;
 }
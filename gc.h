@@ -17,14 +17,35 @@
 #define DEF_GC_THREAD_MIN_SLEEP_TIME	30000	/* milliseconds */
 #define DEF_GC_THREAD_MAX_SLEEP_TIME	60000
 #define DEF_GC_THREAD_NOGC_SLEEP_TIME	300000	/* wait 5 min */
+#define DEF_GC_THREAD_QOS_SLEEP_TIME	100	/* 100 ms */
 #define LIMIT_INVALID_BLOCK	40 /* percentage over total user space */
 #define LIMIT_FREE_BLOCK	40 /* percentage over invalid + free space */
 
 #define DEF_GC_FAILED_PINNED_FILES	2048
 
+/* age a section needs to reach to be a GC_AT victim */
+#define DEF_GC_AGE_THRESHOLD	(7 * 24 * 60 * 60)	/* 7 days */
+/* the youngest age bucket is gc_age_threshold >> (GC_AGE_HIST_YOUNG - 1) */
+#define MIN_GC_AGE_THRESHOLD	(1 << (GC_AGE_HIST_YOUNG - 1))
+/* GC_AT rebuilds its age histogram at most once per interval */
+#define GC_AGE_HIST_INTERVAL	60			/* 60 secs */
+
+/* GC keeps data of files modified within this time in the warm log */
+#define DEF_GC_WARM_DATA_AGE	(60 * 60)		/* 1 hour */
+
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
+/* # of phases gc_node_segment/gc_data_segment run over a victim section */
+#define GC_NODE_PHASES		3
+#define GC_DATA_PHASES		5
+
+/* FG_GC victim sections per round and data migration workers */
+#define DEF_GC_FG_VICTIMS	1
+#define DEF_GC_MIGRATE_WORKERS	4
+#define MAX_GC_MIGRATE_WORKERS	64
+#define DEF_GC_FG_SLICE_MS	20	/* 0 runs FG_GC to completion */
+
 struct f2fs_gc_kthread {
 	struct task_struct *f2fs_gc_task;
 	wait_queue_head_t gc_wait_queue_head;
@@ -39,11 +60,40 @@ struct f2fs_gc_kthread {
 	unsigned int gc_idle;
 	unsigned int gc_urgent;
 	unsigned int gc_wake;
+
+	/* for gc QoS, budget of BG_GC refilled every second, 0 is unlimited */
+	unsigned int gc_qos;
+	unsigned int qos_mbps;
+	unsigned int qos_iops;
+	unsigned int qos_exhausted;	/* # of times the budget ran out */
+	unsigned long long qos_bytes;	/* remaining byte budget, * HZ */
+	unsigned long long qos_ios;	/* remaining I/O budget, * HZ */
+	unsigned long qos_refill_time;	/* last refill in jiffies */
 };
 
 struct gc_inode_list {
 	struct list_head ilist;
 	struct radix_tree_root iroot;
+	struct list_head wlist;		/* pending gc_migrate_works */
+	struct radix_tree_root wroot;	/* gc_migrate_works by ino */
+};
+
+/* a data block of a victim section queued for migration */
+struct gc_migrate_blk {
+	block_t bidx;			/* index in the owner inode */
+	unsigned int segno;		/* victim segment */
+	int off;			/* block offset in the segment */
+};
+
+/* per-inode batch of blocks migrated by a FG_GC worker */
+struct gc_migrate_work {
+	struct work_struct work;
+	struct list_head list;		/* linked in gc_inode_list->wlist */
+	struct inode *inode;		/* owner, referenced by ilist */
+	struct gc_migrate_blk *blks;
+	unsigned int nr_blks;		/* # of queued blocks */
+	unsigned int max_blks;		/* size of blks array */
+	unsigned int nr_moved;		/* # of blocks handled by worker */
 };
 
 /*
@@ -99,6 +149,59 @@ static inline void decrease_sleep_time(struct f2fs_gc_kthread *gc_th,
 		*wait -= min_time;
 }
 
+static inline bool gc_qos_limited(struct f2fs_gc_kthread *gc_th)
+{
+	return gc_th->gc_qos && (gc_th->qos_mbps || gc_th->qos_iops);
+}
+
+/*
+ * Add the budget earned since the last refill, allowing bursts of at most
+ * one second. The budget is kept in units of 1/HZ, so a rate earns exactly
+ * its value per jiffy and no fraction is lost between refills. Returns true
+ * if BG_GC may migrate something.
+ */
+static inline bool gc_qos_refill(struct f2fs_gc_kthread *gc_th)
+{
+	unsigned long long bps = (unsigned long long)gc_th->qos_mbps << 20;
+	unsigned long long iops = gc_th->qos_iops;
+	unsigned long elapsed = jiffies - gc_th->qos_refill_time;
+
+	if (elapsed) {
+		gc_th->qos_refill_time += elapsed;
+		elapsed = min_t(unsigned long, elapsed, HZ);
+		gc_th->qos_bytes = min(bps * HZ,
+				gc_th->qos_bytes + bps * elapsed);
+		gc_th->qos_ios = min(iops * HZ, gc_th->qos_ios + iops * elapsed);
+	}
+
+	return (!bps || gc_th->qos_bytes >= (u64)F2FS_BLKSIZE * HZ) &&
+			(!iops || gc_th->qos_ios >= HZ);
+}
+
+/*
+ * Charge one migrated block, i.e. F2FS_BLKSIZE bytes and one I/O, to the
+ * BG_GC budget. Returns false if the budget does not cover it.
+ */
+static inline bool gc_qos_charge(struct f2fs_sb_info *sbi, int gc_type)
+{
+	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+
+	if (gc_type != BG_GC || !gc_th || !gc_qos_limited(gc_th))
+		return true;
+
+	if (!gc_qos_refill(gc_th))
+		return false;
+
+	if (gc_th->qos_mbps)
+		gc_th->qos_bytes -= (u64)F2FS_BLKSIZE * HZ;
+	if (gc_th->qos_iops)
+		gc_th->qos_ios -= HZ;
+
+	if (!gc_qos_refill(gc_th))
+		gc_th->qos_exhausted++;
+	return true;
+}
+
 static inline bool has_enough_invalid_blocks(struct f2fs_sb_info *sbi)
 {
 	block_t invalid_user_blocks = sbi->user_block_count -
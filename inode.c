@@ -286,6 +286,10 @@ pr_notice("Enter do_read_inode()， inode->i_ino = 0x%x\n",inode->i_ino);
 		fi->i_crtime.tv_nsec = le32_to_cpu(ri->i_crtime_nsec);
 	}
 
+	if (f2fs_has_extra_attr(inode) &&
+			F2FS_FITS_IN_INODE(ri, fi->i_extra_isize, i_temp_age))
+		fi->i_temp_age = le32_to_cpu(ri->i_temp_age);
+
 	f2fs_put_page(node_page, 1);
 
 	stat_inc_inline_xattr(inode);
@@ -443,6 +447,11 @@ void update_inode(struct inode *inode, struct page *node_page)
 			ri->i_crtime_nsec =
 				cpu_to_le32(F2FS_I(inode)->i_crtime.tv_nsec);
 		}
+
+		if (F2FS_FITS_IN_INODE(ri, F2FS_I(inode)->i_extra_isize,
+								i_temp_age))
+			ri->i_temp_age =
+				cpu_to_le32(F2FS_I(inode)->i_temp_age);
 	}
 
 	__set_inode_rdev(inode, ri);
@@ -142,45 +142,327 @@ fail_drop:
 	return ERR_PTR(err);
 }
 
-static int is_multimedia_file(const unsigned char *s, const char *sub)
+static const char * const temp_rule_kinds[NR_TEMP_RULE_KINDS] = {
+	[TEMP_RULE_SUFFIX]	= "suffix",
+	[TEMP_RULE_UID]		= "uid",
+	[TEMP_RULE_PROJID]	= "projid",
+	[TEMP_RULE_PARENT]	= "parent",
+	[TEMP_RULE_SIZE]	= "size",
+};
+
+static const char * const temp_names[NR_TEMP_TYPE] = {
+	[HOT]	= "hot",
+	[WARM]	= "warm",
+	[COLD]	= "cold",
+};
+
+static int temp_rule_suffix(char *dst, const char *src, size_t len)
 {
-	size_t slen = strlen(s);
-	size_t sublen = strlen(sub);
-	int i;
+	size_t i;
 
-	/*
-	 * filename format of multimedia file should be defined as:
-	 * "filename + '.' + extension + (optional: '.' + temp extension)".
-	 */
-	if (slen < sublen + 2)
-		return 0;
+	if (!len || len >= TEMP_RULE_SUFFIX_LEN)
+		return -EINVAL;
+
+	for (i = 0; i < len; i++)
+		dst[i] = tolower(src[i]);
+	dst[len] = '\0';
+	return 0;
+}
+
+static unsigned int temp_rule_hash(const char *suffix)
+{
+	return full_name_hash(NULL, suffix, strlen(suffix));
+}
 
-	for (i = 1; i < slen - sublen; i++) {
-		if (s[i] != '.')
+/* rule slots move on deletion, so the suffix hash is rebuilt each time */
+static void rehash_temp_rules(struct f2fs_sb_info *sbi)
+{
+	unsigned int i;
+
+	hash_init(sbi->temp_rule_hash);
+	for (i = 0; i < sbi->nr_temp_rules; i++) {
+		struct temp_rule *r = &sbi->temp_rules[i];
+
+		if (r->kind == TEMP_RULE_SUFFIX)
+			hash_add(sbi->temp_rule_hash, &r->hnode,
+						temp_rule_hash(r->suffix));
+	}
+}
+
+static struct temp_rule *__lookup_temp_rule(struct f2fs_sb_info *sbi,
+						struct temp_rule *key)
+{
+	unsigned int i;
+
+	for (i = 0; i < sbi->nr_temp_rules; i++) {
+		struct temp_rule *r = &sbi->temp_rules[i];
+
+		if (r->kind != key->kind)
 			continue;
-		if (!strncasecmp(s + i + 1, sub, sublen))
-			return 1;
+		if (r->kind == TEMP_RULE_SUFFIX ?
+				!strcmp(r->suffix, key->suffix) :
+				r->value == key->value)
+			return r;
 	}
+	return NULL;
+}
 
+static int __add_temp_rule(struct f2fs_sb_info *sbi, struct temp_rule *key)
+{
+	struct temp_rule *r = __lookup_temp_rule(sbi, key);
+
+	if (r) {
+		r->temp = key->temp;
+		return 0;
+	}
+
+	if (sbi->nr_temp_rules >= MAX_TEMP_RULES)
+		return -ENOSPC;
+
+	r = &sbi->temp_rules[sbi->nr_temp_rules++];
+	*r = *key;
+	if (r->kind == TEMP_RULE_SUFFIX)
+		hash_add(sbi->temp_rule_hash, &r->hnode,
+					temp_rule_hash(r->suffix));
+	return 0;
+}
+
+static int __del_temp_rule(struct f2fs_sb_info *sbi, struct temp_rule *key)
+{
+	struct temp_rule *r = __lookup_temp_rule(sbi, key);
+	unsigned int i;
+
+	if (!r)
+		return -ENOENT;
+
+	i = r - sbi->temp_rules;
+	memmove(r, r + 1, (--sbi->nr_temp_rules - i) * sizeof(*r));
+	rehash_temp_rules(sbi);
 	return 0;
 }
 
 /*
- * Set multimedia files as cold files for hot/cold data separation
+ * The superblock extension list becomes a set of cold suffix rules, which
+ * can be changed later through sysfs.
  */
-static inline void set_cold_files(struct f2fs_sb_info *sbi, struct inode *inode,
-		const unsigned char *name)
+void init_temp_rules(struct f2fs_sb_info *sbi)
 {
-	int i;
 	__u8 (*extlist)[8] = sbi->raw_super->extension_list;
-
 	int count = le32_to_cpu(sbi->raw_super->extension_count);
-	for (i = 0; i < count; i++) {
-		if (is_multimedia_file(name, extlist[i])) {
-			file_set_cold(inode);
+	struct temp_rule key = { .kind = TEMP_RULE_SUFFIX, .temp = COLD };
+	int i;
+
+	rwlock_init(&sbi->temp_rule_lock);
+	hash_init(sbi->temp_rule_hash);
+
+	for (i = 0; i < min(count, F2FS_MAX_EXTENSION); i++) {
+		const char *ext = (const char *)extlist[i];
+
+		if (temp_rule_suffix(key.suffix, ext, strnlen(ext, 8)))
+			continue;
+		__add_temp_rule(sbi, &key);
+	}
+}
+
+/*
+ * Match every ".token" of the name after its first character, so that
+ * "a.mp4.tmp" hits a rule for either mp4 or tmp.
+ */
+static struct temp_rule *__match_suffix_rule(struct f2fs_sb_info *sbi,
+						const unsigned char *name)
+{
+	const char *s = (const char *)name;
+	size_t len = strlen(s), i, j;
+	char suffix[TEMP_RULE_SUFFIX_LEN];
+	struct temp_rule *r;
+
+	for (i = 1; i < len; i = j) {
+		for (j = i + 1; j < len && s[j] != '.'; j++)
+			;
+		if (s[i] != '.' ||
+			temp_rule_suffix(suffix, s + i + 1, j - i - 1))
+			continue;
+
+		hash_for_each_possible(sbi->temp_rule_hash, r, hnode,
+						temp_rule_hash(suffix))
+			if (!strcmp(r->suffix, suffix))
+				return r;
+	}
+	return NULL;
+}
+
+static bool __match_temp_rule(struct temp_rule *r, struct inode *inode,
+						struct inode *dir)
+{
+	switch (r->kind) {
+	case TEMP_RULE_UID:
+		return r->value == from_kuid(&init_user_ns, inode->i_uid);
+	case TEMP_RULE_PROJID:
+		return r->value == from_kprojid(&init_user_ns,
+						F2FS_I(inode)->i_projid);
+	case TEMP_RULE_PARENT:
+		return r->value == dir->i_ino;
+	default:
+		return false;
+	}
+}
+
+static void set_rule_temp(struct inode *inode, unsigned char temp)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	unsigned char advise;
+
+	advise = fi->i_advise & ~(FADVISE_COLD_BIT | FADVISE_HOT_BIT);
+	if (temp == HOT)
+		advise |= FADVISE_HOT_BIT;
+	else if (temp == COLD)
+		advise |= FADVISE_COLD_BIT;
+
+	if (advise == fi->i_advise)
+		return;
+
+	fi->i_advise = advise;
+	f2fs_mark_inode_dirty_sync(inode, true);
+}
+
+/*
+ * With @dir, the inode is being created as @name in it; otherwise its data
+ * is written back for the first time since it was loaded, and only size
+ * rules are checked. The first matching rule sets the hint bits kept in
+ * i_advise, which __get_segment_type() then takes as they are.
+ */
+void apply_temp_rules(struct inode *inode, struct inode *dir,
+					const unsigned char *name)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct temp_rule *r = NULL;
+	unsigned char temp = NR_TEMP_TYPE;
+	unsigned int i;
+
+	if (!dir)
+		set_inode_flag(inode, FI_TEMP_RULED);
+
+	read_lock(&sbi->temp_rule_lock);
+	if (dir && !test_opt(sbi, DISABLE_EXT_IDENTIFY))
+		r = __match_suffix_rule(sbi, name);
+
+	for (i = 0; !r && i < sbi->nr_temp_rules; i++) {
+		struct temp_rule *t = &sbi->temp_rules[i];
+
+		if (dir ? __match_temp_rule(t, inode, dir) :
+				t->kind == TEMP_RULE_SIZE &&
+				i_size_read(inode) >= t->value)
+			r = t;
+	}
+
+	if (r)
+		temp = r->temp;
+	read_unlock(&sbi->temp_rule_lock);
+
+	if (temp != NR_TEMP_TYPE)
+		set_rule_temp(inode, temp);
+}
+
+static int parse_temp_rule(char *kind, char *value, struct temp_rule *key)
+{
+	u32 id;
+	int i, err;
+
+	for (i = 0; i < NR_TEMP_RULE_KINDS; i++)
+		if (!strcmp(kind, temp_rule_kinds[i]))
 			break;
-		}
+	if (i == NR_TEMP_RULE_KINDS || !value)
+		return -EINVAL;
+
+	key->kind = i;
+	if (i == TEMP_RULE_SUFFIX)
+		return temp_rule_suffix(key->suffix, value, strlen(value));
+	if (i == TEMP_RULE_SIZE)
+		return kstrtoull(value, 0, &key->value);
+
+	/* uid_t, projid_t and nid_t are all 32 bits wide */
+	err = kstrtou32(value, 0, &id);
+	if (!err)
+		key->value = id;
+	return err;
+}
+
+/*
+ * Commands are "add <kind> <value> <hot|warm|cold>", "del <kind> <value>"
+ * and "clear", where kind is one of temp_rule_kinds.
+ */
+int update_temp_rules(struct f2fs_sb_info *sbi, char *cmd)
+{
+	char *op, *kind, *value, *temp;
+	struct temp_rule key = { 0 };
+	int err;
+
+	cmd = strim(cmd);
+	op = strsep(&cmd, " ");
+	kind = strsep(&cmd, " ");
+	value = strsep(&cmd, " ");
+	temp = strsep(&cmd, " ");
+
+	if (!strcmp(op, "clear")) {
+		if (kind)
+			return -EINVAL;
+		write_lock(&sbi->temp_rule_lock);
+		sbi->nr_temp_rules = 0;
+		hash_init(sbi->temp_rule_hash);
+		write_unlock(&sbi->temp_rule_lock);
+		return 0;
+	}
+
+	if (!kind || cmd)
+		return -EINVAL;
+	err = parse_temp_rule(kind, value, &key);
+	if (err)
+		return err;
+
+	if (!strcmp(op, "del")) {
+		if (temp)
+			return -EINVAL;
+		write_lock(&sbi->temp_rule_lock);
+		err = __del_temp_rule(sbi, &key);
+		write_unlock(&sbi->temp_rule_lock);
+		return err;
+	}
+
+	if (strcmp(op, "add") || !temp)
+		return -EINVAL;
+	for (key.temp = 0; key.temp < NR_TEMP_TYPE; key.temp++)
+		if (!strcmp(temp, temp_names[key.temp]))
+			break;
+	if (key.temp == NR_TEMP_TYPE)
+		return -EINVAL;
+
+	write_lock(&sbi->temp_rule_lock);
+	err = __add_temp_rule(sbi, &key);
+	write_unlock(&sbi->temp_rule_lock);
+	return err;
+}
+
+int show_temp_rules(struct f2fs_sb_info *sbi, char *buf)
+{
+	int len = 0;
+	unsigned int i;
+
+	read_lock(&sbi->temp_rule_lock);
+	for (i = 0; i < sbi->nr_temp_rules; i++) {
+		struct temp_rule *r = &sbi->temp_rules[i];
+
+		if (r->kind == TEMP_RULE_SUFFIX)
+			len += scnprintf(buf + len, PAGE_SIZE - len,
+				"%s %s %s\n", temp_rule_kinds[r->kind],
+				r->suffix, temp_names[r->temp]);
+		else
+			len += scnprintf(buf + len, PAGE_SIZE - len,
+				"%s %llu %s\n", temp_rule_kinds[r->kind],
+				(unsigned long long)r->value,
+				temp_names[r->temp]);
 	}
+	read_unlock(&sbi->temp_rule_lock);
+	return len;
 }
 
 static int f2fs_create(struct inode *dir, struct dentry *dentry, umode_t mode,
@@ -202,8 +484,7 @@ static int f2fs_create(struct inode *dir, struct dentry *dentry, umode_t mode,
 	if (IS_ERR(inode))
 		return PTR_ERR(inode);
 
-	if (!test_opt(sbi, DISABLE_EXT_IDENTIFY))
-		set_cold_files(sbi, inode, dentry->d_name.name);
+	apply_temp_rules(inode, dir, dentry->d_name.name);
 
 	inode->i_op = &f2fs_file_inode_operations;
 	inode->i_fop = &f2fs_file_operations;
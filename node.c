@@ -355,6 +355,8 @@ static void set_node_addr(struct f2fs_sb_info *sbi, struct node_info *ni,
 
 	/* change address */
 	nat_set_blkaddr(e, new_blkaddr);
+	WRITE_ONCE(nm_i->nat_slot_seq[NAT_SEQ_SLOT(ni->nid)],
+						++nm_i->nat_seq);
 	if (new_blkaddr == NEW_ADDR || new_blkaddr == NULL_ADDR)
 		set_nat_flag(e, IS_CHECKPOINTED, false);
 	__set_nat_cache_dirty(nm_i, e);
@@ -450,6 +452,74 @@ cache:
 	cache_nat_entry(sbi, nid, &ne);
 }
 
+/*
+ * Batched get_node_info(): resolve @nis[i] for every nis[i].nid != 0.
+ * Hits in the NAT cache are served under a single nat_tree_lock, and the
+ * NAT blocks of the misses are read ahead together before they are
+ * resolved one by one. Returns the nat_seq the batch was resolved at, see
+ * nat_info_current().
+ */
+unsigned long get_node_info_batch(struct f2fs_sb_info *sbi,
+				struct node_info *nis, unsigned int count)
+{
+	struct f2fs_nm_info *nm_i = NM_I(sbi);
+	struct blk_plug plug;
+	struct nat_entry *e;
+	pgoff_t ra_ofs = ULONG_MAX;
+	unsigned int i, nr_miss = 0;
+	unsigned long nat_seq;
+
+	down_read(&nm_i->nat_tree_lock);
+	nat_seq = nm_i->nat_seq;
+	for (i = 0; i < count; i++) {
+		if (!nis[i].nid)
+			continue;
+		e = __lookup_nat_cache(nm_i, nis[i].nid);
+		if (e) {
+			nis[i].ino = nat_get_ino(e);
+			nis[i].blk_addr = nat_get_blkaddr(e);
+			nis[i].version = nat_get_version(e);
+		} else {
+			/* ino 0 marks an entry still to be resolved */
+			nis[i].ino = 0;
+			nr_miss++;
+		}
+	}
+	up_read(&nm_i->nat_tree_lock);
+
+	if (!nr_miss)
+		return nat_seq;
+
+	blk_start_plug(&plug);
+	for (i = 0; i < count; i++) {
+		if (!nis[i].nid || nis[i].ino)
+			continue;
+		if (NAT_BLOCK_OFFSET(nis[i].nid) == ra_ofs)
+			continue;
+		ra_ofs = NAT_BLOCK_OFFSET(nis[i].nid);
+		ra_meta_pages(sbi, ra_ofs, 1, META_NAT, true);
+	}
+	blk_finish_plug(&plug);
+
+	for (i = 0; i < count; i++)
+		if (nis[i].nid && !nis[i].ino)
+			get_node_info(sbi, nis[i].nid, &nis[i]);
+	return nat_seq;
+}
+
+/*
+ * @ni was resolved at @nat_seq; it still holds unless the address of a nid
+ * in the same NAT_SEQ_SLOT has changed since.
+ */
+static bool nat_info_current(struct f2fs_sb_info *sbi, struct node_info *ni,
+						unsigned long nat_seq)
+{
+	struct f2fs_nm_info *nm_i = NM_I(sbi);
+
+	return READ_ONCE(nm_i->nat_slot_seq[NAT_SEQ_SLOT(ni->nid)]) <=
+								nat_seq;
+}
+
 /*
  * readahead MAX_RA_NODE number of node pages.
  */
@@ -1102,8 +1172,10 @@ fail:
  * Caller should do after getting the following values.
  * 0: f2fs_put_page(page, 0)
  * LOCKED_PAGE or error: f2fs_put_page(page, 1)
+ * A @hint resolved at @nat_seq saves the NAT lookup while it is current.
  */
-static int read_node_page(struct page *page, int op_flags)
+static int read_node_page(struct page *page, int op_flags,
+			struct node_info *hint, unsigned long nat_seq)
 {
 	struct f2fs_sb_info *sbi = F2FS_P_SB(page);
 	struct node_info ni;
@@ -1119,7 +1191,11 @@ static int read_node_page(struct page *page, int op_flags)
 	if (PageUptodate(page))
 		return LOCKED_PAGE;
 pr_notice("page->index = 0x%x\n",page->index);
-	get_node_info(sbi, page->index, &ni);
+	if (hint && hint->nid == page->index &&
+			nat_info_current(sbi, hint, nat_seq))
+		ni = *hint;
+	else
+		get_node_info(sbi, page->index, &ni);
 
 	if (unlikely(ni.blk_addr == NULL_ADDR)) {
 		ClearPageUptodate(page);
@@ -1133,7 +1209,8 @@ pr_notice("page->index = 0x%x\n",page->index);
 /*
  * Readahead a node page
  */
-void ra_node_page(struct f2fs_sb_info *sbi, nid_t nid)
+static void __ra_node_page(struct f2fs_sb_info *sbi, nid_t nid,
+			struct node_info *hint, unsigned long nat_seq)
 {
 	struct page *apage;
 	int err;
@@ -1152,12 +1229,25 @@ void ra_node_page(struct f2fs_sb_info *sbi, nid_t nid)
 	if (!apage)
 		return;
 
-	err = read_node_page(apage, REQ_RAHEAD);
+	err = read_node_page(apage, REQ_RAHEAD, hint, nat_seq);
 	f2fs_put_page(apage, err ? 1 : 0);
 }
 
+void ra_node_page(struct f2fs_sb_info *sbi, nid_t nid)
+{
+	__ra_node_page(sbi, nid, NULL, 0);
+}
+
+/* readahead the node of @ni resolved by get_node_info_batch() */
+void ra_node_page_ni(struct f2fs_sb_info *sbi, struct node_info *ni,
+						unsigned long nat_seq)
+{
+	__ra_node_page(sbi, ni->nid, ni, nat_seq);
+}
+
 static struct page *__get_node_page(struct f2fs_sb_info *sbi, pgoff_t nid,
-					struct page *parent, int start)
+			struct page *parent, int start,
+			struct node_info *hint, unsigned long nat_seq)
 {
 	struct page *page;
 	int err;
@@ -1170,7 +1260,7 @@ repeat:
 	if (!page)
 		return ERR_PTR(-ENOMEM);
 
-	err = read_node_page(page, 0);
+	err = read_node_page(page, 0, hint, nat_seq);
 	if (err < 0) {
 		f2fs_put_page(page, 1);
 		return ERR_PTR(err);
@@ -1216,7 +1306,14 @@ out_err:
 
 struct page *get_node_page(struct f2fs_sb_info *sbi, pgoff_t nid)
 {
-	return __get_node_page(sbi, nid, NULL, 0);
+	return __get_node_page(sbi, nid, NULL, 0, NULL, 0);
+}
+
+/* get the node of @ni resolved by get_node_info_batch() */
+struct page *get_node_page_ni(struct f2fs_sb_info *sbi, struct node_info *ni,
+						unsigned long nat_seq)
+{
+	return __get_node_page(sbi, ni->nid, NULL, 0, ni, nat_seq);
 }
 
 struct page *get_node_page_ra(struct page *parent, int start)
@@ -1224,7 +1321,7 @@ struct page *get_node_page_ra(struct page *parent, int start)
 	struct f2fs_sb_info *sbi = F2FS_P_SB(parent);
 	nid_t nid = get_nid(parent, start, false);
 
-	return __get_node_page(sbi, nid, parent, start);
+	return __get_node_page(sbi, nid, parent, start, NULL, 0);
 }
 
 static void flush_inline_data(struct f2fs_sb_info *sbi, nid_t ino)
@@ -1372,8 +1469,16 @@ static int __write_node_page(struct page *page, bool atomic, bool *submitted,
 		return 0;
 	}
 
-	if (atomic && !test_opt(sbi, NOBARRIER))
+	if (atomic && !test_opt(sbi, NOBARRIER)) {
 		fio.op_flags |= REQ_PREFLUSH | REQ_FUA;
+	} else if (f2fs_fua_fsync(sbi) && IS_DNODE(page) &&
+						is_cold_node(page)) {
+		/* roll-forward walks these, a cached one breaks the chain */
+		if (is_fsync_dnode(page))
+			fio.op_flags |= REQ_FUA;
+		else
+			set_sbi_flag(sbi, SBI_CACHED_NODE);
+	}
 
 	set_page_writeback(page);
 	fio.old_blkaddr = ni.blk_addr;
@@ -2322,6 +2427,10 @@ retry:
 			F2FS_FITS_IN_INODE(src, le16_to_cpu(src->i_extra_isize),
 								i_projid))
 			dst->i_projid = src->i_projid;
+
+		if (F2FS_FITS_IN_INODE(src, le16_to_cpu(src->i_extra_isize),
+								i_temp_age))
+			dst->i_temp_age = src->i_temp_age;
 	}
 
 	new_ni = old_ni;
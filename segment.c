@@ -26,71 +26,15 @@
 #include "trace.h"
 #include <trace/events/f2fs.h>
 
-#define __reverse_ffz(x) __reverse_ffs(~(x))
-
 static struct kmem_cache *discard_entry_slab;
 static struct kmem_cache *discard_cmd_slab;
 static struct kmem_cache *sit_entry_set_slab;
 static struct kmem_cache *inmem_entry_slab;
-
-static unsigned long __reverse_ulong(unsigned char *str)
-{
-	unsigned long tmp = 0;
-	int shift = 24, idx = 0;
-
-#if BITS_PER_LONG == 64
-	shift = 56;
-#endif
-	while (shift >= 0) {
-		tmp |= (unsigned long)str[idx++] << shift;
-		shift -= BITS_PER_BYTE;
-	}
-	return tmp;
-}
-
-/*
- * __reverse_ffs is copied from include/asm-generic/bitops/__ffs.h since
- * MSB and LSB are reversed in a byte by f2fs_set_bit.
- */
-static inline unsigned long __reverse_ffs(unsigned long word)
-{
-	int num = 0;
-
-#if BITS_PER_LONG == 64
-	if ((word & 0xffffffff00000000UL) == 0)
-		num += 32;
-	else
-		word >>= 32;
-#endif
-	if ((word & 0xffff0000) == 0)
-		num += 16;
-	else
-		word >>= 16;
-
-	if ((word & 0xff00) == 0)
-		num += 8;
-	else
-		word >>= 8;
-
-	if ((word & 0xf0) == 0)
-		num += 4;
-	else
-		word >>= 4;
-
-	if ((word & 0xc) == 0)
-		num += 2;
-	else
-		word >>= 2;
-
-	if ((word & 0x2) == 0)
-		num += 1;
-	return num;
-}
+static struct kmem_cache *ckpt_map_slab;
 
 /*
- * __find_rev_next(_zero)_bit is copied from lib/find_next_bit.c because
- * f2fs_set_bit makes MSB and LSB reversed in a byte.
- * @size must be integral times of unsigned long.
+ * __find_rev_next(_zero)_bit work like find_next(_zero)_bit, but on bitmaps
+ * made by f2fs_set_bit, whose MSB and LSB are reversed in a byte.
  * Example:
  *                             MSB <--> LSB
  *   f2fs_set_bit(0, bitmap) => 1000 0000
@@ -100,73 +44,40 @@ static unsigned long __find_rev_next_bit(const unsigned long *addr,
 			unsigned long size, unsigned long offset)
 {
 	const unsigned long *p = addr + BIT_WORD(offset);
-	unsigned long result = size;
+	unsigned long result = offset & ~(BITS_PER_LONG - 1);
 	unsigned long tmp;
 
 	if (offset >= size)
 		return size;
 
-	size -= (offset & ~(BITS_PER_LONG - 1));
-	offset %= BITS_PER_LONG;
-
-	while (1) {
-		if (*p == 0)
-			goto pass;
-
-		tmp = __reverse_ulong((unsigned char *)p);
-
-		tmp &= ~0UL >> offset;
-		if (size < BITS_PER_LONG)
-			tmp &= (~0UL << (BITS_PER_LONG - size));
-		if (tmp)
-			goto found;
-pass:
-		if (size <= BITS_PER_LONG)
-			break;
-		size -= BITS_PER_LONG;
-		offset = 0;
-		p++;
+	tmp = f2fs_bitmap_word(p) & (~0UL >> (offset % BITS_PER_LONG));
+	while (!tmp) {
+		result += BITS_PER_LONG;
+		if (result >= size)
+			return size;
+		tmp = f2fs_bitmap_word(++p);
 	}
-	return result;
-found:
-	return result - size + __reverse_ffs(tmp);
+	return min(result + f2fs_first_bit(tmp), size);
 }
 
 static unsigned long __find_rev_next_zero_bit(const unsigned long *addr,
 			unsigned long size, unsigned long offset)
 {
 	const unsigned long *p = addr + BIT_WORD(offset);
-	unsigned long result = size;
+	unsigned long result = offset & ~(BITS_PER_LONG - 1);
 	unsigned long tmp;
 
 	if (offset >= size)
 		return size;
 
-	size -= (offset & ~(BITS_PER_LONG - 1));
-	offset %= BITS_PER_LONG;
-
-	while (1) {
-		if (*p == ~0UL)
-			goto pass;
-
-		tmp = __reverse_ulong((unsigned char *)p);
-
-		if (offset)
-			tmp |= ~0UL << (BITS_PER_LONG - offset);
-		if (size < BITS_PER_LONG)
-			tmp |= ~0UL >> size;
-		if (tmp != ~0UL)
-			goto found;
-pass:
-		if (size <= BITS_PER_LONG)
-			break;
-		size -= BITS_PER_LONG;
-		offset = 0;
-		p++;
+	tmp = ~f2fs_bitmap_word(p) & (~0UL >> (offset % BITS_PER_LONG));
+	while (!tmp) {
+		result += BITS_PER_LONG;
+		if (result >= size)
+			return size;
+		tmp = ~f2fs_bitmap_word(++p);
 	}
-	return result;
-found:
-	return result - size + __reverse_ffz(tmp);
+	return min(result + f2fs_first_bit(tmp), size);
 }
 
 bool need_SSR(struct f2fs_sb_info *sbi)
@@ -491,6 +402,8 @@ void f2fs_balance_fs_bg(struct f2fs_sb_info *sbi)
 	else
 		build_free_nids(sbi, false, false);
 
+	flush_sit_entries_bg(sbi);
+
 	if (!is_idle(sbi) && !excess_dirty_nats(sbi))
 		return;
 
@@ -546,50 +459,118 @@ static int submit_flush_wait(struct f2fs_sb_info *sbi, nid_t ino)
 	return ret;
 }
 
+static void f2fs_submit_flush_endio(struct bio *bio)
+{
+	struct flush_dev_queue *fq = bio->bi_private;
+	struct flush_cmd *cmd, *next;
+
+	fq->ret = blk_status_to_errno(bio->bi_status);
+	llist_for_each_entry_safe(cmd, next, fq->dispatch_list, llnode) {
+		cmd->ret = fq->ret;
+		complete(&cmd->wait);
+	}
+	fq->dispatch_list = NULL;
+	complete(&fq->done);
+	bio_put(bio);
+}
+
+static void __submit_flush_queue(struct f2fs_sb_info *sbi,
+					struct flush_dev_queue *fq)
+{
+	struct bio *bio = f2fs_bio_alloc(sbi, 0, true);
+
+	fq->dispatch_list = llist_del_all(&fq->issue_list);
+	fq->dispatch_list = llist_reverse_order(fq->dispatch_list);
+	reinit_completion(&fq->done);
+
+	bio->bi_opf = REQ_OP_WRITE | REQ_SYNC | REQ_PREFLUSH;
+	bio_set_dev(bio, fq->bdev);
+	bio->bi_private = fq;
+	bio->bi_end_io = f2fs_submit_flush_endio;
+	submit_bio(bio);
+}
+
 static int issue_flush_thread(void *data)
 {//flush线程
 	struct f2fs_sb_info *sbi = data;
 	struct flush_cmd_control *fcc = SM_I(sbi)->fcc_info;
 	wait_queue_head_t *q = &fcc->flush_wait_queue;
+	unsigned long submitted;
+	int i;
 repeat:
 	if (kthread_should_stop())
 		return 0;
 
 	sb_start_intwrite(sbi->sb);
 
-	if (!llist_empty(&fcc->issue_list)) {
-		struct flush_cmd *cmd, *next;
-		int ret;
-
-		fcc->dispatch_list = llist_del_all(&fcc->issue_list);
-		fcc->dispatch_list = llist_reverse_order(fcc->dispatch_list);
-
-		cmd = llist_entry(fcc->dispatch_list, struct flush_cmd, llnode);
-
-		ret = submit_flush_wait(sbi, cmd->ino);
+	/*
+	 * Flush every device with waiters at once, waiters are completed
+	 * by the endio of their own device.
+	 */
+	submitted = 0;
+	for (i = 0; i < fcc->nr_queues; i++) {
+		if (llist_empty(&fcc->queue[i].issue_list))
+			continue;
+		__submit_flush_queue(sbi, &fcc->queue[i]);
 		atomic_inc(&fcc->issued_flush);
+		__set_bit(i, &submitted);
+	}
 
-		llist_for_each_entry_safe(cmd, next,
-					  fcc->dispatch_list, llnode) {
-			cmd->ret = ret;
-			complete(&cmd->wait);
-		}
-		fcc->dispatch_list = NULL;
+	for_each_set_bit(i, &submitted, fcc->nr_queues) {
+		struct flush_dev_queue *fq = &fcc->queue[i];
+
+		wait_for_completion_io(&fq->done);
+		trace_f2fs_issue_flush(fq->bdev, test_opt(sbi, NOBARRIER),
+				test_opt(sbi, FLUSH_MERGE), fq->ret);
 	}
 
 	sb_end_intwrite(sbi->sb);
 
 	wait_event_interruptible(*q,
-		kthread_should_stop() || !llist_empty(&fcc->issue_list));
+		kthread_should_stop() || !flush_lists_empty(fcc));
 	goto repeat;
 }
 
-int f2fs_issue_flush(struct f2fs_sb_info *sbi, nid_t ino)
+static void __wait_flush_cmd(struct f2fs_sb_info *sbi, struct flush_cmd *cmd)
 {
 	struct flush_cmd_control *fcc = SM_I(sbi)->fcc_info;
-	struct flush_cmd cmd;
+	struct flush_dev_queue *fq = &fcc->queue[cmd->devi];
+	struct flush_cmd *tmp, *next;
+	struct llist_node *list;
+	bool found = false;
 	int ret;
 
+	if (fcc->f2fs_issue_flush)
+		goto wait;
+
+	/* no flush thread, issue the merged flush of this device here */
+	list = llist_del_all(&fq->issue_list);
+	if (!list)
+		goto wait;
+
+	ret = __submit_flush_wait(sbi, fq->bdev);
+
+	llist_for_each_entry_safe(tmp, next, list, llnode) {
+		if (tmp == cmd) {
+			cmd->ret = ret;
+			found = true;
+			continue;
+		}
+		tmp->ret = ret;
+		complete(&tmp->wait);
+	}
+	if (found)
+		return;
+wait:
+	wait_for_completion(&cmd->wait);
+}
+
+int f2fs_issue_flush(struct f2fs_sb_info *sbi, nid_t ino)
+{
+	struct flush_cmd_control *fcc = SM_I(sbi)->fcc_info;
+	struct flush_cmd cmd[MAX_DEVICES];
+	int i, nr = 0, ret = 0;
+
 	if (test_opt(sbi, NOBARRIER))
 		return 0;
 
@@ -599,7 +580,7 @@ int f2fs_issue_flush(struct f2fs_sb_info *sbi, nid_t ino)
 		return ret;
 	}
 
-	if (atomic_inc_return(&fcc->issing_flush) == 1 || sbi->s_ndevs > 1) {
+	if (atomic_inc_return(&fcc->issing_flush) == 1 && !sbi->s_ndevs) {
 		ret = submit_flush_wait(sbi, ino);
 		atomic_dec(&fcc->issing_flush);
 
@@ -607,10 +588,17 @@ int f2fs_issue_flush(struct f2fs_sb_info *sbi, nid_t ino)
 		return ret;
 	}
 
-	cmd.ino = ino;
-	init_completion(&cmd.wait);
-
-	llist_add(&cmd.llnode, &fcc->issue_list);
+	/* merge into the queue of every device this inode has dirtied */
+	for (i = 0; i < fcc->nr_queues; i++) {
+		if (sbi->s_ndevs && !is_dirty_device(sbi, ino, i, FLUSH_INO))
+			continue;
+		cmd[nr].ino = ino;
+		cmd[nr].devi = i;
+		cmd[nr].ret = 0;
+		init_completion(&cmd[nr].wait);
+		llist_add(&cmd[nr].llnode, &fcc->queue[i].issue_list);
+		nr++;
+	}
 
 	/* update issue_list before we wake up issue_flush thread */
 	smp_mb();
@@ -618,41 +606,21 @@ int f2fs_issue_flush(struct f2fs_sb_info *sbi, nid_t ino)
 	if (waitqueue_active(&fcc->flush_wait_queue))
 		wake_up(&fcc->flush_wait_queue);
 
-	if (fcc->f2fs_issue_flush) {
-		wait_for_completion(&cmd.wait);
-		atomic_dec(&fcc->issing_flush);
-	} else {
-		struct llist_node *list;
-
-		list = llist_del_all(&fcc->issue_list);
-		if (!list) {
-			wait_for_completion(&cmd.wait);
-			atomic_dec(&fcc->issing_flush);
-		} else {
-			struct flush_cmd *tmp, *next;
-
-			ret = submit_flush_wait(sbi, ino);
-
-			llist_for_each_entry_safe(tmp, next, list, llnode) {
-				if (tmp == &cmd) {
-					cmd.ret = ret;
-					atomic_dec(&fcc->issing_flush);
-					continue;
-				}
-				tmp->ret = ret;
-				complete(&tmp->wait);
-			}
-		}
+	for (i = 0; i < nr; i++) {
+		__wait_flush_cmd(sbi, &cmd[i]);
+		if (!ret)
+			ret = cmd[i].ret;
 	}
+	atomic_dec(&fcc->issing_flush);
 
-	return cmd.ret;
+	return ret;
 }
 
 int create_flush_cmd_control(struct f2fs_sb_info *sbi)
 {//为sbi->sm_info->fcc创建结构，并初始化flush_thread
 	dev_t dev = sbi->sb->s_bdev->bd_dev;
 	struct flush_cmd_control *fcc;
-	int err = 0;
+	int err = 0, i;
 
 	if (SM_I(sbi)->fcc_info) {
 		fcc = SM_I(sbi)->fcc_info;
@@ -667,7 +635,14 @@ int create_flush_cmd_control(struct f2fs_sb_info *sbi)
 	atomic_set(&fcc->issued_flush, 0);
 	atomic_set(&fcc->issing_flush, 0);
 	init_waitqueue_head(&fcc->flush_wait_queue);
-	init_llist_head(&fcc->issue_list);
+	fcc->nr_queues = max(sbi->s_ndevs, 1);
+	for (i = 0; i < fcc->nr_queues; i++) {
+		struct flush_dev_queue *fq = &fcc->queue[i];
+
+		fq->bdev = sbi->s_ndevs ? FDEV(i).bdev : sbi->sb->s_bdev;
+		init_llist_head(&fq->issue_list);
+		init_completion(&fq->done);
+	}
 	SM_I(sbi)->fcc_info = fcc;
 	if (!test_opt(sbi, FLUSH_MERGE))
 		return err;
@@ -723,6 +698,113 @@ int f2fs_flush_device_cache(struct f2fs_sb_info *sbi)
 	return ret;
 }
 
+static void __remove_victim_entry(struct victim_index *vi,
+				struct victim_entry *ve)
+{
+	if (list_empty(&ve->list))
+		return;
+
+	list_del_init(&ve->list);
+	if (list_empty(&vi->buckets[ve->vblocks]))
+		clear_bit(ve->vblocks, vi->bucket_map);
+	vi->nr_entries--;
+}
+
+static void __insert_victim_entry(struct victim_index *vi,
+			struct victim_entry *ve, unsigned int vblocks)
+{
+	list_add_tail(&ve->list, &vi->buckets[vblocks]);
+	set_bit(vblocks, vi->bucket_map);
+	ve->vblocks = vblocks;
+	vi->nr_entries++;
+}
+
+/*
+ * Move an indexed section to the bucket matching its current valid block
+ * count. Sections which are not indexed are left alone.
+ */
+static void __refresh_victim_entry(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	struct victim_index *vi = &DIRTY_I(sbi)->vindex;
+	struct victim_entry *ve;
+	unsigned int vblocks;
+
+	ve = &vi->entries[GET_SEC_FROM_SEG(sbi, segno)];
+	if (list_empty(&ve->list))
+		return;
+
+	vblocks = get_valid_blocks(sbi, segno, true);
+	if (ve->vblocks == vblocks)
+		return;
+
+	__remove_victim_entry(vi, ve);
+	__insert_victim_entry(vi, ve, vblocks);
+}
+
+/*
+ * A section is indexed as long as any of its segments is in the DIRTY
+ * segmap. This should be covered by seglist_lock.
+ */
+static void __update_victim_entry(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_index *vi = &dirty_i->vindex;
+	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
+	unsigned int start = GET_SEG_FROM_SEC(sbi, secno);
+	unsigned int end = start + sbi->segs_per_sec;
+	struct victim_entry *ve = &vi->entries[secno];
+
+	if (find_next_bit(dirty_i->dirty_segmap[DIRTY], end, start) >= end) {
+		__remove_victim_entry(vi, ve);
+		return;
+	}
+
+	if (list_empty(&ve->list))
+		__insert_victim_entry(vi, ve, get_valid_blocks(sbi, segno, true));
+	else
+		__refresh_victim_entry(sbi, segno);
+}
+
+/*
+ * Move an SSR indexed segment to the bucket matching its ckpt_valid_blocks.
+ * This should be called whenever ckpt_valid_blocks changes.
+ */
+static void __refresh_ssr_entry(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct seg_entry *se = get_seg_entry(sbi, segno);
+	struct victim_entry *ve = &dirty_i->ssr_entries[segno];
+	struct victim_index *vi;
+
+	if (list_empty(&ve->list) || ve->vblocks == se->ckpt_valid_blocks)
+		return;
+
+	vi = &dirty_i->ssr_index[se->type];
+	__remove_victim_entry(vi, ve);
+	__insert_victim_entry(vi, ve, se->ckpt_valid_blocks);
+}
+
+/* A segment is SSR indexed while it is in the dirty segmap of its type. */
+static void __update_ssr_entry(struct f2fs_sb_info *sbi, unsigned int segno,
+						enum dirty_type t, bool dirty)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct victim_entry *ve = &dirty_i->ssr_entries[segno];
+
+	if (!dirty) {
+		__remove_victim_entry(&dirty_i->ssr_index[t], ve);
+		return;
+	}
+
+	if (list_empty(&ve->list))
+		__insert_victim_entry(&dirty_i->ssr_index[t], ve,
+				get_seg_entry(sbi, segno)->ckpt_valid_blocks);
+	else
+		__refresh_ssr_entry(sbi, segno);
+}
+
 static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		enum dirty_type dirty_type)
 {
@@ -745,6 +827,9 @@ static void __locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 		}
 		if (!test_and_set_bit(segno, dirty_i->dirty_segmap[t]))
 			dirty_i->nr_dirty[t]++;
+
+		__update_victim_entry(sbi, segno);
+		__update_ssr_entry(sbi, segno, t, true);
 	}
 }
 
@@ -762,10 +847,31 @@ static void __remove_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno,
 
 		if (test_and_clear_bit(segno, dirty_i->dirty_segmap[t]))
 			dirty_i->nr_dirty[t]--;
+		__update_ssr_entry(sbi, segno, t, false);
 
 		if (get_valid_blocks(sbi, segno, true) == 0)
 			clear_bit(GET_SEC_FROM_SEG(sbi, segno),
 						dirty_i->victim_secmap);
+
+		__update_victim_entry(sbi, segno);
+	}
+}
+
+/*
+ * Bring the index entries of segments marked stale up to date. Caller holds
+ * seglist_lock.
+ */
+void refresh_stale_victims(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int segno;
+
+	for_each_set_bit(segno, dirty_i->stale_segmap, MAIN_SEGS(sbi)) {
+		/* clear first, so a racing update marks the segment again */
+		if (!test_and_clear_bit(segno, dirty_i->stale_segmap))
+			continue;
+		__refresh_victim_entry(sbi, segno);
+		__refresh_ssr_entry(sbi, segno);
 	}
 }
 
@@ -779,8 +885,33 @@ static void locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno)
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
 	unsigned short valid_blocks;
 
-	if (segno == NULL_SEGNO || IS_CURSEG(sbi, segno))
+	if (segno == NULL_SEGNO)
+		return;
+
+	/*
+	 * victim indexes are refreshed here rather than in update_sit_entry(),
+	 * which may run in parallel; the section of a current segment can
+	 * still be indexed through its other segments.
+	 */
+	if (IS_CURSEG(sbi, segno)) {
+		if (sbi->segs_per_sec > 1)
+			set_bit(segno, dirty_i->stale_segmap);
+		return;
+	}
+
+	valid_blocks = get_valid_blocks(sbi, segno, false);
+
+	/*
+	 * A dirty segment that stays dirty only moves within the indexes,
+	 * which can wait for the next victim selection. Segments only leave
+	 * DIRTY under sentry_lock for write or after their valid block count
+	 * changed, and that count is re-read under seglist_lock then.
+	 */
+	if (valid_blocks && valid_blocks < sbi->blocks_per_seg &&
+			test_bit(segno, dirty_i->dirty_segmap[DIRTY])) {
+		set_bit(segno, dirty_i->stale_segmap);
 		return;
+	}
 
 	mutex_lock(&dirty_i->seglist_lock);
 
@@ -799,6 +930,17 @@ static void locate_dirty_segment(struct f2fs_sb_info *sbi, unsigned int segno)
 	mutex_unlock(&dirty_i->seglist_lock);
 }
 
+static struct discard_dev_queue *__discard_dev_queue(
+		struct discard_cmd_control *dcc, struct block_device *bdev)
+{
+	int i;
+
+	for (i = 1; i < dcc->nr_dev_queues; i++)
+		if (dcc->dev_queue[i].bdev == bdev)
+			return &dcc->dev_queue[i];
+	return &dcc->dev_queue[0];
+}
+
 static struct discard_cmd *__create_discard_cmd(struct f2fs_sb_info *sbi,
 		struct block_device *bdev, block_t lstart,
 		block_t start, block_t len)
@@ -809,11 +951,12 @@ static struct discard_cmd *__create_discard_cmd(struct f2fs_sb_info *sbi,
 
 	f2fs_bug_on(sbi, !len);
 
-	pend_list = &dcc->pend_list[plist_idx(len)];
-
 	dc = f2fs_kmem_cache_alloc(discard_cmd_slab, GFP_NOFS);
 	INIT_LIST_HEAD(&dc->list);
 	dc->bdev = bdev;
+	dc->dq = __discard_dev_queue(dcc, bdev);
+	dc->ds = discard_shard(dcc, lstart);
+	pend_list = discard_pend_list(dc->ds, dc->dq, plist_idx(len));
 	dc->lstart = lstart;
 	dc->start = start;
 	dc->len = len;
@@ -823,7 +966,7 @@ static struct discard_cmd *__create_discard_cmd(struct f2fs_sb_info *sbi,
 	init_completion(&dc->wait);
 	list_add_tail(&dc->list, pend_list);
 	atomic_inc(&dcc->discard_cmd_cnt);
-	dcc->undiscard_blks += len;
+	dc->ds->undiscard_blks += len;
 
 	return dc;
 }
@@ -833,13 +976,12 @@ static struct discard_cmd *__attach_discard_cmd(struct f2fs_sb_info *sbi,
 				block_t start, block_t len,
 				struct rb_node *parent, struct rb_node **p)
 {
-	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
 	struct discard_cmd *dc;
 
 	dc = __create_discard_cmd(sbi, bdev, lstart, start, len);
 
 	rb_link_node(&dc->rb_node, parent, p);
-	rb_insert_color(&dc->rb_node, &dcc->root);
+	rb_insert_color(&dc->rb_node, &dc->ds->root);
 
 	return dc;
 }
@@ -851,8 +993,8 @@ static void __detach_discard_cmd(struct discard_cmd_control *dcc,
 		atomic_dec(&dcc->issing_discard);
 
 	list_del(&dc->list);
-	rb_erase(&dc->rb_node, &dcc->root);
-	dcc->undiscard_blks -= dc->len;
+	rb_erase(&dc->rb_node, &dc->ds->root);
+	dc->ds->undiscard_blks -= dc->len;
 
 	kmem_cache_free(discard_cmd_slab, dc);
 
@@ -881,6 +1023,13 @@ static void __remove_discard_cmd(struct f2fs_sb_info *sbi,
 static void f2fs_submit_discard_endio(struct bio *bio)
 {
 	struct discard_cmd *dc = (struct discard_cmd *)bio->bi_private;
+	struct discard_dev_queue *dq = dc->dq;
+	unsigned int lat = ktime_us_delta(ktime_get(), dc->issue_time);
+	unsigned int avg = READ_ONCE(dq->avg_lat_us);
+
+	/* racy update is fine, it only steers the depth of the queue */
+	WRITE_ONCE(dq->avg_lat_us, avg - (avg >> 3) + (lat >> 3));
+	atomic_dec(&dq->inflight);
 
 	dc->error = blk_status_to_errno(bio->bi_status);
 	dc->state = D_DONE;
@@ -922,7 +1071,7 @@ static void __submit_discard_cmd(struct f2fs_sb_info *sbi,
 {
 	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
 	struct list_head *wait_list = (dpolicy->type == DPOLICY_FSTRIM) ?
-					&(dcc->fstrim_list) : &(dcc->wait_list);
+				&(dc->ds->fstrim_list) : &(dc->ds->wait_list);
 	struct bio *bio = NULL;
 	int flag = dpolicy->sync ? REQ_SYNC : 0;
 
@@ -944,6 +1093,8 @@ static void __submit_discard_cmd(struct f2fs_sb_info *sbi,
 			bio->bi_private = dc;
 			bio->bi_end_io = f2fs_submit_discard_endio;
 			bio->bi_opf |= flag;
+			dc->issue_time = ktime_get();
+			atomic_inc(&dc->dq->inflight);
 			submit_bio(bio);
 			list_move_tail(&dc->list, wait_list);
 			__check_sit_bitmap(sbi, dc->start, dc->start + dc->len);
@@ -962,6 +1113,7 @@ static struct discard_cmd *__insert_discard_tree(struct f2fs_sb_info *sbi,
 				struct rb_node *insert_parent)
 {
 	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_shard *ds = discard_shard(dcc, lstart);
 	struct rb_node **p;
 	struct rb_node *parent = NULL;
 	struct discard_cmd *dc = NULL;
@@ -972,7 +1124,7 @@ static struct discard_cmd *__insert_discard_tree(struct f2fs_sb_info *sbi,
 		goto do_insert;
 	}
 
-	p = __lookup_rb_tree_for_insert(sbi, &dcc->root, &parent, lstart);
+	p = __lookup_rb_tree_for_insert(sbi, &ds->root, &parent, lstart);
 do_insert:
 	dc = __attach_discard_cmd(sbi, bdev, lstart, start, len, parent, p);
 	if (!dc)
@@ -984,7 +1136,8 @@ do_insert:
 static void __relocate_discard_cmd(struct discard_cmd_control *dcc,
 						struct discard_cmd *dc)
 {
-	list_move_tail(&dc->list, &dcc->pend_list[plist_idx(dc->len)]);
+	list_move_tail(&dc->list,
+			discard_pend_list(dc->ds, dc->dq, plist_idx(dc->len)));
 }
 
 static void __punch_discard_cmd(struct f2fs_sb_info *sbi,
@@ -999,11 +1152,11 @@ static void __punch_discard_cmd(struct f2fs_sb_info *sbi,
 		return;
 	}
 
-	dcc->undiscard_blks -= di.len;
+	dc->ds->undiscard_blks -= di.len;
 
 	if (blkaddr > di.lstart) {
 		dc->len = blkaddr - dc->lstart;
-		dcc->undiscard_blks += dc->len;
+		dc->ds->undiscard_blks += dc->len;
 		__relocate_discard_cmd(dcc, dc);
 		modified = true;
 	}
@@ -1018,7 +1171,7 @@ static void __punch_discard_cmd(struct f2fs_sb_info *sbi,
 			dc->lstart++;
 			dc->len--;
 			dc->start++;
-			dcc->undiscard_blks += dc->len;
+			dc->ds->undiscard_blks += dc->len;
 			__relocate_discard_cmd(dcc, dc);
 		}
 	}
@@ -1029,15 +1182,16 @@ static void __update_discard_tree_range(struct f2fs_sb_info *sbi,
 				block_t start, block_t len)
 {
 	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_shard *ds = discard_shard(dcc, lstart);
 	struct discard_cmd *prev_dc = NULL, *next_dc = NULL;
 	struct discard_cmd *dc;
 	struct discard_info di = {0};
 	struct rb_node **insert_p = NULL, *insert_parent = NULL;
 	block_t end = lstart + len;
 
-	mutex_lock(&dcc->cmd_lock);
+	mutex_lock(&ds->cmd_lock);
 
-	dc = (struct discard_cmd *)__lookup_rb_tree_ret(&dcc->root,
+	dc = (struct discard_cmd *)__lookup_rb_tree_ret(&ds->root,
 					NULL, lstart,
 					(struct rb_entry **)&prev_dc,
 					(struct rb_entry **)&next_dc,
@@ -1078,11 +1232,12 @@ static void __update_discard_tree_range(struct f2fs_sb_info *sbi,
 			prev_dc->bdev == bdev &&
 			__is_discard_back_mergeable(&di, &prev_dc->di)) {
 			prev_dc->di.len += di.len;
-			dcc->undiscard_blks += di.len;
+			ds->undiscard_blks += di.len;
 			__relocate_discard_cmd(dcc, prev_dc);
 			di = prev_dc->di;
 			tdc = prev_dc;
 			merged = true;
+			atomic_inc(&dcc->merged_discard);
 		}
 
 		if (next_dc && next_dc->state == D_PREP &&
@@ -1091,11 +1246,12 @@ static void __update_discard_tree_range(struct f2fs_sb_info *sbi,
 			next_dc->di.lstart = di.lstart;
 			next_dc->di.len += di.len;
 			next_dc->di.start = di.start;
-			dcc->undiscard_blks += di.len;
+			ds->undiscard_blks += di.len;
 			__relocate_discard_cmd(dcc, next_dc);
 			if (tdc)
 				__remove_discard_cmd(sbi, tdc);
 			merged = true;
+			atomic_inc(&dcc->merged_discard);
 		}
 
 		if (!merged) {
@@ -1111,12 +1267,13 @@ static void __update_discard_tree_range(struct f2fs_sb_info *sbi,
 		next_dc = rb_entry_safe(node, struct discard_cmd, rb_node);
 	}
 
-	mutex_unlock(&dcc->cmd_lock);
+	mutex_unlock(&ds->cmd_lock);
 }
 
 static int __queue_discard_cmd(struct f2fs_sb_info *sbi,
 		struct block_device *bdev, block_t blkstart, block_t blklen)
 {
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
 	block_t lblkstart = blkstart;
 
 	trace_f2fs_queue_discard(bdev, blkstart, blklen);
@@ -1126,15 +1283,27 @@ static int __queue_discard_cmd(struct f2fs_sb_info *sbi,
 
 		blkstart -= FDEV(devi).start_blk;
 	}
-	__update_discard_tree_range(sbi, bdev, lblkstart, blkstart, blklen);
+
+	/* a discard command never spans two shards of the tree */
+	while (blklen) {
+		block_t shard_end = round_up(lblkstart + 1,
+					1U << dcc->shard_shift);
+		block_t len = min(blklen, shard_end - lblkstart);
+
+		__update_discard_tree_range(sbi, bdev, lblkstart,
+							blkstart, len);
+		lblkstart += len;
+		blkstart += len;
+		blklen -= len;
+	}
 	return 0;
 }
 
-static void __issue_discard_cmd_range(struct f2fs_sb_info *sbi,
+static void __issue_discard_shard_range(struct f2fs_sb_info *sbi,
 					struct discard_policy *dpolicy,
+					struct discard_shard *ds,
 					unsigned int start, unsigned int end)
 {
-	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
 	struct discard_cmd *prev_dc = NULL, *next_dc = NULL;
 	struct rb_node **insert_p = NULL, *insert_parent = NULL;
 	struct discard_cmd *dc;
@@ -1144,10 +1313,10 @@ static void __issue_discard_cmd_range(struct f2fs_sb_info *sbi,
 next:
 	issued = 0;
 
-	mutex_lock(&dcc->cmd_lock);
-	f2fs_bug_on(sbi, !__check_rb_tree_consistence(sbi, &dcc->root));
+	mutex_lock(&ds->cmd_lock);
+	f2fs_bug_on(sbi, !__check_rb_tree_consistence(sbi, &ds->root));
 
-	dc = (struct discard_cmd *)__lookup_rb_tree_ret(&dcc->root,
+	dc = (struct discard_cmd *)__lookup_rb_tree_ret(&ds->root,
 					NULL, start,
 					(struct rb_entry **)&prev_dc,
 					(struct rb_entry **)&next_dc,
@@ -1164,7 +1333,7 @@ next:
 			goto skip;
 
 		if (dc->state != D_PREP) {
-			list_move_tail(&dc->list, &dcc->fstrim_list);
+			list_move_tail(&dc->list, &ds->fstrim_list);
 			goto skip;
 		}
 
@@ -1174,7 +1343,7 @@ next:
 			start = dc->lstart + dc->len;
 
 			blk_finish_plug(&plug);
-			mutex_unlock(&dcc->cmd_lock);
+			mutex_unlock(&ds->cmd_lock);
 
 			schedule();
 
@@ -1189,49 +1358,131 @@ skip:
 	}
 
 	blk_finish_plug(&plug);
-	mutex_unlock(&dcc->cmd_lock);
+	mutex_unlock(&ds->cmd_lock);
+}
+
+static void __issue_discard_cmd_range(struct f2fs_sb_info *sbi,
+					struct discard_policy *dpolicy,
+					unsigned int start, unsigned int end)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_shard *ds = discard_shard(dcc, start);
+
+	for (; ds <= discard_shard(dcc, end); ds++) {
+		__issue_discard_shard_range(sbi, dpolicy, ds, start, end);
+		if (fatal_signal_pending(current))
+			break;
+	}
+}
+
+/*
+ * Halve the depth of a device whose discards complete slower than the
+ * latency target, since they are queueing behind foreground I/O there;
+ * otherwise grow it by one per round up to max_inflight.
+ */
+static void __adjust_discard_depth(struct discard_cmd_control *dcc,
+					struct discard_dev_queue *dq)
+{
+	unsigned int lat_ms = READ_ONCE(dq->avg_lat_us) / USEC_PER_MSEC;
+
+	if (dcc->discard_latency && lat_ms > dcc->discard_latency)
+		dq->depth = max(dq->depth >> 1, 1U);
+	else if (dq->depth < dcc->max_inflight)
+		dq->depth++;
+	dq->depth = min(dq->depth, dcc->max_inflight);
+}
+
+static int __issue_discard_queue(struct f2fs_sb_info *sbi,
+				struct discard_policy *dpolicy,
+				struct discard_shard *ds,
+				struct discard_dev_queue *dq, int i,
+				int *iter, bool *io_interrupted)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct list_head *pend_list = discard_pend_list(ds, dq, i);
+	struct discard_cmd *dc, *tmp;
+	int issued = 0;
+
+	list_for_each_entry_safe(dc, tmp, pend_list, list) {
+		f2fs_bug_on(sbi, dc->state != D_PREP);
+
+		if (dpolicy->io_aware && i < dpolicy->io_aware_gran &&
+					!is_bdev_idle(sbi, dq->bdev)) {
+			*io_interrupted = true;
+			goto skip;
+		}
+
+		if (dpolicy->io_aware &&
+			atomic_read(&dq->inflight) >= dq->depth) {
+			atomic_inc(&dcc->deferred_discard);
+			*io_interrupted = true;
+			break;
+		}
+
+		__submit_discard_cmd(sbi, dpolicy, dc);
+		issued++;
+skip:
+		if (++(*iter) >= dpolicy->max_requests)
+			break;
+	}
+	return issued;
 }
 
 static int __issue_discard_cmd(struct f2fs_sb_info *sbi,
 					struct discard_policy *dpolicy)
 {
 	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
-	struct list_head *pend_list;
-	struct discard_cmd *dc, *tmp;
+	struct discard_dev_queue *dq;
 	struct blk_plug plug;
-	int i, iter = 0, issued = 0;
+	int iter[MAX_DEVICES] = {0};
+	int i, s, d, done = 0, issued = 0;
 	bool io_interrupted = false;
 
+	if (dpolicy->io_aware)
+		for (d = 0; d < dcc->nr_dev_queues; d++)
+			__adjust_discard_depth(dcc, &dcc->dev_queue[d]);
+
+	/* each device gets max_requests per round, largest extents first */
 	for (i = MAX_PLIST_NUM - 1; i >= 0; i--) {
 		if (i + 1 < dpolicy->granularity)
 			break;
-		pend_list = &dcc->pend_list[i];
 
-		mutex_lock(&dcc->cmd_lock);
-		if (list_empty(pend_list))
-			goto next;
-		f2fs_bug_on(sbi, !__check_rb_tree_consistence(sbi, &dcc->root));
-		blk_start_plug(&plug);
-		list_for_each_entry_safe(dc, tmp, pend_list, list) {
-			f2fs_bug_on(sbi, dc->state != D_PREP);
-
-			if (dpolicy->io_aware && i < dpolicy->io_aware_gran &&
-								!is_idle(sbi)) {
-				io_interrupted = true;
-				goto skip;
+		for (s = 0; s < dcc->nr_shards; s++) {
+			struct discard_shard *ds = &dcc->shards[s];
+
+			/* unlocked peek, a racing insert waits a round */
+			for (d = 0; d < dcc->nr_dev_queues; d++)
+				if (!list_empty(discard_pend_list(ds,
+						&dcc->dev_queue[d], i)))
+					break;
+			if (d == dcc->nr_dev_queues)
+				continue;
+
+			mutex_lock(&ds->cmd_lock);
+			f2fs_bug_on(sbi,
+				!__check_rb_tree_consistence(sbi, &ds->root));
+			blk_start_plug(&plug);
+			for (d = 0, done = 0; d < dcc->nr_dev_queues; d++) {
+				dq = &dcc->dev_queue[d];
+
+				if (iter[d] >= dpolicy->max_requests) {
+					done++;
+					continue;
+				}
+				if (list_empty(discard_pend_list(ds, dq, i)))
+					continue;
+				issued += __issue_discard_queue(sbi, dpolicy,
+						ds, dq, i, &iter[d],
+						&io_interrupted);
 			}
+			blk_finish_plug(&plug);
+			mutex_unlock(&ds->cmd_lock);
 
-			__submit_discard_cmd(sbi, dpolicy, dc);
-			issued++;
-skip:
-			if (++iter >= dpolicy->max_requests)
+			if (done == dcc->nr_dev_queues)
 				break;
 		}
-		blk_finish_plug(&plug);
-next:
-		mutex_unlock(&dcc->cmd_lock);
 
-		if (iter >= dpolicy->max_requests)
+		if (done == dcc->nr_dev_queues)
 			break;
 	}
 
@@ -1244,21 +1495,23 @@ next:
 static bool __drop_discard_cmd(struct f2fs_sb_info *sbi)
 {
 	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
-	struct list_head *pend_list;
+	struct discard_shard *ds;
 	struct discard_cmd *dc, *tmp;
 	int i;
 	bool dropped = false;
 
-	mutex_lock(&dcc->cmd_lock);
-	for (i = MAX_PLIST_NUM - 1; i >= 0; i--) {
-		pend_list = &dcc->pend_list[i];
-		list_for_each_entry_safe(dc, tmp, pend_list, list) {
-			f2fs_bug_on(sbi, dc->state != D_PREP);
-			__remove_discard_cmd(sbi, dc);
-			dropped = true;
+	for (ds = dcc->shards; ds < dcc->shards + dcc->nr_shards; ds++) {
+		mutex_lock(&ds->cmd_lock);
+		for (i = dcc->nr_dev_queues * MAX_PLIST_NUM - 1; i >= 0; i--) {
+			list_for_each_entry_safe(dc, tmp,
+						&ds->pend_list[i], list) {
+				f2fs_bug_on(sbi, dc->state != D_PREP);
+				__remove_discard_cmd(sbi, dc);
+				dropped = true;
+			}
 		}
+		mutex_unlock(&ds->cmd_lock);
 	}
-	mutex_unlock(&dcc->cmd_lock);
 
 	return dropped;
 }
@@ -1271,11 +1524,11 @@ void drop_discard_cmd(struct f2fs_sb_info *sbi)
 static unsigned int __wait_one_discard_bio(struct f2fs_sb_info *sbi,
 							struct discard_cmd *dc)
 {
-	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_shard *ds = dc->ds;
 	unsigned int len = 0;
 
 	wait_for_completion_io(&dc->wait);
-	mutex_lock(&dcc->cmd_lock);
+	mutex_lock(&ds->cmd_lock);
 	f2fs_bug_on(sbi, dc->state != D_DONE);
 	dc->ref--;
 	if (!dc->ref) {
@@ -1283,18 +1536,18 @@ static unsigned int __wait_one_discard_bio(struct f2fs_sb_info *sbi,
 			len = dc->len;
 		__remove_discard_cmd(sbi, dc);
 	}
-	mutex_unlock(&dcc->cmd_lock);
+	mutex_unlock(&ds->cmd_lock);
 
 	return len;
 }
 
-static unsigned int __wait_discard_cmd_range(struct f2fs_sb_info *sbi,
+static unsigned int __wait_discard_shard_range(struct f2fs_sb_info *sbi,
 						struct discard_policy *dpolicy,
+						struct discard_shard *ds,
 						block_t start, block_t end)
 {
-	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
 	struct list_head *wait_list = (dpolicy->type == DPOLICY_FSTRIM) ?
-					&(dcc->fstrim_list) : &(dcc->wait_list);
+					&(ds->fstrim_list) : &(ds->wait_list);
 	struct discard_cmd *dc, *tmp;
 	bool need_wait;
 	unsigned int trimmed = 0;
@@ -1302,7 +1555,7 @@ static unsigned int __wait_discard_cmd_range(struct f2fs_sb_info *sbi,
 next:
 	need_wait = false;
 
-	mutex_lock(&dcc->cmd_lock);
+	mutex_lock(&ds->cmd_lock);
 	list_for_each_entry_safe(dc, tmp, wait_list, list) {
 		if (dc->lstart + dc->len <= start || end <= dc->lstart)
 			continue;
@@ -1319,7 +1572,7 @@ next:
 			break;
 		}
 	}
-	mutex_unlock(&dcc->cmd_lock);
+	mutex_unlock(&ds->cmd_lock);
 
 	if (need_wait) {
 		trimmed += __wait_one_discard_bio(sbi, dc);
@@ -1329,30 +1582,71 @@ next:
 	return trimmed;
 }
 
+static unsigned int __wait_discard_cmd_range(struct f2fs_sb_info *sbi,
+						struct discard_policy *dpolicy,
+						block_t start, block_t end)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_shard *ds = discard_shard(dcc, start);
+	unsigned int trimmed = 0;
+
+	for (; ds <= discard_shard(dcc, end); ds++)
+		trimmed += __wait_discard_shard_range(sbi, dpolicy, ds,
+								start, end);
+	return trimmed;
+}
+
 static void __wait_all_discard_cmd(struct f2fs_sb_info *sbi,
 						struct discard_policy *dpolicy)
 {
 	__wait_discard_cmd_range(sbi, dpolicy, 0, UINT_MAX);
 }
 
-/* This should be covered by global mutex, &sit_i->sentry_lock */
-static void f2fs_wait_discard_bio(struct f2fs_sb_info *sbi, block_t blkaddr)
+/*
+ * Free the discard commands which have completed, without waiting for the
+ * rest; those still in flight keep counting against the depth of their
+ * device in the next round.
+ */
+static void __reap_done_discard_cmd(struct f2fs_sb_info *sbi)
 {
 	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
-	struct discard_cmd *dc;
-	bool need_wait = false;
+	struct discard_shard *ds;
+	struct discard_cmd *dc, *tmp;
 
-	mutex_lock(&dcc->cmd_lock);
-	dc = (struct discard_cmd *)__lookup_rb_tree(&dcc->root, NULL, blkaddr);
-	if (dc) {
-		if (dc->state == D_PREP) {
-			__punch_discard_cmd(sbi, dc, blkaddr);
-		} else {
-			dc->ref++;
-			need_wait = true;
+	for (ds = dcc->shards; ds < dcc->shards + dcc->nr_shards; ds++) {
+		if (list_empty(&ds->wait_list))
+			continue;
+
+		mutex_lock(&ds->cmd_lock);
+		list_for_each_entry_safe(dc, tmp, &ds->wait_list, list) {
+			if (dc->state != D_DONE || dc->ref)
+				continue;
+			wait_for_completion_io(&dc->wait);
+			__remove_discard_cmd(sbi, dc);
+		}
+		mutex_unlock(&ds->cmd_lock);
+	}
+}
+
+/* This should be covered by global mutex, &sit_i->sentry_lock */
+static void f2fs_wait_discard_bio(struct f2fs_sb_info *sbi, block_t blkaddr)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	struct discard_shard *ds = discard_shard(dcc, blkaddr);
+	struct discard_cmd *dc;
+	bool need_wait = false;
+
+	mutex_lock(&ds->cmd_lock);
+	dc = (struct discard_cmd *)__lookup_rb_tree(&ds->root, NULL, blkaddr);
+	if (dc) {
+		if (dc->state == D_PREP) {
+			__punch_discard_cmd(sbi, dc, blkaddr);
+		} else {
+			dc->ref++;
+			need_wait = true;
 		}
 	}
-	mutex_unlock(&dcc->cmd_lock);
+	mutex_unlock(&ds->cmd_lock);
 
 	if (need_wait)
 		__wait_one_discard_bio(sbi, dc);
@@ -1420,13 +1714,17 @@ static int issue_discard_thread(void *data)
 
 		sb_start_intwrite(sbi->sb);
 
+		/*
+		 * The per-device depth bounds what is in flight, so rounds
+		 * only reap completed commands instead of draining all.
+		 */
+		__reap_done_discard_cmd(sbi);
 		issued = __issue_discard_cmd(sbi, &dpolicy);
-		if (issued) {
-			__wait_all_discard_cmd(sbi, &dpolicy);
+		/* come back soon while submitted commands wait to be reaped */
+		if (issued || atomic_read(&dcc->issing_discard))
 			wait_ms = dpolicy.min_interval;
-		} else {
+		else
 			wait_ms = dpolicy.max_interval;
-		}
 
 		sb_end_intwrite(sbi->sb);
 
@@ -1524,7 +1822,7 @@ static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
 		offset = GET_BLKOFF_FROM_SEG0(sbi, i);
 
 		if (!f2fs_test_and_set_bit(offset, se->discard_map))
-			sbi->discard_blks--;
+			percpu_counter_dec(&sbi->discard_blks);
 	}
 
 	if (len)
@@ -1535,7 +1833,6 @@ static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
 static bool add_discard_addrs(struct f2fs_sb_info *sbi, struct cp_control *cpc,
 							bool check_only)
 {
-	int entries = SIT_VBLOCK_MAP_SIZE / sizeof(unsigned long);
 	int max_blocks = sbi->blocks_per_seg;
 	struct seg_entry *se = get_seg_entry(sbi, cpc->trim_start);
 	unsigned long *cur_map = (unsigned long *)se->cur_valid_map;
@@ -1559,9 +1856,12 @@ static bool add_discard_addrs(struct f2fs_sb_info *sbi, struct cp_control *cpc,
 	}
 
 	/* SIT_VBLOCK_MAP_SIZE should be multiple of sizeof(unsigned long) */
-	for (i = 0; i < entries; i++)
-		dmap[i] = force ? ~ckpt_map[i] & ~discard_map[i] :
-				(cur_map[i] ^ ckpt_map[i]) & ckpt_map[i];
+	if (force) {
+		bitmap_or(dmap, ckpt_map, discard_map, max_blocks);
+		bitmap_complement(dmap, dmap, max_blocks);
+	} else {
+		bitmap_andnot(dmap, ckpt_map, cur_map, max_blocks);
+	}
 
 	while (force || SM_I(sbi)->dcc_info->nr_discards <=
 				SM_I(sbi)->dcc_info->max_discards) {
@@ -1735,11 +2035,73 @@ void init_discard_policy(struct discard_policy *dpolicy,
 	}
 }
 
+static void __free_discard_cmd_control(struct discard_cmd_control *dcc)
+{
+	int s;
+
+	if (dcc->shards)
+		for (s = 0; s < dcc->nr_shards; s++)
+			kvfree(dcc->shards[s].pend_list);
+	kvfree(dcc->shards);
+	kvfree(dcc->dev_queue);
+	kfree(dcc);
+}
+
+static int __init_discard_queues(struct f2fs_sb_info *sbi,
+					struct discard_cmd_control *dcc)
+{
+	unsigned int nr_lists;
+	int i, s, d;
+
+	dcc->nr_dev_queues = max(sbi->s_ndevs, 1);
+	dcc->dev_queue = f2fs_kvzalloc(sbi, dcc->nr_dev_queues *
+				sizeof(struct discard_dev_queue), GFP_KERNEL);
+	if (!dcc->dev_queue)
+		return -ENOMEM;
+
+	for (d = 0; d < dcc->nr_dev_queues; d++) {
+		struct discard_dev_queue *dq = &dcc->dev_queue[d];
+
+		dq->bdev = sbi->s_ndevs ? FDEV(d).bdev : sbi->sb->s_bdev;
+		dq->index = d;
+		atomic_set(&dq->inflight, 0);
+		dq->depth = dcc->max_inflight;
+	}
+
+	/* at most MAX_DISCARD_SHARDS shards, each at least one segment */
+	dcc->shard_shift = max_t(int, fls(MAX_BLKADDR(sbi)) -
+				ilog2(MAX_DISCARD_SHARDS),
+				sbi->log_blocks_per_seg);
+	dcc->nr_shards = ((MAX_BLKADDR(sbi) - 1) >> dcc->shard_shift) + 1;
+	dcc->shards = f2fs_kvzalloc(sbi, dcc->nr_shards *
+				sizeof(struct discard_shard), GFP_KERNEL);
+	if (!dcc->shards)
+		return -ENOMEM;
+
+	nr_lists = dcc->nr_dev_queues * MAX_PLIST_NUM;
+	for (s = 0; s < dcc->nr_shards; s++) {
+		struct discard_shard *ds = &dcc->shards[s];
+
+		ds->pend_list = f2fs_kvmalloc(sbi, nr_lists *
+				sizeof(struct list_head), GFP_KERNEL);
+		if (!ds->pend_list)
+			return -ENOMEM;
+		for (i = 0; i < nr_lists; i++)
+			INIT_LIST_HEAD(&ds->pend_list[i]);
+		INIT_LIST_HEAD(&ds->wait_list);
+		INIT_LIST_HEAD(&ds->fstrim_list);
+		mutex_init(&ds->cmd_lock);
+		ds->root = RB_ROOT;
+		ds->undiscard_blks = 0;
+	}
+	return 0;
+}
+
 static int create_discard_cmd_control(struct f2fs_sb_info *sbi)
 {//为sm_info创建discard_cmd_control,并初始化discard_线程
 	dev_t dev = sbi->sb->s_bdev->bd_dev;
 	struct discard_cmd_control *dcc;
-	int err = 0, i;
+	int err = 0;
 
 	if (SM_I(sbi)->dcc_info) {
 		dcc = SM_I(sbi)->dcc_info;
@@ -1750,20 +2112,23 @@ static int create_discard_cmd_control(struct f2fs_sb_info *sbi)
 	if (!dcc)
 		return -ENOMEM;
 
+	dcc->max_inflight = DEF_MAX_DISCARD_INFLIGHT;
+	dcc->discard_latency = DEF_DISCARD_LATENCY;
+	err = __init_discard_queues(sbi, dcc);
+	if (err) {
+		__free_discard_cmd_control(dcc);
+		return err;
+	}
+
 	dcc->discard_granularity = DEFAULT_DISCARD_GRANULARITY;
 	INIT_LIST_HEAD(&dcc->entry_list);
-	for (i = 0; i < MAX_PLIST_NUM; i++)
-		INIT_LIST_HEAD(&dcc->pend_list[i]);
-	INIT_LIST_HEAD(&dcc->wait_list);
-	INIT_LIST_HEAD(&dcc->fstrim_list);
-	mutex_init(&dcc->cmd_lock);
 	atomic_set(&dcc->issued_discard, 0);
 	atomic_set(&dcc->issing_discard, 0);
 	atomic_set(&dcc->discard_cmd_cnt, 0);
+	atomic_set(&dcc->merged_discard, 0);
+	atomic_set(&dcc->deferred_discard, 0);
 	dcc->nr_discards = 0;
 	dcc->max_discards = MAIN_SEGS(sbi) << sbi->log_blocks_per_seg;
-	dcc->undiscard_blks = 0;
-	dcc->root = RB_ROOT;
 
 	init_waitqueue_head(&dcc->discard_wait_queue);
 	SM_I(sbi)->dcc_info = dcc;
@@ -1772,7 +2137,7 @@ init_thread:
 				"f2fs_discard-%u:%u", MAJOR(dev), MINOR(dev));
 	if (IS_ERR(dcc->f2fs_issue_discard)) {
 		err = PTR_ERR(dcc->f2fs_issue_discard);
-		kfree(dcc);
+		__free_discard_cmd_control(dcc);
 		SM_I(sbi)->dcc_info = NULL;
 		return err;
 	}
@@ -1789,7 +2154,7 @@ static void destroy_discard_cmd_control(struct f2fs_sb_info *sbi)
 
 	stop_discard_thread(sbi);
 
-	kfree(dcc);
+	__free_discard_cmd_control(dcc);
 	SM_I(sbi)->dcc_info = NULL;
 }
 
@@ -1797,8 +2162,8 @@ static bool __mark_sit_entry_dirty(struct f2fs_sb_info *sbi, unsigned int segno)
 {
 	struct sit_info *sit_i = SIT_I(sbi);
 
-	if (!__test_and_set_bit(segno, sit_i->dirty_sentries_bitmap)) {
-		sit_i->dirty_sentries++;
+	if (!test_and_set_bit(segno, sit_i->dirty_sentries_bitmap)) {
+		percpu_counter_inc(&sit_i->dirty_sentries);
 		return false;
 	}
 
@@ -1814,7 +2179,44 @@ static void __set_sit_entry_type(struct f2fs_sb_info *sbi, int type,
 		__mark_sit_entry_dirty(sbi, segno);
 }
 
-static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
+/*
+ * Give ckpt_valid_map a private copy before cur_valid_map diverges from it.
+ * Callers holding a stripe lock pass in a preallocated map via @map.
+ */
+static void __unshare_ckpt_map(struct f2fs_sb_info *sbi,
+				struct seg_entry *se, unsigned char **map)
+{
+	unsigned char *new_map;
+
+	if (map) {
+		new_map = *map;
+		*map = NULL;
+	} else {
+		new_map = f2fs_kmem_cache_alloc(ckpt_map_slab, GFP_NOFS);
+	}
+	f2fs_bug_on(sbi, !new_map);
+
+	memcpy(new_map, se->cur_valid_map, SIT_VBLOCK_MAP_SIZE);
+	se->ckpt_valid_map = new_map;
+	atomic_inc(&SIT_I(sbi)->nr_ckpt_maps);
+}
+
+/*
+ * Checkpointed state caught up with the current one, so drop the private
+ * copy and alias cur_valid_map again. Called under sentry_lock for write.
+ */
+static void __sync_ckpt_map(struct f2fs_sb_info *sbi, struct seg_entry *se)
+{
+	if (se->ckpt_valid_map != se->cur_valid_map) {
+		kmem_cache_free(ckpt_map_slab, se->ckpt_valid_map);
+		se->ckpt_valid_map = se->cur_valid_map;
+		atomic_dec(&SIT_I(sbi)->nr_ckpt_maps);
+	}
+	se->ckpt_valid_blocks = se->valid_blocks;
+}
+
+static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr,
+					int del, unsigned char **map)
 {
 	struct seg_entry *se;
 	unsigned int segno, offset;
@@ -1835,7 +2237,10 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 
 	se->valid_blocks = new_vblocks;
 	se->mtime = get_mtime(sbi);
-	SIT_I(sbi)->max_mtime = se->mtime;
+	update_max_mtime(SIT_I(sbi), se->mtime);
+
+	if (se->ckpt_valid_map == se->cur_valid_map)
+		__unshare_ckpt_map(sbi, se, map);
 
 	/* Update valid block bitmap */
 	if (del > 0) {
@@ -1860,7 +2265,7 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 
 		if (f2fs_discard_en(sbi) &&
 			!f2fs_test_and_set_bit(offset, se->discard_map))
-			sbi->discard_blks--;
+			percpu_counter_dec(&sbi->discard_blks);
 
 		/* don't overwrite by SSR to keep node chain */
 		if (se->type == CURSEG_WARM_NODE) {
@@ -1889,7 +2294,7 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 
 		if (f2fs_discard_en(sbi) &&
 			f2fs_test_and_clear_bit(offset, se->discard_map))
-			sbi->discard_blks++;
+			percpu_counter_inc(&sbi->discard_blks);
 	}
 	if (!f2fs_test_bit(offset, se->ckpt_valid_map))
 		se->ckpt_valid_blocks += del;
@@ -1897,12 +2302,35 @@ static void update_sit_entry(struct f2fs_sb_info *sbi, block_t blkaddr, int del)
 	__mark_sit_entry_dirty(sbi, segno);
 
 	/* update total number of valid blocks to be written in ckpt area */
-	SIT_I(sbi)->written_valid_blocks += del;
+	percpu_counter_add(&SIT_I(sbi)->written_valid_blocks, del);
 
 	if (sbi->segs_per_sec > 1)
 		get_sec_entry(sbi, segno)->valid_blocks += del;
 }
 
+/*
+ * update_sit_entry() for callers that may hold sentry_lock for read only:
+ * the entry is updated under the lock of its stripe as well.
+ */
+static void update_sit_entry_striped(struct f2fs_sb_info *sbi,
+					block_t blkaddr, int del)
+{
+	unsigned int segno = GET_SEGNO(sbi, blkaddr);
+	struct seg_entry *se = get_seg_entry(sbi, segno);
+	unsigned char *map = NULL;
+
+	/* maps are only re-shared under sentry_lock for write */
+	if (se->ckpt_valid_map == se->cur_valid_map)
+		map = f2fs_kmem_cache_alloc(ckpt_map_slab, GFP_NOFS);
+
+	spin_lock(sentry_stripe_lock(sbi, segno));
+	update_sit_entry(sbi, blkaddr, del, &map);
+	spin_unlock(sentry_stripe_lock(sbi, segno));
+
+	if (map)
+		kmem_cache_free(ckpt_map_slab, map);
+}
+
 void invalidate_blocks(struct f2fs_sb_info *sbi, block_t addr)
 {
 	unsigned int segno = GET_SEGNO(sbi, addr);
@@ -1912,15 +2340,17 @@ void invalidate_blocks(struct f2fs_sb_info *sbi, block_t addr)
 	if (addr == NEW_ADDR)
 		return;
 
+	materialize_sit_entry(sbi, segno);
+
 	/* add it into sit main buffer */
-	down_write(&sit_i->sentry_lock);
+	down_read(&sit_i->sentry_lock);
 
-	update_sit_entry(sbi, addr, -1);
+	update_sit_entry_striped(sbi, addr, -1);
 
 	/* add it into dirty seglist */
 	locate_dirty_segment(sbi, segno);
 
-	up_write(&sit_i->sentry_lock);
+	up_read(&sit_i->sentry_lock);
 }
 
 bool is_checkpointed_data(struct f2fs_sb_info *sbi, block_t blkaddr)
@@ -1933,9 +2363,11 @@ bool is_checkpointed_data(struct f2fs_sb_info *sbi, block_t blkaddr)
 	if (blkaddr == NEW_ADDR || blkaddr == NULL_ADDR)
 		return true;
 
+	segno = GET_SEGNO(sbi, blkaddr);
+	materialize_sit_entry(sbi, segno);
+
 	down_read(&sit_i->sentry_lock);
 
-	segno = GET_SEGNO(sbi, blkaddr);
 	se = get_seg_entry(sbi, segno);
 	offset = GET_BLKOFF_FROM_SEG0(sbi, blkaddr);
 
@@ -1947,6 +2379,173 @@ bool is_checkpointed_data(struct f2fs_sb_info *sbi, block_t blkaddr)
 	return is_cp;
 }
 
+/* decode one SIT entry, and return # of blocks it adds to discard_blks */
+static unsigned int __load_sit_entry(struct f2fs_sb_info *sbi,
+			unsigned int segno, struct f2fs_sit_entry *sit)
+{
+	struct seg_entry *se = get_seg_entry(sbi, segno);
+
+	seg_info_from_raw_sit(se, sit);
+
+	/* build discard map only one time */
+	if (!f2fs_discard_en(sbi))
+		return 0;
+	if (SIT_I(sbi)->mount_trimmed) {
+		memset(se->discard_map, 0xff, SIT_VBLOCK_MAP_SIZE);
+		return 0;
+	}
+	memcpy(se->discard_map, se->cur_valid_map, SIT_VBLOCK_MAP_SIZE);
+	return sbi->blocks_per_seg - se->valid_blocks;
+}
+
+/*
+ * Decode SIT block @blk into the cache. Sections may straddle SIT blocks, so
+ * sec_entries are updated under their stripe lock.
+ */
+static int __decode_sit_block(struct f2fs_sb_info *sbi, unsigned int blk)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned int start = blk * SIT_ENTRY_PER_BLOCK;
+	unsigned int end = min(start + SIT_ENTRY_PER_BLOCK, MAIN_SEGS(sbi));
+	struct f2fs_sit_block *sit_blk;
+	struct page *page;
+	unsigned int segno, discard_blks = 0;
+	int err = 0;
+
+	page = get_current_sit_page(sbi, start);
+	sit_blk = (struct f2fs_sit_block *)page_address(page);
+
+	for (segno = start; segno < end; segno++) {
+		struct f2fs_sit_entry *sit;
+		struct seg_entry *se = get_seg_entry(sbi, segno);
+
+		sit = &sit_blk->entries[SIT_ENTRY_OFFSET(sit_i, segno)];
+		err = check_block_count(sbi, segno, sit);
+		if (err)
+			break;
+		discard_blks += __load_sit_entry(sbi, segno, sit);
+
+		if (sbi->segs_per_sec > 1) {
+			spin_lock(sentry_stripe_lock(sbi, segno));
+			get_sec_entry(sbi, segno)->valid_blocks +=
+							se->valid_blocks;
+			spin_unlock(sentry_stripe_lock(sbi, segno));
+		}
+		if (se->mtime < sit_i->min_mtime)
+			sit_i->min_mtime = se->mtime;
+	}
+	f2fs_put_page(page, 1);
+
+	percpu_counter_add(&sbi->discard_blks, discard_blks);
+	return err;
+}
+
+static void __mark_sit_block_loaded(struct f2fs_sb_info *sbi,
+						unsigned int blk)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+
+	/* cache must be visible before materialize_sit_entry() skips it */
+	smp_wmb();
+	set_bit(blk, sit_i->loaded_blocks_bitmap);
+	if (++sit_i->nr_loaded_blocks == SIT_BLK_CNT(sbi)) {
+		FREE_I(sbi)->pending_segments = 0;
+		sit_i->sit_loaded = true;
+	}
+}
+
+/*
+ * Decode SIT block @blk after mount, and put its segments on the free and
+ * dirty segmaps. Caller holds load_lock and sentry_lock.
+ */
+static void __load_sit_block(struct f2fs_sb_info *sbi, unsigned int blk)
+{
+	struct free_segmap_info *free_i = FREE_I(sbi);
+	unsigned int start = blk * SIT_ENTRY_PER_BLOCK;
+	unsigned int end = min(start + SIT_ENTRY_PER_BLOCK, MAIN_SEGS(sbi));
+	unsigned int segno, nr_free = 0;
+
+	if (__decode_sit_block(sbi, blk)) {
+		/* keep the whole block away from the allocator */
+		set_sbi_flag(sbi, SBI_NEED_FSCK);
+		goto out;
+	}
+
+	for (segno = start; segno < end; segno++) {
+		struct seg_entry *se = get_seg_entry(sbi, segno);
+
+		if (!se->valid_blocks) {
+			__set_free(sbi, segno);
+			nr_free++;
+			continue;
+		}
+		percpu_counter_add(&SIT_I(sbi)->written_valid_blocks,
+							se->valid_blocks);
+		if (se->valid_blocks == sbi->blocks_per_seg)
+			continue;
+		mutex_lock(&DIRTY_I(sbi)->seglist_lock);
+		__locate_dirty_segment(sbi, segno, DIRTY);
+		mutex_unlock(&DIRTY_I(sbi)->seglist_lock);
+	}
+	free_i->pending_segments -= min(free_i->pending_segments, nr_free);
+out:
+	__mark_sit_block_loaded(sbi, blk);
+}
+
+void load_sit_block(struct f2fs_sb_info *sbi, unsigned int blk)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+
+	if (test_bit(blk, sit_i->loaded_blocks_bitmap)) {
+		smp_rmb();
+		return;
+	}
+
+	down_read(&sit_i->sentry_lock);
+	mutex_lock(&sit_i->load_lock);
+	if (!test_bit(blk, sit_i->loaded_blocks_bitmap))
+		__load_sit_block(sbi, blk);
+	mutex_unlock(&sit_i->load_lock);
+	up_read(&sit_i->sentry_lock);
+}
+
+/*
+ * lazy_sit only frees a section once its SIT blocks are decoded; decode
+ * more in the allocator's path rather than running out of free sections.
+ * Caller holds sentry_lock for write.
+ */
+static void load_free_sections(struct f2fs_sb_info *sbi)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned int blk;
+
+	mutex_lock(&sit_i->load_lock);
+	while (!sit_i->sit_loaded &&
+			FREE_I(sbi)->free_sections <= reserved_sections(sbi)) {
+		blk = find_first_zero_bit(sit_i->loaded_blocks_bitmap,
+							SIT_BLK_CNT(sbi));
+		__load_sit_block(sbi, blk);
+	}
+	mutex_unlock(&sit_i->load_lock);
+}
+
+static void load_sit_work_fn(struct work_struct *work)
+{
+	struct sit_info *sit_i = container_of(work, struct sit_info,
+								load_work);
+	struct f2fs_sb_info *sbi = sit_i->sbi;
+	unsigned int blk;
+
+	for (blk = 0; blk < SIT_BLK_CNT(sbi); blk++) {
+		if (READ_ONCE(sit_i->load_stop))
+			break;
+		if (!(blk % BIO_MAX_PAGES))
+			ra_meta_pages(sbi, blk, BIO_MAX_PAGES, META_SIT, false);
+		load_sit_block(sbi, blk);
+		cond_resched();
+	}
+}
+
 /*
  * This function should be resided under the curseg_mutex lock
  */
@@ -2051,6 +2650,49 @@ static int is_next_segment_free(struct f2fs_sb_info *sbi, int type)
 	return 0;
 }
 
+/* find_next_zero_bit() on free_secmap, skipping full words by summary */
+static unsigned int __find_next_free_sec(struct free_segmap_info *free_i,
+					unsigned int max, unsigned int start)
+{
+	unsigned int nr_words = BITS_TO_LONGS(max);
+	unsigned int word = BIT_WORD(start);
+	unsigned long val;
+
+	if (start >= max)
+		return max;
+
+	val = ~free_i->free_secmap[word] & BITMAP_FIRST_WORD_MASK(start);
+	while (!val) {
+		word = find_next_zero_bit(free_i->free_secmap_sum,
+							nr_words, word + 1);
+		if (word >= nr_words)
+			return max;
+		val = ~free_i->free_secmap[word];
+	}
+	return min(word * BITS_PER_LONG + __ffs(val), max);
+}
+
+/* the last free section at or before @start, or @max if there is none */
+static unsigned int __find_prev_free_sec(struct free_segmap_info *free_i,
+					unsigned int max, unsigned int start)
+{
+	unsigned int word = BIT_WORD(start);
+	unsigned long val;
+
+	if (start >= max)
+		return max;
+
+	val = ~free_i->free_secmap[word] & BITMAP_LAST_WORD_MASK(start + 1);
+	while (!val) {
+		if (!word--)
+			return max;
+		if (test_bit(word, free_i->free_secmap_sum))
+			continue;
+		val = ~free_i->free_secmap[word];
+	}
+	return word * BITS_PER_LONG + __fls(val);
+}
+
 /*
  * Find a new segment from the free segments bitmap to right order
  * This function should be returned with success, otherwise BUG
@@ -2068,6 +2710,9 @@ static void get_new_segment(struct f2fs_sb_info *sbi,
 	int go_left = 0;
 	int i;
 
+	if (unlikely(!SIT_I(sbi)->sit_loaded))
+		load_free_sections(sbi);
+
 	spin_lock(&free_i->segmap_lock);
 
 	if (!new_sec && ((*newseg + 1) % sbi->segs_per_sec)) {
@@ -2077,10 +2722,10 @@ static void get_new_segment(struct f2fs_sb_info *sbi,
 			goto got_it;
 	}
 find_other_zone:
-	secno = find_next_zero_bit(free_i->free_secmap, MAIN_SECS(sbi), hint);
+	secno = __find_next_free_sec(free_i, MAIN_SECS(sbi), hint);
 	if (secno >= MAIN_SECS(sbi)) {
 		if (dir == ALLOC_RIGHT) {
-			secno = find_next_zero_bit(free_i->free_secmap,
+			secno = __find_next_free_sec(free_i,
 							MAIN_SECS(sbi), 0);
 			f2fs_bug_on(sbi, secno >= MAIN_SECS(sbi));
 		} else {
@@ -2091,15 +2736,10 @@ find_other_zone:
 	if (go_left == 0)
 		goto skip_left;
 
-	while (test_bit(left_start, free_i->free_secmap)) {
-		if (left_start > 0) {
-			left_start--;
-			continue;
-		}
-		left_start = find_next_zero_bit(free_i->free_secmap,
-							MAIN_SECS(sbi), 0);
+	left_start = __find_prev_free_sec(free_i, MAIN_SECS(sbi), left_start);
+	if (left_start >= MAIN_SECS(sbi)) {
+		left_start = __find_next_free_sec(free_i, MAIN_SECS(sbi), 0);
 		f2fs_bug_on(sbi, left_start >= MAIN_SECS(sbi));
-		break;
 	}
 	secno = left_start;
 skip_left:
@@ -2158,7 +2798,8 @@ static void reset_curseg(struct f2fs_sb_info *sbi, int type, int modified)
 		SET_SUM_TYPE(sum_footer, SUM_TYPE_DATA);
 	if (IS_NODESEG(type))
 		SET_SUM_TYPE(sum_footer, SUM_TYPE_NODE);
-	__set_sit_entry_type(sbi, type, curseg->segno, modified);
+	__set_sit_entry_type(sbi, curseg_sit_type(type), curseg->segno,
+								modified);
 }
 
 static unsigned int __get_next_segno(struct f2fs_sb_info *sbi, int type)
@@ -2187,7 +2828,8 @@ static void new_curseg(struct f2fs_sb_info *sbi, int type, bool new_sec)
 
 	write_sum_page(sbi, curseg->sum_blk,
 				GET_SUM_BLOCK(sbi, segno));
-	if (type == CURSEG_WARM_DATA || type == CURSEG_COLD_DATA)
+	if (type == CURSEG_WARM_DATA || type == CURSEG_COLD_DATA ||
+							IS_VOLATILE_LOG(type))
 		dir = ALLOC_RIGHT;
 
 	if (test_opt(sbi, NOHEAP))
@@ -2200,6 +2842,53 @@ static void new_curseg(struct f2fs_sb_info *sbi, int type, bool new_sec)
 	curseg->alloc_type = LFS;
 }
 
+/*
+ * A volatile log is opened by its first write after mount or checkpoint, in
+ * a new section next to the warm data log.
+ */
+static void open_volatile_log(struct f2fs_sb_info *sbi, int type)
+{
+	struct curseg_info *curseg = CURSEG_I(sbi, type);
+	unsigned int segno = CURSEG_I(sbi, CURSEG_WARM_DATA)->segno;
+
+	get_new_segment(sbi, &segno, true, ALLOC_RIGHT);
+	curseg->next_segno = segno;
+	reset_curseg(sbi, type, 1);
+	curseg->alloc_type = LFS;
+	stat_inc_seg_type(sbi, curseg);
+}
+
+/*
+ * The checkpoint records only the persistent logs, so volatile logs are
+ * closed before it: their summaries go to the SSA area, and their segments
+ * become ordinary dirty segments for SSR and GC.
+ */
+void close_volatile_logs(struct f2fs_sb_info *sbi)
+{
+	struct curseg_info *curseg;
+	unsigned int segno;
+	int i;
+
+	for (i = CURSEG_STREAM_DATA; i < NO_CHECK_TYPE; i++) {
+		if (!is_volatile_log_used(sbi, i))
+			continue;
+		curseg = CURSEG_I(sbi, i);
+
+		mutex_lock(&curseg->curseg_mutex);
+		segno = curseg->segno;
+		if (segno != NULL_SEGNO) {
+			write_sum_page(sbi, curseg->sum_blk,
+					GET_SUM_BLOCK(sbi, segno));
+
+			down_write(&SIT_I(sbi)->sentry_lock);
+			curseg->segno = NULL_SEGNO;
+			locate_dirty_segment(sbi, segno);
+			up_write(&SIT_I(sbi)->sentry_lock);
+		}
+		mutex_unlock(&curseg->curseg_mutex);
+	}
+}
+
 static void __next_free_blkoff(struct f2fs_sb_info *sbi,
 			struct curseg_info *seg, block_t start)
 {
@@ -2271,6 +2960,9 @@ static int get_ssr_segment(struct f2fs_sb_info *sbi, int type)
 	int i, cnt;
 	bool reversed = false;
 
+	/* volatile logs reuse the space of warm data */
+	type = curseg_sit_type(type);
+
 	/* need_SSR() already forces to do this */
 	if (v_ops->get_victim(sbi, &segno, BG_GC, type, SSR)) {
 		curseg->next_segno = segno;
@@ -2399,6 +3091,11 @@ int f2fs_trim_fs(struct f2fs_sb_info *sbi, struct fstrim_range *range)
 	end_segno = (end >= MAX_BLKADDR(sbi)) ? MAIN_SEGS(sbi) - 1 :
 						GET_SEGNO(sbi, end);
 
+	/* discard maps of undecoded SIT blocks would say all is free */
+	for (cur_segno = START_SEGNO(start_segno); cur_segno <= end_segno;
+				cur_segno += SIT_ENTRY_PER_BLOCK)
+		materialize_sit_entry(sbi, cur_segno);
+
 	cpc.reason = CP_DISCARD;
 	cpc.trim_minlen = max_t(__u64, 1, F2FS_BYTES_TO_BLK(range->minlen));
 
@@ -2407,9 +3104,9 @@ int f2fs_trim_fs(struct f2fs_sb_info *sbi, struct fstrim_range *range)
 					cur_segno = cpc.trim_end + 1) {
 		cpc.trim_start = cur_segno;
 
-		if (sbi->discard_blks == 0)
+		if (discard_blocks(sbi) == 0)
 			break;
-		else if (sbi->discard_blks < BATCHED_TRIM_BLOCKS(sbi))
+		else if (discard_blocks(sbi) < BATCHED_TRIM_BLOCKS(sbi))
 			cpc.trim_end = end_segno;
 		else
 			cpc.trim_end = min_t(unsigned int,
@@ -2458,6 +3155,112 @@ int rw_hint_to_seg_type(enum rw_hint hint)
 	}
 }
 
+/*
+ * With stream logs, a file set to a stream by F2FS_IOC_SET_STREAM and data
+ * written with a medium or long lifetime hint get a log of their own.
+ */
+static int __get_stream_type(struct inode *inode)
+{
+	unsigned int nr_streams = F2FS_I_SB(inode)->nr_stream_logs;
+	unsigned int stream = F2FS_I(inode)->i_stream;
+
+	if (!stream) {
+		switch (inode->i_write_hint) {
+		case WRITE_LIFE_MEDIUM:
+			stream = 1;
+			break;
+		case WRITE_LIFE_LONG:
+			stream = 2;
+			break;
+		default:
+			return rw_hint_to_seg_type(inode->i_write_hint);
+		}
+	}
+	return CURSEG_STREAM_DATA + (stream - 1) % nr_streams;
+}
+
+static enum temp_type __age_to_temp(struct f2fs_sb_info *sbi,
+						unsigned long long age)
+{
+	if (age < sbi->temp_hot_age)
+		return HOT;
+	if (age >= sbi->temp_cold_age)
+		return COLD;
+	return WARM;
+}
+
+/*
+ * Data writes of an inode separated by more than a second make up a write
+ * pass. When a pass overwrites blocks, the time since the previous pass is
+ * how long those blocks lived; it is averaged into i_temp_age, and compared
+ * against the log the old block was placed in. Inodes whose extra attribute
+ * area has room for it keep i_temp_age on disk, so the learned temperature
+ * survives eviction; older inodes relearn it each time they are loaded.
+ */
+static int __classify_data_type(struct f2fs_io_info *fio)
+{
+	struct f2fs_sb_info *sbi = fio->sbi;
+	struct inode *inode = fio->page->mapping->host;
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+	unsigned long long now = get_mtime(sbi);
+	bool dirty = false;
+
+	if (now > fi->i_temp_last + 1) {
+		fi->i_temp_prev = fi->i_temp_pass;
+		fi->i_temp_pass = now;
+	}
+	fi->i_temp_last = now;
+
+	if (fi->i_temp_prev && fio->old_blkaddr != NEW_ADDR &&
+				fio->old_blkaddr != NULL_ADDR) {
+		unsigned long long age = now - fi->i_temp_prev;
+		unsigned int segno = GET_SEGNO(sbi, fio->old_blkaddr);
+		enum temp_type actual = __age_to_temp(sbi, age);
+		unsigned char type;
+
+		materialize_sit_entry(sbi, segno);
+		down_read(&SIT_I(sbi)->sentry_lock);
+		type = get_seg_entry(sbi, segno)->type;
+		up_read(&SIT_I(sbi)->sentry_lock);
+
+		if (IS_DATASEG(type)) {
+			enum temp_type placed = type - CURSEG_HOT_DATA;
+
+			if (placed == actual)
+				atomic64_inc(&sbi->temp_hit[placed]);
+			else
+				atomic64_inc(&sbi->temp_miss[placed]);
+		}
+
+		age = min_t(unsigned long long, age, UINT_MAX);
+		if (fi->i_temp_age)
+			age = (3ULL * fi->i_temp_age + age) >> 2;
+
+		/* only a new class is worth an inode update */
+		if (!fi->i_temp_age || __age_to_temp(sbi, age) !=
+				__age_to_temp(sbi, fi->i_temp_age))
+			dirty = true;
+		fi->i_temp_age = age;
+		fi->i_temp_prev = 0;
+	}
+
+	if (dirty)
+		f2fs_mark_inode_dirty_sync(inode, true);
+
+	/* no overwrite was seen yet */
+	if (!fi->i_temp_age)
+		return CURSEG_WARM_DATA;
+
+	switch (__age_to_temp(sbi, fi->i_temp_age)) {
+	case HOT:
+		return CURSEG_HOT_DATA;
+	case COLD:
+		return CURSEG_COLD_DATA;
+	default:
+		return CURSEG_WARM_DATA;
+	}
+}
+
 static int __get_segment_type_2(struct f2fs_io_info *fio)
 {
 	if (fio->type == DATA)
@@ -2488,10 +3291,19 @@ static int __get_segment_type_6(struct f2fs_io_info *fio)
 	if (fio->type == DATA) {
 		struct inode *inode = fio->page->mapping->host;
 
-		if (is_cold_data(fio->page) || file_is_cold(inode))
+		/* the cold flag marks pages moved by GC */
+		if (is_cold_data(fio->page))
+			return get_gc_data_type(inode);
+		if (file_is_cold(inode))
 			return CURSEG_COLD_DATA;
-		if (is_inode_flag_set(inode, FI_HOT_DATA))
+		if (is_inode_flag_set(inode, FI_HOT_DATA) ||
+						file_is_hot(inode))
 			return CURSEG_HOT_DATA;
+		if (F2FS_I_SB(inode)->nr_stream_logs)
+			return __get_stream_type(inode);
+		if (F2FS_I_SB(inode)->temp_classify && S_ISREG(inode->i_mode) &&
+				inode->i_write_hint == WRITE_LIFE_NOT_SET)
+			return __classify_data_type(fio);
 		return rw_hint_to_seg_type(inode->i_write_hint);
 	} else {
 		if (IS_DNODE(fio->page))
@@ -2519,7 +3331,22 @@ static int __get_segment_type(struct f2fs_io_info *fio)
 		f2fs_bug_on(fio->sbi, true);
 	}
 
-	if (IS_HOT(type))
+	/*
+	 * spread warm data of concurrent writers over the sub-logs by inode;
+	 * writeback runs on the flusher's CPU, not on the writer's
+	 */
+	if (type == CURSEG_WARM_DATA && fio->sbi->nr_alloc_shards &&
+					!is_cold_data(fio->page)) {
+		struct inode *inode = fio->page->mapping->host;
+		int shard = inode->i_ino % (fio->sbi->nr_alloc_shards + 1);
+
+		if (shard)
+			type = CURSEG_SHARD_DATA + shard - 1;
+	}
+
+	if (IS_VOLATILE_LOG(type))
+		fio->temp = volatile_log_temp(fio->sbi, type);
+	else if (IS_HOT(type))
 		fio->temp = HOT;
 	else if (IS_WARM(type))
 		fio->temp = WARM;
@@ -2535,11 +3362,29 @@ void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 {
 	struct sit_info *sit_i = SIT_I(sbi);
 	struct curseg_info *curseg = CURSEG_I(sbi, type);
+	bool exclusive;
+
+	materialize_sit_entry(sbi, GET_SEGNO(sbi, old_blkaddr));
 
 	down_read(&SM_I(sbi)->curseg_lock);
 
 	mutex_lock(&curseg->curseg_mutex);
-	down_write(&sit_i->sentry_lock);
+
+	/*
+	 * Appending to an LFS segment only updates the SIT entries of the new
+	 * and old blocks, which their stripe locks cover. Opening a log and
+	 * SSR, whose next free block is looked up in the shared tmp_map, are
+	 * serialized by sentry_lock for write.
+	 */
+	exclusive = curseg->alloc_type == SSR ||
+		(IS_VOLATILE_LOG(type) && curseg->segno == NULL_SEGNO);
+	if (exclusive)
+		down_write(&sit_i->sentry_lock);
+	else
+		down_read(&sit_i->sentry_lock);
+
+	if (IS_VOLATILE_LOG(type) && curseg->segno == NULL_SEGNO)
+		open_volatile_log(sbi, type);
 
 	*new_blkaddr = NEXT_FREE_BLKADDR(sbi, curseg);
 
@@ -2560,12 +3405,19 @@ void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 	 * SIT information should be updated before segment allocation,
 	 * since SSR needs latest valid block information.
 	 */
-	update_sit_entry(sbi, *new_blkaddr, 1);
+	update_sit_entry_striped(sbi, *new_blkaddr, 1);
 	if (GET_SEGNO(sbi, old_blkaddr) != NULL_SEGNO)
-		update_sit_entry(sbi, old_blkaddr, -1);
-
-	if (!__has_curseg_space(sbi, type))
+		update_sit_entry_striped(sbi, old_blkaddr, -1);
+
+	/* curseg_mutex keeps the log to us while sentry_lock is upgraded */
+	if (!__has_curseg_space(sbi, type)) {
+		if (!exclusive) {
+			up_read(&sit_i->sentry_lock);
+			down_write(&sit_i->sentry_lock);
+			exclusive = true;
+		}
 		sit_i->s_ops->allocate_segment(sbi, type, false);
+	}
 
 	/*
 	 * segment dirty status should be updated after segment allocation,
@@ -2575,7 +3427,10 @@ void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 	locate_dirty_segment(sbi, GET_SEGNO(sbi, old_blkaddr));
 	locate_dirty_segment(sbi, GET_SEGNO(sbi, *new_blkaddr));
 
-	up_write(&sit_i->sentry_lock);
+	if (exclusive)
+		up_write(&sit_i->sentry_lock);
+	else
+		up_read(&sit_i->sentry_lock);
 
 	if (page && IS_NODESEG(type)) {
 		fill_node_footer_blkaddr(page, NEXT_FREE_BLKADDR(sbi, curseg));
@@ -2726,8 +3581,11 @@ void __f2fs_replace_block(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 	struct seg_entry *se;
 	int type;
 	unsigned short old_blkoff;
+	bool exclusive;
 
 	segno = GET_SEGNO(sbi, new_blkaddr);
+	materialize_sit_entry(sbi, segno);
+	materialize_sit_entry(sbi, GET_SEGNO(sbi, old_blkaddr));
 	se = get_seg_entry(sbi, segno);
 	type = se->type;
 
@@ -2755,7 +3613,13 @@ void __f2fs_replace_block(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 	curseg = CURSEG_I(sbi, type);
 
 	mutex_lock(&curseg->curseg_mutex);
-	down_write(&sit_i->sentry_lock);
+
+	/* as in allocate_data_block(), only moving the log is exclusive */
+	exclusive = segno != curseg->segno;
+	if (exclusive)
+		down_write(&sit_i->sentry_lock);
+	else
+		down_read(&sit_i->sentry_lock);
 
 	old_cursegno = curseg->segno;
 	old_blkoff = curseg->next_blkoff;
@@ -2770,9 +3634,9 @@ void __f2fs_replace_block(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 	__add_sum_entry(sbi, type, sum);
 
 	if (!recover_curseg || recover_newaddr)
-		update_sit_entry(sbi, new_blkaddr, 1);
+		update_sit_entry_striped(sbi, new_blkaddr, 1);
 	if (GET_SEGNO(sbi, old_blkaddr) != NULL_SEGNO)
-		update_sit_entry(sbi, old_blkaddr, -1);
+		update_sit_entry_striped(sbi, old_blkaddr, -1);
 
 	locate_dirty_segment(sbi, GET_SEGNO(sbi, old_blkaddr));
 	locate_dirty_segment(sbi, GET_SEGNO(sbi, new_blkaddr));
@@ -2787,7 +3651,10 @@ void __f2fs_replace_block(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 		curseg->next_blkoff = old_blkoff;
 	}
 
-	up_write(&sit_i->sentry_lock);
+	if (exclusive)
+		up_write(&sit_i->sentry_lock);
+	else
+		up_read(&sit_i->sentry_lock);
 	mutex_unlock(&curseg->curseg_mutex);
 	up_write(&SM_I(sbi)->curseg_lock);
 }
@@ -3131,13 +3998,19 @@ static struct page *get_next_sit_page(struct f2fs_sb_info *sbi,
 	pgoff_t src_off, dst_off;
 
 	src_off = current_sit_addr(sbi, start);
-	dst_off = next_sit_addr(sbi, src_off);
+
+	/* a block written ahead of this checkpoint is in its next copy */
+	if (test_bit(SIT_BLOCK_OFFSET(start), sit_i->early_blocks_bitmap))
+		dst_off = src_off;
+	else
+		dst_off = next_sit_addr(sbi, src_off);
 
 	page = grab_meta_page(sbi, dst_off);
 	seg_info_to_sit_page(sbi, page, start);
 
 	set_page_dirty(page);
-	set_to_next_sit(sit_i, start);
+	if (dst_off != src_off)
+		set_to_next_sit(sit_i, start);
 
 	return page;
 }
@@ -3225,6 +4098,135 @@ static void remove_sits_in_journal(struct f2fs_sb_info *sbi)
 	up_write(&curseg->journal_rwsem);
 }
 
+static bool sit_in_journal(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	struct curseg_info *curseg = CURSEG_I(sbi, CURSEG_COLD_DATA);
+	int offset;
+
+	down_read(&curseg->journal_rwsem);
+	offset = lookup_journal_in_cursum(curseg->journal,
+						SIT_JOURNAL, segno, 0);
+	up_read(&curseg->journal_rwsem);
+	return offset >= 0;
+}
+
+/*
+ * Write the most dirtied SIT blocks to their next copy before the checkpoint,
+ * so that checkpoint only needs to flush the rest. Those blocks stay in their
+ * next copy until the checkpoint switches to it, and checkpointed valid maps
+ * of the written entries are left alone until then to keep SSR and discard
+ * away from blocks the previous checkpoint still refers to. Entries in the
+ * SIT journal stay dirty, since the journal overrides SIT blocks at mount.
+ *
+ * It runs when the device is idle, or once bg_sit_flush_dirty entries are
+ * dirty. A block already written ahead is only rewritten once half of its
+ * entries are dirty again.
+ */
+void flush_sit_entries_bg(struct f2fs_sb_info *sbi)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	struct curseg_info *curseg = CURSEG_I(sbi, CURSEG_COLD_DATA);
+	struct list_head *head = &SM_I(sbi)->sit_entry_set;
+	struct sit_entry_set *ses, *tmp;
+	unsigned int nr_blocks = SM_I(sbi)->bg_sit_flush_blocks;
+	unsigned int written = 0;
+
+	if (!nr_blocks || unlikely(f2fs_cp_error(sbi)) ||
+			unlikely(is_sbi_flag_set(sbi, SBI_POR_DOING)))
+		return;
+
+	if (!is_idle(sbi) &&
+		nr_dirty_sentries(sbi) < SM_I(sbi)->bg_sit_flush_dirty)
+		return;
+
+	/* if locked failed, cp is flushing SIT entries by itself */
+	if (!mutex_trylock(&sbi->cp_mutex))
+		return;
+
+	down_write(&sit_i->sentry_lock);
+
+	/* checkpoint can put a few entries in the journal cheaply */
+	if (__has_cursum_space(curseg->journal, nr_dirty_sentries(sbi),
+							SIT_JOURNAL)) {
+		up_write(&sit_i->sentry_lock);
+		mutex_unlock(&sbi->cp_mutex);
+		return;
+	}
+
+	add_sits_in_set(sbi);
+
+	/* sets are sorted by entry count, so take them from the tail */
+	list_for_each_entry_safe_reverse(ses, tmp, head, set_list) {
+		unsigned int start_segno = ses->start_segno;
+		unsigned int end = min(start_segno + SIT_ENTRY_PER_BLOCK,
+						(unsigned long)MAIN_SEGS(sbi));
+		unsigned int segno = start_segno;
+
+		if (test_bit(SIT_BLOCK_OFFSET(start_segno),
+					sit_i->early_blocks_bitmap) &&
+				ses->entry_cnt < SIT_ENTRY_PER_BLOCK / 2) {
+			release_sit_entry_set(ses);
+			continue;
+		}
+
+		if (nr_blocks) {
+			nr_blocks--;
+			written++;
+			f2fs_put_page(get_next_sit_page(sbi, start_segno), 1);
+			if (!__test_and_set_bit(SIT_BLOCK_OFFSET(start_segno),
+						sit_i->early_blocks_bitmap))
+				sit_i->early_blocks++;
+
+			for_each_set_bit_from(segno,
+					sit_i->dirty_sentries_bitmap, end) {
+				if (sit_in_journal(sbi, segno))
+					continue;
+				__clear_bit(segno,
+					sit_i->dirty_sentries_bitmap);
+				__set_bit(segno, sit_i->early_sentries_bitmap);
+				percpu_counter_dec(&sit_i->dirty_sentries);
+			}
+		}
+		release_sit_entry_set(ses);
+	}
+
+	up_write(&sit_i->sentry_lock);
+
+	if (written)
+		sync_meta_pages(sbi, META, LONG_MAX, FS_META_IO);
+	mutex_unlock(&sbi->cp_mutex);
+}
+
+/*
+ * Entries written by flush_sit_entries_bg() and not dirtied again since only
+ * need their checkpointed state updated.
+ */
+static void sync_early_sentries(struct f2fs_sb_info *sbi,
+						struct cp_control *cpc)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned int segno;
+
+	for_each_set_bit(segno, sit_i->early_sentries_bitmap, MAIN_SEGS(sbi)) {
+		struct seg_entry *se = get_seg_entry(sbi, segno);
+
+		if (test_bit(segno, sit_i->dirty_sentries_bitmap))
+			continue;
+
+		if (!(cpc->reason & CP_DISCARD)) {
+			cpc->trim_start = segno;
+			add_discard_addrs(sbi, cpc, false);
+		}
+		__sync_ckpt_map(sbi, se);
+
+		mutex_lock(&DIRTY_I(sbi)->seglist_lock);
+		__refresh_ssr_entry(sbi, segno);
+		mutex_unlock(&DIRTY_I(sbi)->seglist_lock);
+	}
+	memset(sit_i->early_sentries_bitmap, 0,
+				f2fs_bitmap_size(MAIN_SEGS(sbi)));
+}
+
 /*
  * CP calls this function, which flushes SIT entries including sit_journal,
  * and moves prefree segs to free segs.
@@ -3242,7 +4244,9 @@ void flush_sit_entries(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 
 	down_write(&sit_i->sentry_lock);
 
-	if (!sit_i->dirty_sentries)
+	sync_early_sentries(sbi, cpc);
+
+	if (!nr_dirty_sentries(sbi))
 		goto out;
 
 	/*
@@ -3256,7 +4260,7 @@ void flush_sit_entries(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	 * entries, remove all entries from journal and add and account
 	 * them in sit entry set.
 	 */
-	if (!__has_cursum_space(journal, sit_i->dirty_sentries, SIT_JOURNAL))
+	if (!__has_cursum_space(journal, nr_dirty_sentries(sbi), SIT_JOURNAL))
 		remove_sits_in_journal(sbi);
 
 	/*
@@ -3301,16 +4305,21 @@ void flush_sit_entries(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 				f2fs_bug_on(sbi, offset < 0);
 				segno_in_journal(journal, offset) =
 							cpu_to_le32(segno);
-				seg_info_to_raw_sit(se,
+				__seg_info_to_raw_sit(se,
 					&sit_in_journal(journal, offset));
 			} else {
 				sit_offset = SIT_ENTRY_OFFSET(sit_i, segno);
-				seg_info_to_raw_sit(se,
+				__seg_info_to_raw_sit(se,
 						&raw_sit->entries[sit_offset]);
 			}
+			__sync_ckpt_map(sbi, se);
+			/* ckpt_valid_blocks was synced to valid_blocks */
+			mutex_lock(&DIRTY_I(sbi)->seglist_lock);
+			__refresh_ssr_entry(sbi, segno);
+			mutex_unlock(&DIRTY_I(sbi)->seglist_lock);
 
 			__clear_bit(segno, bitmap);
-			sit_i->dirty_sentries--;
+			percpu_counter_dec(&sit_i->dirty_sentries);
 			ses->entry_cnt--;
 		}
 
@@ -3324,7 +4333,7 @@ void flush_sit_entries(struct f2fs_sb_info *sbi, struct cp_control *cpc)
 	}
 
 	f2fs_bug_on(sbi, !list_empty(head));
-	f2fs_bug_on(sbi, sit_i->dirty_sentries);
+	f2fs_bug_on(sbi, nr_dirty_sentries(sbi));
 out:
 	if (cpc->reason & CP_DISCARD) {
 		__u64 trim_start = cpc->trim_start;
@@ -3334,6 +4343,11 @@ out:
 
 		cpc->trim_start = trim_start;
 	}
+
+	/* this checkpoint switches to the copies written ahead */
+	memset(sit_i->early_blocks_bitmap, 0,
+			f2fs_bitmap_size(SIT_BLK_CNT(sbi)));
+	sit_i->early_blocks = 0;
 	up_write(&sit_i->sentry_lock);
 
 	set_prefree_as_free_segments(sbi);
@@ -3344,9 +4358,10 @@ static int build_sit_info(struct f2fs_sb_info *sbi)
 
 	struct f2fs_super_block *raw_super = F2FS_RAW_SUPER(sbi);
 	struct sit_info *sit_i;
-	unsigned int sit_segs, start;
-	char *src_bitmap;
+	unsigned int sit_segs, start, i;
+	char *src_bitmap, *bitmap;
 	unsigned int bitmap_size;
+	unsigned long map_size;
 
 	/* allocate memory for SIT information */
 	//1. 分配sit_info空间
@@ -3362,34 +4377,57 @@ static int build_sit_info(struct f2fs_sb_info *sbi)
 	if (!sit_i->sentries)
 		return -ENOMEM;
 
+	if (percpu_counter_init(&sit_i->dirty_sentries, 0, GFP_KERNEL) ||
+		percpu_counter_init(&sit_i->written_valid_blocks, 0, GFP_KERNEL))
+		return -ENOMEM;
+
 	bitmap_size = f2fs_bitmap_size(MAIN_SEGS(sbi));
 	sit_i->dirty_sentries_bitmap = f2fs_kvzalloc(sbi, bitmap_size,
 								GFP_KERNEL);
 	if (!sit_i->dirty_sentries_bitmap)
 		return -ENOMEM;
 
+	sit_i->early_sentries_bitmap = f2fs_kvzalloc(sbi, bitmap_size,
+								GFP_KERNEL);
+	if (!sit_i->early_sentries_bitmap)
+		return -ENOMEM;
+
+	sit_i->early_blocks_bitmap = f2fs_kvzalloc(sbi,
+			f2fs_bitmap_size(SIT_BLK_CNT(sbi)), GFP_KERNEL);
+	if (!sit_i->early_blocks_bitmap)
+		return -ENOMEM;
+
+	/*
+	 * All per-segment maps come from one arena; ckpt_valid_map only gets
+	 * its own copy while the segment differs from the last checkpoint.
+	 */
+	map_size = SIT_VBLOCK_MAP_SIZE;
+#ifdef CONFIG_F2FS_CHECK_FS
+	map_size += SIT_VBLOCK_MAP_SIZE;
+#endif
+	if (f2fs_discard_en(sbi))
+		map_size += SIT_VBLOCK_MAP_SIZE;
+
+	sit_i->bitmap = f2fs_kvzalloc(sbi, MAIN_SEGS(sbi) * map_size,
+								GFP_KERNEL);
+	if (!sit_i->bitmap)
+		return -ENOMEM;
+	atomic_set(&sit_i->nr_ckpt_maps, 0);
+
+	bitmap = sit_i->bitmap;
 	for (start = 0; start < MAIN_SEGS(sbi); start++) {
-		sit_i->sentries[start].cur_valid_map
-			= f2fs_kzalloc(sbi, SIT_VBLOCK_MAP_SIZE, GFP_KERNEL);
-		sit_i->sentries[start].ckpt_valid_map
-			= f2fs_kzalloc(sbi, SIT_VBLOCK_MAP_SIZE, GFP_KERNEL);
-		if (!sit_i->sentries[start].cur_valid_map ||
-				!sit_i->sentries[start].ckpt_valid_map)
-			return -ENOMEM;
+		sit_i->sentries[start].cur_valid_map = bitmap;
+		sit_i->sentries[start].ckpt_valid_map = bitmap;
+		bitmap += SIT_VBLOCK_MAP_SIZE;
 
 #ifdef CONFIG_F2FS_CHECK_FS
-		sit_i->sentries[start].cur_valid_map_mir
-			= f2fs_kzalloc(sbi, SIT_VBLOCK_MAP_SIZE, GFP_KERNEL);
-		if (!sit_i->sentries[start].cur_valid_map_mir)
-			return -ENOMEM;
+		sit_i->sentries[start].cur_valid_map_mir = bitmap;
+		bitmap += SIT_VBLOCK_MAP_SIZE;
 #endif
 
 		if (f2fs_discard_en(sbi)) {//discard是否能用
-			sit_i->sentries[start].discard_map
-				= f2fs_kzalloc(sbi, SIT_VBLOCK_MAP_SIZE,
-								GFP_KERNEL);
-			if (!sit_i->sentries[start].discard_map)
-				return -ENOMEM;
+			sit_i->sentries[start].discard_map = bitmap;
+			bitmap += SIT_VBLOCK_MAP_SIZE;
 		}
 	}
 
@@ -3397,6 +4435,18 @@ static int build_sit_info(struct f2fs_sb_info *sbi)
 	if (!sit_i->tmp_map)
 		return -ENOMEM;
 
+	sit_i->sbi = sbi;
+	sit_i->mount_trimmed = is_set_ckpt_flags(sbi, CP_TRIMMED_FLAG);
+	sit_i->sit_loaded = !test_opt(sbi, LAZY_SIT);
+	mutex_init(&sit_i->load_lock);
+	INIT_WORK(&sit_i->load_work, load_sit_work_fn);
+	if (!sit_i->sit_loaded) {
+		sit_i->loaded_blocks_bitmap = f2fs_kvzalloc(sbi,
+				f2fs_bitmap_size(SIT_BLK_CNT(sbi)), GFP_KERNEL);
+		if (!sit_i->loaded_blocks_bitmap)
+			return -ENOMEM;
+	}
+
 	if (sbi->segs_per_sec > 1) {
 		sit_i->sec_entries = f2fs_kvzalloc(sbi, MAIN_SECS(sbi) *
 					sizeof(struct sec_entry), GFP_KERNEL);
@@ -3431,13 +4481,13 @@ static int build_sit_info(struct f2fs_sb_info *sbi)
 
 	sit_i->sit_base_addr = le32_to_cpu(raw_super->sit_blkaddr);//0x600 = 1536
 	sit_i->sit_blocks = sit_segs << sbi->log_blocks_per_seg;//0x200 = 512
-	sit_i->written_valid_blocks = 0;
 	sit_i->bitmap_size = bitmap_size;//0x40=64
-	sit_i->dirty_sentries = 0;
 	sit_i->sents_per_block = SIT_ENTRY_PER_BLOCK;
 	sit_i->elapsed_time = le64_to_cpu(sbi->ckpt->elapsed_time);
 	sit_i->mounted_time = ktime_get_real_seconds();
 	init_rwsem(&sit_i->sentry_lock);
+	for (i = 0; i < NR_SENTRY_STRIPES; i++)
+		spin_lock_init(&sit_i->stripes[i].lock);
 //pr_notice("sit_i->sit_base_addr=0x%x, sit_i->sit_blocks=0x%x,sit_i->bitmap_size=0x%x",sit_i->sit_base_addr, sit_i->sit_blocks,sit_i->bitmap_size);
 	return 0;
 }
@@ -3445,7 +4495,7 @@ static int build_sit_info(struct f2fs_sb_info *sbi)
 static int build_free_segmap(struct f2fs_sb_info *sbi)
 {
 	struct free_segmap_info *free_i;
-	unsigned int bitmap_size, sec_bitmap_size;
+	unsigned int bitmap_size, sec_bitmap_size, sum_bitmap_size;
 
 	/* allocate memory for free segmap information */
 	free_i = f2fs_kzalloc(sbi, sizeof(struct free_segmap_info), GFP_KERNEL);
@@ -3464,9 +4514,16 @@ static int build_free_segmap(struct f2fs_sb_info *sbi)
 	if (!free_i->free_secmap)
 		return -ENOMEM;
 
+	sum_bitmap_size = f2fs_bitmap_size(BITS_TO_LONGS(MAIN_SECS(sbi)));
+	free_i->free_secmap_sum = f2fs_kvmalloc(sbi, sum_bitmap_size,
+								GFP_KERNEL);
+	if (!free_i->free_secmap_sum)
+		return -ENOMEM;
+
 	/* set all segments as dirty temporarily */
 	memset(free_i->free_segmap, 0xff, bitmap_size);
 	memset(free_i->free_secmap, 0xff, sec_bitmap_size);
+	memset(free_i->free_secmap_sum, 0xff, sum_bitmap_size);
 
 	/* init free segmap information */
 	free_i->start_segno = GET_SEGNO_FROM_SEG0(sbi, MAIN_BLKADDR(sbi));
@@ -3481,7 +4538,7 @@ static int build_curseg(struct f2fs_sb_info *sbi)
 	struct curseg_info *array;
 	int i;
 
-	array = f2fs_kzalloc(sbi, sizeof(*array) * NR_CURSEG_TYPE, GFP_KERNEL);
+	array = f2fs_kzalloc(sbi, sizeof(*array) * NO_CHECK_TYPE, GFP_KERNEL);
 	if (!array)
 		return -ENOMEM;
 
@@ -3500,30 +4557,112 @@ static int build_curseg(struct f2fs_sb_info *sbi)
 		array[i].segno = NULL_SEGNO;
 		array[i].next_blkoff = 0;
 	}
+
+	/* volatile logs need no journal, and stay closed until written */
+	for (i = CURSEG_STREAM_DATA; i < NO_CHECK_TYPE; i++) {
+		mutex_init(&array[i].curseg_mutex);
+		init_rwsem(&array[i].journal_rwsem);
+		array[i].segno = NULL_SEGNO;
+		array[i].next_segno = NULL_SEGNO;
+		if (!is_volatile_log_used(sbi, i))
+			continue;
+		array[i].sum_blk = f2fs_kzalloc(sbi, PAGE_SIZE, GFP_KERNEL);
+		if (!array[i].sum_blk)
+			return -ENOMEM;
+	}
 	//读取summary到curseg中
 	return restore_curseg_summaries(sbi);
 }
 
-static int build_sit_entries(struct f2fs_sb_info *sbi)
-{//从设备中读取sit信息放入sit_i->sentires[]中，然后重journal中读取sit信息，保证最新的sit_i->sentries[]
+/*
+ * Split main area into section aligned ranges, run @fn on each of them in
+ * parallel, and merge the counters they collected.
+ */
+static int run_sit_load_works(struct f2fs_sb_info *sbi, work_func_t fn)
+{
+	struct free_segmap_info *free_i = FREE_I(sbi);
+	struct workqueue_struct *wq = NULL;
+	struct sit_load_work *works, *sw;
+	unsigned int nr, per_work, i;
+	s64 discard_blks = 0, valid_blocks = 0;
+	int err = 0;
+
+	nr = min_t(unsigned int, num_online_cpus(), MAX_MOUNT_WORKERS);
+	nr = min_t(unsigned int, nr,
+			DIV_ROUND_UP(MAIN_SEGS(sbi), MIN_MOUNT_WORKER_SEGS));
+	nr = max_t(unsigned int, nr, 1);
+	per_work = roundup(DIV_ROUND_UP(MAIN_SEGS(sbi), nr), sbi->segs_per_sec);
+
+	works = f2fs_kzalloc(sbi, nr * sizeof(struct sit_load_work),
+								GFP_KERNEL);
+	if (!works)
+		return -ENOMEM;
+
+	/* run in the caller if there is no workqueue */
+	if (nr > 1)
+		wq = alloc_workqueue("f2fs_mount-%u:%u", WQ_UNBOUND, nr,
+					MAJOR(sbi->sb->s_bdev->bd_dev),
+					MINOR(sbi->sb->s_bdev->bd_dev));
+
+	for (i = 0; i < nr; i++) {
+		sw = &works[i];
+		sw->sbi = sbi;
+		sw->start = min(i * per_work, MAIN_SEGS(sbi));
+		sw->end = min(sw->start + per_work, MAIN_SEGS(sbi));
+		INIT_WORK(&sw->work, fn);
+		if (wq)
+			queue_work(wq, &sw->work);
+		else
+			fn(&sw->work);
+	}
+	if (wq)
+		destroy_workqueue(wq);
+
+	for (i = 0; i < nr; i++) {
+		sw = &works[i];
+		if (!err)
+			err = sw->err;
+		discard_blks += sw->discard_blks;
+		valid_blocks += sw->valid_blocks;
+		free_i->free_segments += sw->free_segs;
+		free_i->free_sections += sw->free_secs;
+	}
+	percpu_counter_add(&sbi->discard_blks, discard_blks);
+	percpu_counter_add(&SIT_I(sbi)->written_valid_blocks, valid_blocks);
+
+	sbi->mount_workers = wq ? nr : 1;
+	kfree(works);
+	return err;
+}
+
+static void load_sit_range(struct work_struct *work)
+{
+	struct sit_load_work *sw = container_of(work,
+					struct sit_load_work, work);
+	struct f2fs_sb_info *sbi = sw->sbi;
 	struct sit_info *sit_i = SIT_I(sbi);
-	struct curseg_info *curseg = CURSEG_I(sbi, CURSEG_COLD_DATA);
-	struct f2fs_journal *journal = curseg->journal;
 	struct seg_entry *se;
 	struct f2fs_sit_entry sit;
-	int sit_blk_cnt = SIT_BLK_CNT(sbi);
-	unsigned int i, start, end;
-	unsigned int readed, start_blk = 0;
-	int err = 0;
+	unsigned int start = sw->start, end, end_blk;
+	unsigned int readed, start_blk;
+
+	if (start >= sw->end)
+		return;
+
+	start_blk = SIT_BLOCK_OFFSET(start);
+	end_blk = SIT_BLOCK_OFFSET(sw->end - 1) + 1;
 	//读取sit信息到sit_i->sentries[]中缓存
 	do {
-		readed = ra_meta_pages(sbi, start_blk, BIO_MAX_PAGES,
-							META_SIT, true);
+		readed = ra_meta_pages(sbi, start_blk,
+				min_t(unsigned int, BIO_MAX_PAGES,
+					end_blk - start_blk), META_SIT, true);
+		if (!readed)
+			break;
 
-		start = start_blk * sit_i->sents_per_block;
-		end = (start_blk + readed) * sit_i->sents_per_block;
+		end = min((start_blk + readed) * sit_i->sents_per_block,
+								sw->end);
 
-		for (; start < end && start < MAIN_SEGS(sbi); start++) {
+		for (; start < end; start++) {
 			struct f2fs_sit_block *sit_blk;
 			struct page *page;
 
@@ -3533,32 +4672,77 @@ static int build_sit_entries(struct f2fs_sb_info *sbi)
 			sit = sit_blk->entries[SIT_ENTRY_OFFSET(sit_i, start)];
 			f2fs_put_page(page, 1);
 
-			err = check_block_count(sbi, start, &sit);
-			if (err)
-				return err;
-			seg_info_from_raw_sit(se, &sit);
-
-			/* build discard map only one time */
-			if (f2fs_discard_en(sbi)) {
-				if (is_set_ckpt_flags(sbi, CP_TRIMMED_FLAG)) {
-					memset(se->discard_map, 0xff,
-						SIT_VBLOCK_MAP_SIZE);
-				} else {
-					memcpy(se->discard_map,
-						se->cur_valid_map,
-						SIT_VBLOCK_MAP_SIZE);
-					sbi->discard_blks +=
-						sbi->blocks_per_seg -
-						se->valid_blocks;
-				}
-			}
+			sw->err = check_block_count(sbi, start, &sit);
+			if (sw->err)
+				return;
+			sw->discard_blks += __load_sit_entry(sbi, start, &sit);
 
+			/* ranges are section aligned, so nobody else adds */
 			if (sbi->segs_per_sec > 1)
 				get_sec_entry(sbi, start)->valid_blocks +=
 							se->valid_blocks;
 		}
 		start_blk += readed;
-	} while (start_blk < sit_blk_cnt);
+	} while (start_blk < end_blk);
+}
+
+static int __load_mount_sit_block(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	unsigned int blk = SIT_BLOCK_OFFSET(segno);
+	int err;
+
+	if (test_bit(blk, SIT_I(sbi)->loaded_blocks_bitmap))
+		return 0;
+	err = __decode_sit_block(sbi, blk);
+	if (!err)
+		__mark_sit_block_loaded(sbi, blk);
+	return err;
+}
+
+/*
+ * With lazy_sit, mount only decodes SIT blocks of current segments and of
+ * journaled entries; load_work and first use decode the rest.
+ */
+static int load_mount_sit_blocks(struct f2fs_sb_info *sbi)
+{
+	struct curseg_info *curseg = CURSEG_I(sbi, CURSEG_COLD_DATA);
+	struct f2fs_journal *journal = curseg->journal;
+	int i, err = 0;
+
+	for (i = CURSEG_HOT_DATA; i <= CURSEG_COLD_NODE; i++) {
+		err = __load_mount_sit_block(sbi, CURSEG_I(sbi, i)->segno);
+		if (err)
+			return err;
+	}
+
+	down_read(&curseg->journal_rwsem);
+	for (i = 0; i < sits_in_cursum(journal); i++) {
+		err = __load_mount_sit_block(sbi,
+				le32_to_cpu(segno_in_journal(journal, i)));
+		if (err)
+			break;
+	}
+	up_read(&curseg->journal_rwsem);
+	return err;
+}
+
+static int build_sit_entries(struct f2fs_sb_info *sbi)
+{//从设备中读取sit信息放入sit_i->sentires[]中，然后重journal中读取sit信息，保证最新的sit_i->sentries[]
+	struct sit_info *sit_i = SIT_I(sbi);
+	struct curseg_info *curseg = CURSEG_I(sbi, CURSEG_COLD_DATA);
+	struct f2fs_journal *journal = curseg->journal;
+	struct seg_entry *se;
+	struct f2fs_sit_entry sit;
+	unsigned int i, start;
+	int err;
+
+	if (test_opt(sbi, LAZY_SIT))
+		err = load_mount_sit_blocks(sbi);
+	else
+		err = run_sit_load_works(sbi, load_sit_range);
+	if (err)
+		return err;
 
 	down_read(&curseg->journal_rwsem);
 	//扫描日志，从中恢复更新版本的sit信息到&sit_i->sentries[]中
@@ -3583,8 +4767,9 @@ static int build_sit_entries(struct f2fs_sb_info *sbi)
 			} else {
 				memcpy(se->discard_map, se->cur_valid_map,
 							SIT_VBLOCK_MAP_SIZE);
-				sbi->discard_blks += old_valid_blocks -
-							se->valid_blocks;
+				percpu_counter_add(&sbi->discard_blks,
+					(s64)old_valid_blocks -
+					se->valid_blocks);
 			}
 		}
 
@@ -3596,38 +4781,70 @@ static int build_sit_entries(struct f2fs_sb_info *sbi)
 	return err;
 }
 
-static void init_free_segmap(struct f2fs_sb_info *sbi)
-{//根据seg_entry内容设置free_i->free_segments
-	unsigned int start;
-	int type;
+static void init_free_range(struct work_struct *work)
+{
+	struct sit_load_work *sw = container_of(work,
+					struct sit_load_work, work);
+	struct f2fs_sb_info *sbi = sw->sbi;
+	struct free_segmap_info *free_i = FREE_I(sbi);
+	unsigned int segno, start_segno;
 
-	for (start = 0; start < MAIN_SEGS(sbi); start++) {
-		struct seg_entry *sentry = get_seg_entry(sbi, start);
-		if (!sentry->valid_blocks)
-			__set_free(sbi, start);
-		else
-			SIT_I(sbi)->written_valid_blocks +=
-						sentry->valid_blocks;
+	for (segno = sw->start; segno < sw->end; segno++) {
+		struct seg_entry *sentry = get_seg_entry(sbi, segno);
+
+		/* undecoded segments stay in use until lazy_sit gets there */
+		if (!sit_block_loaded(sbi, segno))
+			continue;
+
+		if (!sentry->valid_blocks) {
+			clear_bit(segno, free_i->free_segmap);
+			sw->free_segs++;
+		} else {
+			sw->valid_blocks += sentry->valid_blocks;
+		}
+
+		/* check the section once its last segment is done */
+		if ((segno + 1) % sbi->segs_per_sec)
+			continue;
+		start_segno = segno + 1 - sbi->segs_per_sec;
+		if (find_next_bit(free_i->free_segmap, segno + 1,
+						start_segno) > segno) {
+			__set_sec_free(free_i, GET_SEC_FROM_SEG(sbi, segno));
+			sw->free_secs++;
+		}
 	}
+}
+
+static int init_free_segmap(struct f2fs_sb_info *sbi)
+{//根据seg_entry内容设置free_i->free_segments
+	int type, err;
+
+	err = run_sit_load_works(sbi, init_free_range);
+	if (err)
+		return err;
 
 	/* set use the current segments */
 	for (type = CURSEG_HOT_DATA; type <= CURSEG_COLD_NODE; type++) {
 		struct curseg_info *curseg_t = CURSEG_I(sbi, type);
 		__set_test_and_inuse(sbi, curseg_t->segno);
 	}
+	return 0;
 }
 
-static void init_dirty_segmap(struct f2fs_sb_info *sbi)
+static void init_dirty_range(struct work_struct *work)
 {//根据free segmap 和 sit信息，初始化dirty segment信息，即不是所有block都valid的segment
+	struct sit_load_work *sw = container_of(work,
+					struct sit_load_work, work);
+	struct f2fs_sb_info *sbi = sw->sbi;
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
 	struct free_segmap_info *free_i = FREE_I(sbi);
-	unsigned int segno = 0, offset = 0;
+	unsigned int segno, offset = sw->start;
 	unsigned short valid_blocks;
 
 	while (1) {
-		/* find dirty segment based on free segmap */
-		segno = find_next_inuse(free_i, MAIN_SEGS(sbi), offset);
-		if (segno >= MAIN_SEGS(sbi))
+		/* free segmap is stable while mounting, no need to lock */
+		segno = find_next_bit(free_i->free_segmap, sw->end, offset);
+		if (segno >= sw->end)
 			break;
 		offset = segno + 1;
 		valid_blocks = get_valid_blocks(sbi, segno, false);
@@ -3651,6 +4868,79 @@ static int init_victim_secmap(struct f2fs_sb_info *sbi)
 	dirty_i->victim_secmap = f2fs_kvzalloc(sbi, bitmap_size, GFP_KERNEL);
 	if (!dirty_i->victim_secmap)
 		return -ENOMEM;
+
+	dirty_i->cur_victim_secmap = f2fs_kvzalloc(sbi, bitmap_size,
+								GFP_KERNEL);
+	if (!dirty_i->cur_victim_secmap)
+		return -ENOMEM;
+	return 0;
+}
+
+static int init_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct victim_index *vi = &DIRTY_I(sbi)->vindex;
+	unsigned int i;
+
+	vi->nr_buckets = BLKS_PER_SEC(sbi) + 1;
+	vi->buckets = f2fs_kvzalloc(sbi, vi->nr_buckets *
+				sizeof(struct list_head), GFP_KERNEL);
+	if (!vi->buckets)
+		return -ENOMEM;
+
+	vi->bucket_map = f2fs_kvzalloc(sbi,
+			f2fs_bitmap_size(vi->nr_buckets), GFP_KERNEL);
+	if (!vi->bucket_map)
+		return -ENOMEM;
+
+	vi->entries = f2fs_kvzalloc(sbi, MAIN_SECS(sbi) *
+				sizeof(struct victim_entry), GFP_KERNEL);
+	if (!vi->entries)
+		return -ENOMEM;
+
+	for (i = 0; i < vi->nr_buckets; i++)
+		INIT_LIST_HEAD(&vi->buckets[i]);
+	for (i = 0; i < MAIN_SECS(sbi); i++)
+		INIT_LIST_HEAD(&vi->entries[i].list);
+	vi->nr_entries = 0;
+	return 0;
+}
+
+static int init_ssr_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int i, t;
+
+	for (t = 0; t < DIRTY; t++) {
+		struct victim_index *vi = &dirty_i->ssr_index[t];
+
+		vi->nr_buckets = sbi->blocks_per_seg + 1;
+		vi->buckets = f2fs_kvzalloc(sbi, vi->nr_buckets *
+					sizeof(struct list_head), GFP_KERNEL);
+		if (!vi->buckets)
+			return -ENOMEM;
+
+		vi->bucket_map = f2fs_kvzalloc(sbi,
+				f2fs_bitmap_size(vi->nr_buckets), GFP_KERNEL);
+		if (!vi->bucket_map)
+			return -ENOMEM;
+
+		for (i = 0; i < vi->nr_buckets; i++)
+			INIT_LIST_HEAD(&vi->buckets[i]);
+		vi->nr_entries = 0;
+	}
+
+	dirty_i->ssr_entries = f2fs_kvzalloc(sbi, MAIN_SEGS(sbi) *
+				sizeof(struct victim_entry), GFP_KERNEL);
+	if (!dirty_i->ssr_entries)
+		return -ENOMEM;
+
+	for (i = 0; i < MAIN_SEGS(sbi); i++)
+		INIT_LIST_HEAD(&dirty_i->ssr_entries[i].list);
+
+	dirty_i->stale_segmap = f2fs_kvzalloc(sbi,
+			f2fs_bitmap_size(MAIN_SEGS(sbi)), GFP_KERNEL);
+	if (!dirty_i->stale_segmap)
+		return -ENOMEM;
 	return 0;
 }
 
@@ -3658,6 +4948,7 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 {//创建dirty_seglist_info，根据free_segmap和sit信息填充，每种dirty类型都有一个dirty_segmap
 	struct dirty_seglist_info *dirty_i;
 	unsigned int bitmap_size, i;
+	int err;
 
 	/* allocate memory for dirty segments list information */
 	dirty_i = f2fs_kzalloc(sbi, sizeof(struct dirty_seglist_info),
@@ -3677,7 +4968,17 @@ static int build_dirty_segmap(struct f2fs_sb_info *sbi)
 			return -ENOMEM;
 	}
 
-	init_dirty_segmap(sbi);
+	err = init_victim_index(sbi);
+	if (err)
+		return err;
+
+	err = init_ssr_index(sbi);
+	if (err)
+		return err;
+
+	err = run_sit_load_works(sbi, init_dirty_range);
+	if (err)
+		return err;
 	return init_victim_secmap(sbi);
 }
 
@@ -3697,6 +4998,9 @@ static void init_min_max_mtime(struct f2fs_sb_info *sbi)
 		unsigned int i;
 		unsigned long long mtime = 0;
 
+		if (!sit_block_loaded(sbi, segno))
+			continue;
+
 		for (i = 0; i < sbi->segs_per_sec; i++)
 			mtime += get_seg_entry(sbi, segno + i)->mtime;
 		//计算出这个sec的平均mtime
@@ -3714,6 +5018,7 @@ int build_segment_manager(struct f2fs_sb_info *sbi)
 	struct f2fs_super_block *raw_super = F2FS_RAW_SUPER(sbi);
 	struct f2fs_checkpoint *ckpt = F2FS_CKPT(sbi);
 	struct f2fs_sm_info *sm_info;
+	ktime_t start_time;
 	int err;
 
 	sm_info = f2fs_kzalloc(sbi, sizeof(struct f2fs_sm_info), GFP_KERNEL);
@@ -3739,6 +5044,8 @@ int build_segment_manager(struct f2fs_sb_info *sbi)
 	sm_info->min_ipu_util = DEF_MIN_IPU_UTIL;
 	sm_info->min_fsync_blocks = DEF_MIN_FSYNC_BLOCKS;
 	sm_info->min_hot_blocks = DEF_MIN_HOT_BLOCKS;
+	sm_info->bg_sit_flush_blocks = DEF_BG_SIT_FLUSH_BLOCKS;
+	sm_info->bg_sit_flush_dirty = DEF_BG_SIT_FLUSH_DIRTY;
 	sm_info->min_ssr_sections = reserved_sections(sbi);//0x87 = 135
 
 	sm_info->trim_sections = DEF_BATCHED_TRIM_SECTIONS;
@@ -3776,17 +5083,40 @@ int build_segment_manager(struct f2fs_sb_info *sbi)
 
 	/* reinit free segmap based on SIT */
 	//读取SIT信息和journal中的sit信息，放入sm_info->sit_i->sentries[]中
+	start_time = ktime_get();
 	err = build_sit_entries(sbi);
 	if (err)
 		return err;
+	sbi->mount_time_us[MOUNT_SIT_ENTRIES] =
+			ktime_us_delta(ktime_get(), start_time);
+
 	//根据SIT信息，设置free_segment_map中的信息
-	init_free_segmap(sbi);
+	start_time = ktime_get();
+	err = init_free_segmap(sbi);
+	if (err)
+		return err;
+	sbi->mount_time_us[MOUNT_FREE_SEGMAP] =
+			ktime_us_delta(ktime_get(), start_time);
+
 	//根据free_segmap和SIT信息初始化dirty_seglist_info
+	start_time = ktime_get();
 	err = build_dirty_segmap(sbi);
 	if (err)
 		return err;
+	sbi->mount_time_us[MOUNT_DIRTY_SEGMAP] =
+			ktime_us_delta(ktime_get(), start_time);
 
 	init_min_max_mtime(sbi);
+
+	if (!SIT_I(sbi)->sit_loaded) {
+		struct free_segmap_info *free_i = FREE_I(sbi);
+		unsigned int ckpt_free = le32_to_cpu(ckpt->free_segment_count);
+
+		if (ckpt_free > free_i->free_segments)
+			free_i->pending_segments = ckpt_free -
+						free_i->free_segments;
+		queue_work(system_unbound_wq, &SIT_I(sbi)->load_work);
+	}
 	return 0;
 }
 
@@ -3804,9 +5134,32 @@ static void discard_dirty_segmap(struct f2fs_sb_info *sbi,
 static void destroy_victim_secmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	kvfree(dirty_i->cur_victim_secmap);
 	kvfree(dirty_i->victim_secmap);
 }
 
+static void destroy_victim_index(struct f2fs_sb_info *sbi)
+{
+	struct victim_index *vi = &DIRTY_I(sbi)->vindex;
+
+	kvfree(vi->entries);
+	kvfree(vi->bucket_map);
+	kvfree(vi->buckets);
+}
+
+static void destroy_ssr_index(struct f2fs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	int t;
+
+	for (t = 0; t < DIRTY; t++) {
+		kvfree(dirty_i->ssr_index[t].bucket_map);
+		kvfree(dirty_i->ssr_index[t].buckets);
+	}
+	kvfree(dirty_i->ssr_entries);
+	kvfree(dirty_i->stale_segmap);
+}
+
 static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 {
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
@@ -3820,6 +5173,8 @@ static void destroy_dirty_segmap(struct f2fs_sb_info *sbi)
 		discard_dirty_segmap(sbi, i);
 
 	destroy_victim_secmap(sbi);
+	destroy_victim_index(sbi);
+	destroy_ssr_index(sbi);
 	SM_I(sbi)->dirty_info = NULL;
 	kfree(dirty_i);
 }
@@ -3832,7 +5187,7 @@ static void destroy_curseg(struct f2fs_sb_info *sbi)
 	if (!array)
 		return;
 	SM_I(sbi)->curseg_array = NULL;
-	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+	for (i = 0; i < NO_CHECK_TYPE; i++) {
 		kfree(array[i].sum_blk);
 		kfree(array[i].journal);
 	}
@@ -3847,6 +5202,7 @@ static void destroy_free_segmap(struct f2fs_sb_info *sbi)
 	SM_I(sbi)->free_info = NULL;
 	kvfree(free_i->free_segmap);
 	kvfree(free_i->free_secmap);
+	kvfree(free_i->free_secmap_sum);
 	kfree(free_i);
 }
 
@@ -3858,21 +5214,26 @@ static void destroy_sit_info(struct f2fs_sb_info *sbi)
 	if (!sit_i)
 		return;
 
-	if (sit_i->sentries) {
+	if (sit_i->sentries && sit_i->bitmap) {
 		for (start = 0; start < MAIN_SEGS(sbi); start++) {
-			kfree(sit_i->sentries[start].cur_valid_map);
-#ifdef CONFIG_F2FS_CHECK_FS
-			kfree(sit_i->sentries[start].cur_valid_map_mir);
-#endif
-			kfree(sit_i->sentries[start].ckpt_valid_map);
-			kfree(sit_i->sentries[start].discard_map);
+			struct seg_entry *se = &sit_i->sentries[start];
+
+			if (se->ckpt_valid_map != se->cur_valid_map)
+				kmem_cache_free(ckpt_map_slab,
+						se->ckpt_valid_map);
 		}
 	}
+	kvfree(sit_i->bitmap);
 	kfree(sit_i->tmp_map);
 
 	kvfree(sit_i->sentries);
 	kvfree(sit_i->sec_entries);
 	kvfree(sit_i->dirty_sentries_bitmap);
+	kvfree(sit_i->early_sentries_bitmap);
+	percpu_counter_destroy(&sit_i->dirty_sentries);
+	percpu_counter_destroy(&sit_i->written_valid_blocks);
+	kvfree(sit_i->early_blocks_bitmap);
+	kvfree(sit_i->loaded_blocks_bitmap);
 
 	SM_I(sbi)->sit_info = NULL;
 	kfree(sit_i->sit_bitmap);
@@ -3888,6 +5249,13 @@ void destroy_segment_manager(struct f2fs_sb_info *sbi)
 
 	if (!sm_info)
 		return;
+
+	/* load_work uses everything torn down below */
+	if (SIT_I(sbi) && SIT_I(sbi)->loaded_blocks_bitmap) {
+		WRITE_ONCE(SIT_I(sbi)->load_stop, true);
+		cancel_work_sync(&SIT_I(sbi)->load_work);
+	}
+
 	destroy_flush_cmd_control(sbi, true);
 	destroy_discard_cmd_control(sbi);
 	destroy_dirty_segmap(sbi);
@@ -3919,8 +5287,15 @@ int __init create_segment_manager_caches(void)
 			sizeof(struct inmem_pages));
 	if (!inmem_entry_slab)
 		goto destroy_sit_entry_set;
+
+	ckpt_map_slab = f2fs_kmem_cache_create("sit_ckpt_map",
+			SIT_VBLOCK_MAP_SIZE);
+	if (!ckpt_map_slab)
+		goto destroy_inmem_entry;
 	return 0;
 
+destroy_inmem_entry:
+	kmem_cache_destroy(inmem_entry_slab);
 destroy_sit_entry_set:
 	kmem_cache_destroy(sit_entry_set_slab);
 destroy_discard_cmd:
@@ -3937,4 +5312,5 @@ void destroy_segment_manager_caches(void)
 	kmem_cache_destroy(discard_cmd_slab);
 	kmem_cache_destroy(discard_entry_slab);
 	kmem_cache_destroy(inmem_entry_slab);
+	kmem_cache_destroy(ckpt_map_slab);
 }
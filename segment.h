@@ -24,8 +24,9 @@
 #define GET_L2R_SEGNO(free_i, segno)	((segno) - (free_i)->start_segno)
 #define GET_R2L_SEGNO(free_i, segno)	((segno) + (free_i)->start_segno)
 
-#define IS_DATASEG(t)	((t) <= CURSEG_COLD_DATA)
-#define IS_NODESEG(t)	((t) >= CURSEG_HOT_NODE)
+#define IS_VOLATILE_LOG(t)	((t) >= CURSEG_STREAM_DATA && (t) < NO_CHECK_TYPE)
+#define IS_DATASEG(t)	((t) <= CURSEG_COLD_DATA || IS_VOLATILE_LOG(t))
+#define IS_NODESEG(t)	((t) >= CURSEG_HOT_NODE && (t) <= CURSEG_COLD_NODE)
 
 #define IS_HOT(t)	((t) == CURSEG_HOT_NODE || (t) == CURSEG_HOT_DATA)
 #define IS_WARM(t)	((t) == CURSEG_WARM_NODE || (t) == CURSEG_WARM_DATA)
@@ -37,7 +38,8 @@
 	 ((seg) == CURSEG_I(sbi, CURSEG_COLD_DATA)->segno) ||	\
 	 ((seg) == CURSEG_I(sbi, CURSEG_HOT_NODE)->segno) ||	\
 	 ((seg) == CURSEG_I(sbi, CURSEG_WARM_NODE)->segno) ||	\
-	 ((seg) == CURSEG_I(sbi, CURSEG_COLD_NODE)->segno))
+	 ((seg) == CURSEG_I(sbi, CURSEG_COLD_NODE)->segno) ||	\
+	 is_volatile_curseg(sbi, seg))
 
 #define IS_CURSEC(sbi, secno)						\
 	(((secno) == CURSEG_I(sbi, CURSEG_HOT_DATA)->segno /		\
@@ -51,7 +53,8 @@
 	 ((secno) == CURSEG_I(sbi, CURSEG_WARM_NODE)->segno /		\
 	  (sbi)->segs_per_sec) ||	\
 	 ((secno) == CURSEG_I(sbi, CURSEG_COLD_NODE)->segno /		\
-	  (sbi)->segs_per_sec))	\
+	  (sbi)->segs_per_sec) ||	\
+	 is_volatile_cursec(sbi, secno))
 
 #define MAIN_BLKADDR(sbi)	(SM_I(sbi)->main_blkaddr)
 #define SEG0_BLKADDR(sbi)	(SM_I(sbi)->seg0_blkaddr)
@@ -143,13 +146,16 @@ enum {
 };
 
 /*
- * In the victim_sel_policy->gc_mode, there are two gc, aka cleaning, modes.
+ * In the victim_sel_policy->gc_mode, there are three gc, aka cleaning, modes.
  * GC_CB is based on cost-benefit algorithm.
  * GC_GREEDY is based on greedy algorithm.
+ * GC_AT weighs valid blocks by the age bucket of sections older than
+ * gc_age_threshold.
  */
 enum {
 	GC_CB = 0,
 	GC_GREEDY,
+	GC_AT,
 	ALLOC_NEXT,
 	FLUSH_DEVICE,
 	MAX_GC_POLICY,
@@ -169,7 +175,7 @@ enum {
 /* for a function parameter to select a victim segment */
 struct victim_sel_policy {
 	int alloc_mode;			/* LFS or SSR */
-	int gc_mode;			/* GC_CB or GC_GREEDY */
+	int gc_mode;			/* GC_CB, GC_GREEDY or GC_AT */
 	unsigned long *dirty_segmap;	/* dirty segment bitmap */
 	unsigned int max_search;	/* maximum # of segments to search */
 	unsigned int offset;		/* last scanned bitmap offset */
@@ -190,6 +196,8 @@ struct seg_entry {
 	/*
 	 * # of valid blocks and the validity bitmap stored in the the last
 	 * checkpoint pack. This information is used by the SSR mode.
+	 * ckpt_valid_map aliases cur_valid_map until the segment is changed
+	 * after a checkpoint, then it gets a private copy.
 	 */
 	unsigned char *ckpt_valid_map;	/* validity bitmap of blocks last cp */
 	unsigned char *discard_map;
@@ -222,12 +230,25 @@ struct inmem_pages {
 	block_t old_addr;		/* for revoking when fail to commit */
 };
 
+/*
+ * Block invalidation, appends to LFS logs, and overwrites that keep their
+ * current segment update SIT entries under sentry_lock for read and the
+ * lock of the stripe covering the section, so that updates in other stripes
+ * run in parallel. Moving a log, SSR and checkpoint hold sentry_lock for
+ * write.
+ */
+#define NR_SENTRY_STRIPES	64
+
+struct sentry_stripe {
+	spinlock_t lock;
+} ____cacheline_aligned_in_smp;
+
 struct sit_info {
 	const struct segment_allocation *s_ops;
 
 	block_t sit_base_addr;		/* start block address of SIT area */
 	block_t sit_blocks;		/* # of blocks used by SIT area */
-	block_t written_valid_blocks;	/* # of valid blocks in main area */
+	struct percpu_counter written_valid_blocks; /* # of valid blocks */
 	char *sit_bitmap;		/* SIT bitmap pointer */
 #ifdef CONFIG_F2FS_CHECK_FS
 	char *sit_bitmap_mir;		/* SIT bitmap mirror */
@@ -236,10 +257,16 @@ struct sit_info {
 
 	unsigned long *tmp_map;			/* bitmap for temporal use */
 	unsigned long *dirty_sentries_bitmap;	/* bitmap for dirty sentries */
-	unsigned int dirty_sentries;		/* # of dirty sentries */
+	struct percpu_counter dirty_sentries;	/* # of dirty sentries */
 	unsigned int sents_per_block;		/* # of SIT entries per block */
+	unsigned long *early_blocks_bitmap;	/* SIT blocks moved before CP */
+	unsigned int early_blocks;		/* # of SIT blocks moved */
+	unsigned long *early_sentries_bitmap;	/* entries written before CP */
 	struct rw_semaphore sentry_lock;	/* to protect SIT cache */
+	struct sentry_stripe stripes[NR_SENTRY_STRIPES];
 	struct seg_entry *sentries;		/* SIT segment-level cache */
+	char *bitmap;				/* arena of per-segment maps */
+	atomic_t nr_ckpt_maps;			/* # of private ckpt maps */
 	struct sec_entry *sec_entries;		/* SIT section-level cache */
 
 	/* for cost-benefit algorithm in cleaning procedure */
@@ -249,15 +276,46 @@ struct sit_info {
 	unsigned long long max_mtime;		/* max. modification time */
 
 	unsigned int last_victim[MAX_GC_POLICY]; /* last victim segment # */
+
+	/* lazy_sit: SIT blocks are decoded on first use or by load_work */
+	bool sit_loaded;			/* all SIT blocks decoded */
+	bool mount_trimmed;			/* CP_TRIMMED_FLAG at mount */
+	bool load_stop;				/* umount stops load_work */
+	unsigned long *loaded_blocks_bitmap;	/* SIT blocks decoded */
+	unsigned int nr_loaded_blocks;		/* # of SIT blocks decoded */
+	struct mutex load_lock;			/* serializes decoding */
+	struct work_struct load_work;		/* decodes the rest */
+	struct f2fs_sb_info *sbi;		/* owner, for load_work */
 };
 
 struct free_segmap_info {
 	unsigned int start_segno;	/* start segment number logically */
 	unsigned int free_segments;	/* # of free segments */
 	unsigned int free_sections;	/* # of free sections */
+	unsigned int pending_segments;	/* free ones in undecoded SIT */
 	spinlock_t segmap_lock;		/* free segmap lock */
 	unsigned long *free_segmap;	/* free segment bitmap */
 	unsigned long *free_secmap;	/* free section bitmap */
+	unsigned long *free_secmap_sum;	/* set bit: full free_secmap word */
+};
+
+/*
+ * SIT cache is built at mount by up to MAX_MOUNT_WORKERS works, each one
+ * owning a section aligned range of at least MIN_MOUNT_WORKER_SEGS segments.
+ */
+#define MAX_MOUNT_WORKERS	8
+#define MIN_MOUNT_WORKER_SEGS	4096
+
+struct sit_load_work {
+	struct work_struct work;
+	struct f2fs_sb_info *sbi;
+	unsigned int start;		/* first segment of the range */
+	unsigned int end;		/* last segment of the range + 1 */
+	int err;
+	s64 discard_blks;		/* # of discard candidates found */
+	s64 valid_blocks;		/* # of valid blocks found */
+	unsigned int free_segs;		/* # of free segments found */
+	unsigned int free_secs;		/* # of free sections found */
 };
 
 /* Notice: The order of dirty type is same with CURSEG_XXX in f2fs.h */
@@ -273,12 +331,40 @@ enum dirty_type {
 	NR_DIRTY_TYPE
 };
 
+/*
+ * victim index: dirty sections bucketed by their valid block count, so that
+ * LFS victim selection does not need to walk the whole dirty segmap.
+ * It is updated under seglist_lock. Invalidations that leave the dirty
+ * segmaps alone only mark the segment in stale_segmap, and its entries are
+ * refreshed before the next victim selection.
+ *
+ * The SSR index uses the same structure per dirty log type, but buckets
+ * segments by ckpt_valid_blocks, which is the SSR cost.
+ */
+struct victim_entry {
+	struct list_head list;			/* linked in a bucket list */
+	unsigned int vblocks;			/* bucket this entry is in */
+};
+
+struct victim_index {
+	struct list_head *buckets;		/* one list per valid count */
+	unsigned long *bucket_map;		/* non-empty buckets */
+	struct victim_entry *entries;		/* per-section entries */
+	unsigned int nr_buckets;		/* BLKS_PER_SEC + 1 */
+	unsigned int nr_entries;		/* # of indexed sections */
+};
+
 struct dirty_seglist_info {
 	const struct victim_selection *v_ops;	/* victim selction operation */
 	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
 	struct mutex seglist_lock;		/* lock for segment bitmaps */
 	int nr_dirty[NR_DIRTY_TYPE];		/* # of dirty segments */
 	unsigned long *victim_secmap;		/* background GC victims */
+	unsigned long *cur_victim_secmap;	/* in-flight FG GC victims */
+	struct victim_index vindex;		/* dirty sections by cost */
+	struct victim_index ssr_index[DIRTY];	/* dirty segments per log type */
+	struct victim_entry *ssr_entries;	/* per-segment SSR entries */
+	unsigned long *stale_segmap;		/* index entries to refresh */
 };
 
 /* victim selection function for cleaning and SSR */
@@ -314,6 +400,55 @@ static inline struct curseg_info *CURSEG_I(struct f2fs_sb_info *sbi, int type)
 	return (struct curseg_info *)(SM_I(sbi)->curseg_array + type);
 }
 
+/* volatile logs which are not configured or closed have no segment */
+static inline bool is_volatile_curseg(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	int i;
+
+	if (segno == NULL_SEGNO)
+		return false;
+	for (i = CURSEG_STREAM_DATA; i < NO_CHECK_TYPE; i++)
+		if (CURSEG_I(sbi, i)->segno == segno)
+			return true;
+	return false;
+}
+
+static inline bool is_volatile_cursec(struct f2fs_sb_info *sbi,
+						unsigned int secno)
+{
+	unsigned int segno;
+	int i;
+
+	for (i = CURSEG_STREAM_DATA; i < NO_CHECK_TYPE; i++) {
+		segno = CURSEG_I(sbi, i)->segno;
+		if (segno != NULL_SEGNO && secno == segno / sbi->segs_per_sec)
+			return true;
+	}
+	return false;
+}
+
+static inline bool is_volatile_log_used(struct f2fs_sb_info *sbi, int type)
+{
+	if (type < CURSEG_SHARD_DATA)
+		return type - CURSEG_STREAM_DATA < sbi->nr_stream_logs;
+	return type - CURSEG_SHARD_DATA < sbi->nr_alloc_shards;
+}
+
+/* index of the write bio of a volatile log, after the NR_TEMP_TYPE ones */
+static inline int volatile_log_temp(struct f2fs_sb_info *sbi, int type)
+{
+	if (type < CURSEG_SHARD_DATA)
+		return NR_TEMP_TYPE + type - CURSEG_STREAM_DATA;
+	return NR_TEMP_TYPE + sbi->nr_stream_logs + type - CURSEG_SHARD_DATA;
+}
+
+/* segments of volatile logs are recorded as warm data in SIT */
+static inline int curseg_sit_type(int type)
+{
+	return IS_VOLATILE_LOG(type) ? CURSEG_WARM_DATA : type;
+}
+
 static inline struct seg_entry *get_seg_entry(struct f2fs_sb_info *sbi,
 						unsigned int segno)
 {
@@ -347,7 +482,6 @@ static inline void seg_info_from_raw_sit(struct seg_entry *se,
 	se->valid_blocks = GET_SIT_VBLOCKS(rs);
 	se->ckpt_valid_blocks = GET_SIT_VBLOCKS(rs);
 	memcpy(se->cur_valid_map, rs->valid_map, SIT_VBLOCK_MAP_SIZE);
-	memcpy(se->ckpt_valid_map, rs->valid_map, SIT_VBLOCK_MAP_SIZE);
 #ifdef CONFIG_F2FS_CHECK_FS
 	memcpy(se->cur_valid_map_mir, rs->valid_map, SIT_VBLOCK_MAP_SIZE);
 #endif
@@ -383,15 +517,6 @@ static inline void seg_info_to_sit_page(struct f2fs_sb_info *sbi,
 	}
 }
 
-static inline void seg_info_to_raw_sit(struct seg_entry *se,
-					struct f2fs_sit_entry *rs)
-{
-	__seg_info_to_raw_sit(se, rs);
-
-	memcpy(se->ckpt_valid_map, rs->valid_map, SIT_VBLOCK_MAP_SIZE);
-	se->ckpt_valid_blocks = se->valid_blocks;
-}
-
 static inline unsigned int find_next_inuse(struct free_segmap_info *free_i,
 		unsigned int max, unsigned int segno)
 {
@@ -402,6 +527,25 @@ static inline unsigned int find_next_inuse(struct free_segmap_info *free_i,
 	return ret;
 }
 
+/*
+ * free_secmap_sum has a bit per word of free_secmap, set when the word has
+ * no free section left, so that searches can skip it without reading it.
+ */
+static inline void __set_sec_inuse(struct free_segmap_info *free_i,
+						unsigned int secno)
+{
+	set_bit(secno, free_i->free_secmap);
+	if (free_i->free_secmap[BIT_WORD(secno)] == ~0UL)
+		set_bit(BIT_WORD(secno), free_i->free_secmap_sum);
+}
+
+static inline void __set_sec_free(struct free_segmap_info *free_i,
+						unsigned int secno)
+{
+	clear_bit(secno, free_i->free_secmap);
+	clear_bit(BIT_WORD(secno), free_i->free_secmap_sum);
+}
+
 static inline void __set_free(struct f2fs_sb_info *sbi, unsigned int segno)
 {//将一个segments和section设置为free
 	struct free_segmap_info *free_i = FREE_I(sbi);
@@ -416,7 +560,7 @@ static inline void __set_free(struct f2fs_sb_info *sbi, unsigned int segno)
 	next = find_next_bit(free_i->free_segmap,
 			start_segno + sbi->segs_per_sec, start_segno);
 	if (next >= start_segno + sbi->segs_per_sec) {
-		clear_bit(secno, free_i->free_secmap);
+		__set_sec_free(free_i, secno);
 		free_i->free_sections++;
 	}
 	spin_unlock(&free_i->segmap_lock);
@@ -430,8 +574,10 @@ static inline void __set_inuse(struct f2fs_sb_info *sbi,
 
 	set_bit(segno, free_i->free_segmap);
 	free_i->free_segments--;
-	if (!test_and_set_bit(secno, free_i->free_secmap))
+	if (!test_bit(secno, free_i->free_secmap)) {
+		__set_sec_inuse(free_i, secno);
 		free_i->free_sections--;
+	}
 }
 
 static inline void __set_test_and_free(struct f2fs_sb_info *sbi,
@@ -448,9 +594,10 @@ static inline void __set_test_and_free(struct f2fs_sb_info *sbi,
 
 		next = find_next_bit(free_i->free_segmap,
 				start_segno + sbi->segs_per_sec, start_segno);
-		if (next >= start_segno + sbi->segs_per_sec) {
-			if (test_and_clear_bit(secno, free_i->free_secmap))
-				free_i->free_sections++;
+		if (next >= start_segno + sbi->segs_per_sec &&
+				test_bit(secno, free_i->free_secmap)) {
+			__set_sec_free(free_i, secno);
+			free_i->free_sections++;
 		}
 	}
 	spin_unlock(&free_i->segmap_lock);
@@ -465,8 +612,10 @@ static inline void __set_test_and_inuse(struct f2fs_sb_info *sbi,
 	spin_lock(&free_i->segmap_lock);
 	if (!test_and_set_bit(segno, free_i->free_segmap)) {
 		free_i->free_segments--;
-		if (!test_and_set_bit(secno, free_i->free_secmap))
+		if (!test_bit(secno, free_i->free_secmap)) {
+			__set_sec_inuse(free_i, secno);
 			free_i->free_sections--;
+		}
 	}
 	spin_unlock(&free_i->segmap_lock);
 }
@@ -486,12 +635,44 @@ static inline void get_sit_bitmap(struct f2fs_sb_info *sbi,
 
 static inline block_t written_block_count(struct f2fs_sb_info *sbi)
 {
-	return SIT_I(sbi)->written_valid_blocks;
+	return percpu_counter_sum_positive(&SIT_I(sbi)->written_valid_blocks);
+}
+
+static inline unsigned int nr_dirty_sentries(struct f2fs_sb_info *sbi)
+{
+	return percpu_counter_sum_positive(&SIT_I(sbi)->dirty_sentries);
+}
+
+static inline spinlock_t *sentry_stripe_lock(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
+
+	return &SIT_I(sbi)->stripes[secno % NR_SENTRY_STRIPES].lock;
+}
+
+static inline bool sit_block_loaded(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+
+	return sit_i->sit_loaded ||
+		test_bit(SIT_BLOCK_OFFSET(segno), sit_i->loaded_blocks_bitmap);
+}
+
+/* decode the SIT block of @segno if lazy_sit has not got to it yet */
+static inline void materialize_sit_entry(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	if (likely(SIT_I(sbi)->sit_loaded) || segno == NULL_SEGNO)
+		return;
+	load_sit_block(sbi, SIT_BLOCK_OFFSET(segno));
 }
 
+/* free segments in undecoded SIT blocks are counted from the checkpoint */
 static inline unsigned int free_segments(struct f2fs_sb_info *sbi)
 {
-	return FREE_I(sbi)->free_segments;
+	return FREE_I(sbi)->free_segments + FREE_I(sbi)->pending_segments;
 }
 
 static inline int reserved_segments(struct f2fs_sb_info *sbi)
@@ -501,7 +682,8 @@ static inline int reserved_segments(struct f2fs_sb_info *sbi)
 
 static inline unsigned int free_sections(struct f2fs_sb_info *sbi)
 {
-	return FREE_I(sbi)->free_sections;
+	return FREE_I(sbi)->free_sections +
+		FREE_I(sbi)->pending_segments / sbi->segs_per_sec;
 }
 
 static inline unsigned int prefree_segments(struct f2fs_sb_info *sbi)
@@ -602,6 +784,12 @@ static inline int utilization(struct f2fs_sb_info *sbi)
 #define DEF_MIN_IPU_UTIL	70
 #define DEF_MIN_FSYNC_BLOCKS	8
 #define DEF_MIN_HOT_BLOCKS	16
+#define DEF_BG_SIT_FLUSH_BLOCKS	32	/* SIT blocks per background run */
+#define DEF_BG_SIT_FLUSH_DIRTY	4096	/* dirty entries to flush when busy */
+
+/* rewrite intervals in seconds splitting learned hot, warm and cold data */
+#define DEF_TEMP_HOT_AGE	60
+#define DEF_TEMP_COLD_AGE	(24 * 60 * 60)
 
 enum {
 	F2FS_IPU_FORCE,
@@ -650,24 +838,8 @@ static inline int check_block_count(struct f2fs_sb_info *sbi,
 		int segno, struct f2fs_sit_entry *raw_sit)
 {
 #ifdef CONFIG_F2FS_CHECK_FS
-	bool is_valid  = test_bit_le(0, raw_sit->valid_map) ? true : false;
-	int valid_blocks = 0;
-	int cur_pos = 0, next_pos;
-
 	/* check bitmap with valid block count */
-	do {
-		if (is_valid) {
-			next_pos = find_next_zero_bit_le(&raw_sit->valid_map,
-					sbi->blocks_per_seg,
-					cur_pos);
-			valid_blocks += next_pos - cur_pos;
-		} else
-			next_pos = find_next_bit_le(&raw_sit->valid_map,
-					sbi->blocks_per_seg,
-					cur_pos);
-		cur_pos = next_pos;
-		is_valid = !is_valid;
-	} while (cur_pos < sbi->blocks_per_seg);
+	int valid_blocks = memweight(raw_sit->valid_map, SIT_VBLOCK_MAP_SIZE);
 
 	if (unlikely(GET_SIT_VBLOCKS(raw_sit) != valid_blocks)) {
 		f2fs_msg(sbi->sb, KERN_ERR,
@@ -742,6 +914,22 @@ static inline unsigned long long get_mtime(struct f2fs_sb_info *sbi)
 	return sit_i->elapsed_time + now - sit_i->mounted_time;
 }
 
+/* SIT entries of different stripes are updated in parallel */
+static inline void update_max_mtime(struct sit_info *sit_i,
+					unsigned long long mtime)
+{
+	unsigned long long old = READ_ONCE(sit_i->max_mtime);
+
+	while (old < mtime) {
+		unsigned long long prev;
+
+		prev = cmpxchg64(&sit_i->max_mtime, old, mtime);
+		if (prev == old)
+			break;
+		old = prev;
+	}
+}
+
 static inline void set_summary(struct f2fs_summary *sum, nid_t nid,
 			unsigned int ofs_in_node, unsigned char version)
 {
@@ -780,7 +968,8 @@ static inline bool no_fggc_candidate(struct f2fs_sb_info *sbi,
 
 static inline bool sec_usage_check(struct f2fs_sb_info *sbi, unsigned int secno)
 {
-	if (IS_CURSEC(sbi, secno) || (sbi->cur_victim_sec == secno))
+	if (IS_CURSEC(sbi, secno) || (sbi->cur_victim_sec == secno) ||
+			test_bit(secno, DIRTY_I(sbi)->cur_victim_secmap))
 		return true;
 	return false;
 }
@@ -827,25 +1016,57 @@ static inline long nr_pages_to_write(struct f2fs_sb_info *sbi, int type,
 	return desired - nr_to_write;
 }
 
+static inline bool flush_lists_empty(struct flush_cmd_control *fcc)
+{
+	int i;
+
+	for (i = 0; i < fcc->nr_queues; i++)
+		if (!llist_empty(&fcc->queue[i].issue_list))
+			return false;
+	return true;
+}
+
+static inline struct discard_shard *discard_shard(
+		struct discard_cmd_control *dcc, block_t blkaddr)
+{
+	unsigned int i = blkaddr >> dcc->shard_shift;
+
+	return &dcc->shards[min(i, dcc->nr_shards - 1)];
+}
+
+static inline struct list_head *discard_pend_list(struct discard_shard *ds,
+				struct discard_dev_queue *dq, int i)
+{
+	return &ds->pend_list[dq->index * MAX_PLIST_NUM + i];
+}
+
 static inline void wake_up_discard_thread(struct f2fs_sb_info *sbi, bool force)
 {
 	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
 	bool wakeup = false;
-	int i;
+	int i, s, d;
 
 	if (force)
 		goto wake_up;
 
-	mutex_lock(&dcc->cmd_lock);
-	for (i = MAX_PLIST_NUM - 1; i >= 0; i--) {
-		if (i + 1 < dcc->discard_granularity)
-			break;
-		if (!list_empty(&dcc->pend_list[i])) {
-			wakeup = true;
-			break;
+	for (s = 0; s < dcc->nr_shards && !wakeup; s++) {
+		struct discard_shard *ds = &dcc->shards[s];
+
+		mutex_lock(&ds->cmd_lock);
+		for (d = 0; d < dcc->nr_dev_queues && !wakeup; d++) {
+			struct discard_dev_queue *dq = &dcc->dev_queue[d];
+
+			for (i = MAX_PLIST_NUM - 1; i >= 0; i--) {
+				if (i + 1 < dcc->discard_granularity)
+					break;
+				if (!list_empty(discard_pend_list(ds, dq, i))) {
+					wakeup = true;
+					break;
+				}
+			}
 		}
+		mutex_unlock(&ds->cmd_lock);
 	}
-	mutex_unlock(&dcc->cmd_lock);
 	if (!wakeup)
 		return;
 wake_up:
@@ -94,6 +94,8 @@ enum {
 	Opt_acl,
 	Opt_noacl,
 	Opt_active_logs,
+	Opt_stream_logs,
+	Opt_alloc_shards,
 	Opt_disable_ext_identify,
 	Opt_inline_xattr,
 	Opt_noinline_xattr,
@@ -105,6 +107,8 @@ enum {
 	Opt_noflush_merge,
 	Opt_nobarrier,
 	Opt_fastboot,
+	Opt_lazy_sit,
+	Opt_fua_fsync,
 	Opt_extent_cache,
 	Opt_noextent_cache,
 	Opt_noinline_data,
@@ -147,6 +151,8 @@ static match_table_t f2fs_tokens = {
 	{Opt_acl, "acl"},
 	{Opt_noacl, "noacl"},
 	{Opt_active_logs, "active_logs=%u"},
+	{Opt_stream_logs, "stream_logs=%u"},
+	{Opt_alloc_shards, "alloc_shards=%u"},
 	{Opt_disable_ext_identify, "disable_ext_identify"},
 	{Opt_inline_xattr, "inline_xattr"},
 	{Opt_noinline_xattr, "noinline_xattr"},
@@ -158,6 +164,8 @@ static match_table_t f2fs_tokens = {
 	{Opt_noflush_merge, "noflush_merge"},
 	{Opt_nobarrier, "nobarrier"},
 	{Opt_fastboot, "fastboot"},
+	{Opt_lazy_sit, "lazy_sit"},
+	{Opt_fua_fsync, "fua_fsync"},
 	{Opt_extent_cache, "extent_cache"},
 	{Opt_noextent_cache, "noextent_cache"},
 	{Opt_noinline_data, "noinline_data"},
@@ -484,6 +492,20 @@ static int parse_options(struct super_block *sb, char *options)
 				return -EINVAL;
 			sbi->active_logs = arg;
 			break;
+		case Opt_stream_logs:
+			if (args->from && match_int(args, &arg))
+				return -EINVAL;
+			if (arg < 0 || arg > MAX_STREAM_LOGS)
+				return -EINVAL;
+			sbi->nr_stream_logs = arg;
+			break;
+		case Opt_alloc_shards:
+			if (args->from && match_int(args, &arg))
+				return -EINVAL;
+			if (arg < 0 || arg > MAX_ALLOC_SHARDS)
+				return -EINVAL;
+			sbi->nr_alloc_shards = arg;
+			break;
 		case Opt_disable_ext_identify:
 			set_opt(sbi, DISABLE_EXT_IDENTIFY);
 			break;
@@ -508,6 +530,12 @@ static int parse_options(struct super_block *sb, char *options)
 		case Opt_fastboot:
 			set_opt(sbi, FASTBOOT);
 			break;
+		case Opt_lazy_sit:
+			set_opt(sbi, LAZY_SIT);
+			break;
+		case Opt_fua_fsync:
+			set_opt(sbi, FUA_FSYNC);
+			break;
 		case Opt_extent_cache:
 			set_opt(sbi, EXTENT_CACHE);
 			break;
@@ -874,6 +902,7 @@ static void destroy_percpu_info(struct f2fs_sb_info *sbi)
 {
 	percpu_counter_destroy(&sbi->alloc_valid_block_count);
 	percpu_counter_destroy(&sbi->total_valid_inode_count);
+	percpu_counter_destroy(&sbi->discard_blks);
 }
 
 static void destroy_device_list(struct f2fs_sb_info *sbi)
@@ -916,7 +945,9 @@ static void f2fs_put_super(struct super_block *sb)
 	/* be sure to wait for any on-going discard commands */
 	dropped = f2fs_wait_discard_bios(sbi);
 
-	if (f2fs_discard_en(sbi) && !sbi->discard_blks && !dropped) {
+	/* discard_blks does not count SIT blocks lazy_sit has not decoded */
+	if (f2fs_discard_en(sbi) && SIT_I(sbi)->sit_loaded &&
+			!discard_blocks(sbi) && !dropped) {
 		struct cp_control cpc = {
 			.reason = CP_UMOUNT | CP_TRIMMED,
 		};
@@ -942,6 +973,7 @@ static void f2fs_put_super(struct super_block *sb)
 	iput(sbi->meta_inode);
 
 	/* destroy f2fs internal modules */
+	destroy_gc_manager(sbi);
 	destroy_node_manager(sbi);
 	destroy_segment_manager(sbi);
 
@@ -1192,6 +1224,10 @@ static int f2fs_show_options(struct seq_file *seq, struct dentry *root)
 		seq_puts(seq, ",nobarrier");
 	if (test_opt(sbi, FASTBOOT))
 		seq_puts(seq, ",fastboot");
+	if (test_opt(sbi, LAZY_SIT))
+		seq_puts(seq, ",lazy_sit");
+	if (test_opt(sbi, FUA_FSYNC))
+		seq_puts(seq, ",fua_fsync");
 	if (test_opt(sbi, EXTENT_CACHE))
 		seq_puts(seq, ",extent_cache");
 	else
@@ -1205,6 +1241,10 @@ static int f2fs_show_options(struct seq_file *seq, struct dentry *root)
 	else if (test_opt(sbi, LFS))
 		seq_puts(seq, "lfs");
 	seq_printf(seq, ",active_logs=%u", sbi->active_logs);
+	if (sbi->nr_stream_logs)
+		seq_printf(seq, ",stream_logs=%u", sbi->nr_stream_logs);
+	if (sbi->nr_alloc_shards)
+		seq_printf(seq, ",alloc_shards=%u", sbi->nr_alloc_shards);
 	if (test_opt(sbi, RESERVE_ROOT))
 		seq_printf(seq, ",reserve_root=%u,resuid=%u,resgid=%u",
 				sbi->root_reserved_blocks,
@@ -1274,6 +1314,7 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 	struct f2fs_mount_info org_mount_opt;
 	unsigned long old_sb_flags;
 	int err, active_logs;
+	unsigned int nr_stream_logs, nr_alloc_shards;
 	bool need_restart_gc = false;
 	bool need_stop_gc = false;
 	bool no_extent_cache = !test_opt(sbi, EXTENT_CACHE);
@@ -1293,6 +1334,8 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 	org_mount_opt = sbi->mount_opt;
 	old_sb_flags = sb->s_flags;
 	active_logs = sbi->active_logs;
+	nr_stream_logs = sbi->nr_stream_logs;
+	nr_alloc_shards = sbi->nr_alloc_shards;
 
 #ifdef CONFIG_QUOTA
 	s_jquota_fmt = sbi->s_jquota_fmt;
@@ -1351,6 +1394,15 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 		}
 	}
 #endif
+	/* volatile logs are set up at mount time */
+	if (nr_stream_logs != sbi->nr_stream_logs ||
+			nr_alloc_shards != sbi->nr_alloc_shards) {
+		err = -EINVAL;
+		f2fs_msg(sbi->sb, KERN_WARNING,
+			"switch stream_logs/alloc_shards option is not allowed");
+		goto restore_opts;
+	}
+
 	/* disallow enable/disable extent_cache dynamically */
 	if (no_extent_cache == !!test_opt(sbi, EXTENT_CACHE)) {
 		err = -EINVAL;
@@ -1428,6 +1480,8 @@ restore_opts:
 #endif
 	sbi->mount_opt = org_mount_opt;
 	sbi->active_logs = active_logs;
+	sbi->nr_stream_logs = nr_stream_logs;
+	sbi->nr_alloc_shards = nr_alloc_shards;
 	sb->s_flags = old_sb_flags;
 #ifdef CONFIG_F2FS_FAULT_INJECTION
 	sbi->fault_info = ffi;
@@ -2164,6 +2218,11 @@ static void init_sb_info(struct f2fs_sb_info *sbi)
 	sbi->meta_ino_num = le32_to_cpu(raw_super->meta_ino);	//0x2
 	sbi->cur_victim_sec = NULL_SECNO;
 	sbi->max_victim_search = DEF_MAX_VICTIM_SEARCH;
+	sbi->gc_victim_index = 1;
+	sbi->ssr_victim_index = 1;
+	sbi->temp_hot_age = DEF_TEMP_HOT_AGE;
+	sbi->temp_cold_age = DEF_TEMP_COLD_AGE;
+	init_temp_rules(sbi);
 
 	sbi->dir_level = DEF_DIR_LEVEL;
 	sbi->interval_time[CP_TIME] = DEF_CP_INTERVAL;
@@ -2209,6 +2268,10 @@ static int init_percpu_info(struct f2fs_sb_info *sbi)
 	if (err)
 		return err;
 
+	err = percpu_counter_init(&sbi->discard_blks, 0, GFP_KERNEL);
+	if (err)
+		return err;
+
 	return percpu_counter_init(&sbi->total_valid_inode_count, 0,
 								GFP_KERNEL);
 }
@@ -2477,6 +2540,7 @@ static int f2fs_fill_super(struct super_block *sb, void *data, int silent)
 	char *options = NULL;
 	int recovery, i, valid_super_block;
 	struct curseg_info *seg_i;
+	ktime_t start_time;
 
 try_onemore:
 	err = -EINVAL;
@@ -2627,7 +2691,7 @@ pr_notice("before sb->s_blocksize = size = 0x%x\n",sb->s_blocksize);
 	// node: .............[1]...........................................
 	// meta: .............[2] = 1个，热
 	for (i = 0; i < NR_PAGE_TYPE; i++) {
-		int n = (i == META) ? 1: NR_TEMP_TYPE;
+		int n = nr_write_io(sbi, i);
 		int j;
 
 		sbi->write_io[i] = f2fs_kmalloc(sbi,
@@ -2718,20 +2782,26 @@ pr_notice("before sb->s_blocksize = size = 0x%x\n",sb->s_blocksize);
 
 	/* setup f2fs internal modules */
 	//建立segments的管理信息，如sit，free_segmap,dirty_segmap,curseg
+	start_time = ktime_get();
 	err = build_segment_manager(sbi);
 	if (err) {
 		f2fs_msg(sb, KERN_ERR,
 			"Failed to initialize F2FS segment manager");
 		goto free_sm;
 	}
+	sbi->mount_time_us[MOUNT_SEGMENT_MANAGER] =
+			ktime_us_delta(ktime_get(), start_time);
 
 	// node管理，nat_block，nat_block_bitmap,每个nat_block中nat entry的bitmap，free_nid的bitmap
+	start_time = ktime_get();
 	err = build_node_manager(sbi);
 	if (err) {
 		f2fs_msg(sb, KERN_ERR,
 			"Failed to initialize F2FS node manager");
 		goto free_nm;
 	}
+	sbi->mount_time_us[MOUNT_NODE_MANAGER] =
+			ktime_us_delta(ktime_get(), start_time);
 
 	/* For write statistics */
 	if (sb->s_bdev->bd_part)
@@ -2747,7 +2817,12 @@ pr_notice("before sb->s_blocksize = size = 0x%x\n",sb->s_blocksize);
 		//pr_notice("exist_node_summaries(sbi)\n");
 	}
 	
-	build_gc_manager(sbi);
+	err = build_gc_manager(sbi);
+	if (err) {
+		f2fs_msg(sb, KERN_ERR,
+			"Failed to initialize F2FS gc manager");
+		goto free_nm;
+	}
 
 	/* get an inode for node space */
 	sbi->node_inode = f2fs_iget(sb, F2FS_NODE_INO(sbi)); // 1
@@ -2902,6 +2977,7 @@ free_node_inode:
 	truncate_inode_pages_final(NODE_MAPPING(sbi));
 	iput(sbi->node_inode);
 free_nm:
+	destroy_gc_manager(sbi);
 	destroy_node_manager(sbi);
 free_sm:
 	destroy_segment_manager(sbi);
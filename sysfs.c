@@ -126,6 +126,84 @@ static ssize_t current_reserved_blocks_show(struct f2fs_attr *a,
 	return snprintf(buf, PAGE_SIZE, "%u\n", sbi->current_reserved_blocks);
 }
 
+static ssize_t temp_accuracy_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	static const char * const names[NR_TEMP_TYPE] = {
+		"hot", "warm", "cold" };
+	int len = 0, i;
+
+	for (i = 0; i < NR_TEMP_TYPE; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len,
+			"%s: hit %lld miss %lld\n", names[i],
+			(long long)atomic64_read(&sbi->temp_hit[i]),
+			(long long)atomic64_read(&sbi->temp_miss[i]));
+	return len;
+}
+
+static ssize_t mount_phases_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	static const char * const names[NR_MOUNT_PHASES] = {
+		"sit_entries", "free_segmap", "dirty_segmap",
+		"segment_manager", "node_manager" };
+	int len, i;
+
+	len = snprintf(buf, PAGE_SIZE, "workers: %u\n", sbi->mount_workers);
+	for (i = 0; i < NR_MOUNT_PHASES; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len, "%s: %lld us\n",
+				names[i], (long long)sbi->mount_time_us[i]);
+	if (SIT_I(sbi)->loaded_blocks_bitmap)
+		len += snprintf(buf + len, PAGE_SIZE - len,
+				"sit_blocks_loaded: %u/%u\n",
+				SIT_I(sbi)->nr_loaded_blocks,
+				(unsigned int)SIT_BLK_CNT(sbi));
+	return len;
+}
+
+static ssize_t discard_queue_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+	int len = 0, i;
+
+	if (!dcc)
+		return snprintf(buf, PAGE_SIZE, "off\n");
+
+	for (i = 0; i < dcc->nr_dev_queues; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len,
+			"dev%d: inflight %d depth %u latency %u us\n", i,
+			atomic_read(&dcc->dev_queue[i].inflight),
+			dcc->dev_queue[i].depth,
+			dcc->dev_queue[i].avg_lat_us);
+	len += snprintf(buf + len, PAGE_SIZE - len,
+			"merged: %d\ndeferred: %d\n",
+			atomic_read(&dcc->merged_discard),
+			atomic_read(&dcc->deferred_discard));
+	return len;
+}
+
+static ssize_t temp_rules_show(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, char *buf)
+{
+	return show_temp_rules(sbi, buf);
+}
+
+static ssize_t temp_rules_store(struct f2fs_attr *a,
+		struct f2fs_sb_info *sbi, const char *buf, size_t count)
+{
+	char *cmd;
+	int err;
+
+	cmd = kstrndup(buf, count, GFP_KERNEL);
+	if (!cmd)
+		return -ENOMEM;
+
+	err = update_temp_rules(sbi, cmd);
+	kfree(cmd);
+	return err ? err : count;
+}
+
 static ssize_t f2fs_sbi_show(struct f2fs_attr *a,
 			struct f2fs_sb_info *sbi, char *buf)
 {
@@ -186,6 +264,37 @@ static ssize_t f2fs_sbi_store(struct f2fs_attr *a,
 		return count;
 	}
 
+	if (!strcmp(a->attr.name, "max_discard_inflight")) {
+		if (t == 0)
+			return -EINVAL;
+		*ui = t;
+		return count;
+	}
+
+	if (!strcmp(a->attr.name, "gc_age_threshold")) {
+		if (t < MIN_GC_AGE_THRESHOLD)
+			return -EINVAL;
+		*ui = t;
+		return count;
+	}
+
+	if (!strcmp(a->attr.name, "gc_fg_victims")) {
+		if (t == 0 || t > MAX_GC_FG_VICTIMS)
+			return -EINVAL;
+		*ui = t;
+		return count;
+	}
+
+	if (!strcmp(a->attr.name, "gc_migrate_workers")) {
+		if (t > MAX_GC_MIGRATE_WORKERS)
+			return -EINVAL;
+		/* 0 migrates inline in the GC context */
+		if (t)
+			workqueue_set_max_active(sbi->gc_migrate_wq, t);
+		*ui = t;
+		return count;
+	}
+
 	*ui = t;
 
 	if (!strcmp(a->attr.name, "iostat_enable") && *ui == 0)
@@ -270,9 +379,18 @@ static struct f2fs_attr f2fs_attr_##_name = {			\
 		f2fs_sbi_show, f2fs_sbi_store,			\
 		offsetof(struct struct_name, elname))
 
+#define F2FS_RO_ATTR(struct_type, struct_name, name, elname)	\
+	F2FS_ATTR_OFFSET(struct_type, name, 0444,		\
+		f2fs_sbi_show, NULL,				\
+		offsetof(struct struct_name, elname))
+
 #define F2FS_GENERAL_RO_ATTR(name) \
 static struct f2fs_attr f2fs_attr_##name = __ATTR(name, 0444, name##_show, NULL)
 
+#define F2FS_GENERAL_RW_ATTR(name) \
+static struct f2fs_attr f2fs_attr_##name = __ATTR(name, 0644, name##_show, \
+							name##_store)
+
 #define F2FS_FEATURE_RO_ATTR(_name, _id)			\
 static struct f2fs_attr f2fs_attr_##_name = {			\
 	.attr = {.name = __stringify(_name), .mode = 0444 },	\
@@ -287,20 +405,38 @@ F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_max_sleep_time, max_sleep_time);
 F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_no_gc_sleep_time, no_gc_sleep_time);
 F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_idle, gc_idle);
 F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_urgent, gc_urgent);
+F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_qos, gc_qos);
+F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_qos_mbps, qos_mbps);
+F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_qos_iops, qos_iops);
+F2FS_RO_ATTR(GC_THREAD, f2fs_gc_kthread, gc_qos_exhausted, qos_exhausted);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, reclaim_segments, rec_prefree_segments);
 F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, max_small_discards, max_discards);
 F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, discard_granularity, discard_granularity);
+F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, max_discard_inflight, max_inflight);
+F2FS_RW_ATTR(DCC_INFO, discard_cmd_control, discard_latency_ms, discard_latency);
 F2FS_RW_ATTR(RESERVED_BLOCKS, f2fs_sb_info, reserved_blocks, reserved_blocks);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, batched_trim_sections, trim_sections);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, ipu_policy, ipu_policy);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, min_ipu_util, min_ipu_util);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, min_fsync_blocks, min_fsync_blocks);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, min_hot_blocks, min_hot_blocks);
+F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, bg_sit_flush_blocks, bg_sit_flush_blocks);
+F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, bg_sit_flush_dirty, bg_sit_flush_dirty);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, min_ssr_sections, min_ssr_sections);
 F2FS_RW_ATTR(NM_INFO, f2fs_nm_info, ram_thresh, ram_thresh);
 F2FS_RW_ATTR(NM_INFO, f2fs_nm_info, ra_nid_pages, ra_nid_pages);
 F2FS_RW_ATTR(NM_INFO, f2fs_nm_info, dirty_nats_ratio, dirty_nats_ratio);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, max_victim_search, max_victim_search);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_victim_index, gc_victim_index);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, ssr_victim_index, ssr_victim_index);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, temp_classify, temp_classify);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, temp_hot_age, temp_hot_age);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, temp_cold_age, temp_cold_age);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_age_threshold, gc_age_threshold);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_warm_data_age, gc_warm_data_age);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_fg_victims, gc_fg_victims);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_migrate_workers, gc_migrate_workers);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_fg_slice_ms, gc_fg_slice_ms);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, dir_level, dir_level);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, cp_interval, interval_time[CP_TIME]);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, idle_interval, interval_time[REQ_TIME]);
@@ -315,6 +451,10 @@ F2FS_GENERAL_RO_ATTR(dirty_segments);
 F2FS_GENERAL_RO_ATTR(lifetime_write_kbytes);
 F2FS_GENERAL_RO_ATTR(features);
 F2FS_GENERAL_RO_ATTR(current_reserved_blocks);
+F2FS_GENERAL_RO_ATTR(temp_accuracy);
+F2FS_GENERAL_RO_ATTR(mount_phases);
+F2FS_GENERAL_RO_ATTR(discard_queue);
+F2FS_GENERAL_RW_ATTR(temp_rules);
 
 #ifdef CONFIG_F2FS_FS_ENCRYPTION
 F2FS_FEATURE_RO_ATTR(encryption, FEAT_CRYPTO);
@@ -338,16 +478,34 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(gc_no_gc_sleep_time),
 	ATTR_LIST(gc_idle),
 	ATTR_LIST(gc_urgent),
+	ATTR_LIST(gc_qos),
+	ATTR_LIST(gc_qos_mbps),
+	ATTR_LIST(gc_qos_iops),
+	ATTR_LIST(gc_qos_exhausted),
 	ATTR_LIST(reclaim_segments),
 	ATTR_LIST(max_small_discards),
 	ATTR_LIST(discard_granularity),
+	ATTR_LIST(max_discard_inflight),
+	ATTR_LIST(discard_latency_ms),
 	ATTR_LIST(batched_trim_sections),
 	ATTR_LIST(ipu_policy),
 	ATTR_LIST(min_ipu_util),
 	ATTR_LIST(min_fsync_blocks),
 	ATTR_LIST(min_hot_blocks),
+	ATTR_LIST(bg_sit_flush_blocks),
+	ATTR_LIST(bg_sit_flush_dirty),
 	ATTR_LIST(min_ssr_sections),
 	ATTR_LIST(max_victim_search),
+	ATTR_LIST(gc_victim_index),
+	ATTR_LIST(ssr_victim_index),
+	ATTR_LIST(temp_classify),
+	ATTR_LIST(temp_hot_age),
+	ATTR_LIST(temp_cold_age),
+	ATTR_LIST(gc_age_threshold),
+	ATTR_LIST(gc_warm_data_age),
+	ATTR_LIST(gc_fg_victims),
+	ATTR_LIST(gc_migrate_workers),
+	ATTR_LIST(gc_fg_slice_ms),
 	ATTR_LIST(dir_level),
 	ATTR_LIST(ram_thresh),
 	ATTR_LIST(ra_nid_pages),
@@ -366,6 +524,10 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(features),
 	ATTR_LIST(reserved_blocks),
 	ATTR_LIST(current_reserved_blocks),
+	ATTR_LIST(temp_accuracy),
+	ATTR_LIST(mount_phases),
+	ATTR_LIST(discard_queue),
+	ATTR_LIST(temp_rules),
 	NULL,
 };
 
@@ -0,0 +1,217 @@
+/*
+ * bitbench - compares the old and new SIT bitmap routines of f2fs
+ *
+ * The new __find_rev_next_bit(), __find_rev_next_zero_bit() and count_bits()
+ * are extracted from segment.c and gc.c of this tree at build time, along
+ * with f2fs_bitmap_word() and f2fs_first_bit() from f2fs.h (see bitmap.gen.c
+ * in the Makefile). The byte-reversing and per-bit versions they replaced
+ * are kept in legacy.c.
+ *
+ * Both sets are first cross-checked on every offset, then timed on 512 and
+ * 2048 bit maps of several fill patterns: a scan of all set runs, as
+ * add_discard_addrs() does, and count_bits() over the whole map and over an
+ * unaligned range.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitops.h"
+
+#define __reverse_ulong			old_reverse_ulong
+#define __reverse_ffs			old_reverse_ffs
+#define __find_rev_next_bit		old_find_rev_next_bit
+#define __find_rev_next_zero_bit	old_find_rev_next_zero_bit
+#define count_bits			old_count_bits
+#include "legacy.c"
+#undef __reverse_ffz
+#undef __reverse_ulong
+#undef __reverse_ffs
+#undef __find_rev_next_bit
+#undef __find_rev_next_zero_bit
+#undef count_bits
+
+#include "bitmap.gen.c"
+
+#define NR_MAPS		64		/* maps per size and pattern */
+#define MAX_BITS	2048
+#define MAP_LONGS	(MAX_BITS / BITS_PER_LONG)
+
+struct pattern {
+	const char *name;
+	unsigned int percent;		/* chance of a set bit, or 0 */
+};
+
+static const struct pattern patterns[] = {
+	{ "sparse",	2 },
+	{ "half",	50 },
+	{ "dense",	98 },
+	{ "runs",	0 },		/* runs of 1-32 equal bits */
+};
+#define NR_PATTERNS	(sizeof(patterns) / sizeof(patterns[0]))
+
+static const unsigned int sizes[] = { 512, 2048 };
+#define NR_SIZES	(sizeof(sizes) / sizeof(sizes[0]))
+
+static unsigned long maps[NR_MAPS][MAP_LONGS];
+static unsigned int seed = 2463534242U;
+static volatile unsigned long sink;
+
+/* xorshift32 */
+static unsigned int rnd(unsigned int n)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed % n;
+}
+
+static void fill_maps(const struct pattern *pat, unsigned int size)
+{
+	unsigned int i, nr, run = 0;
+	bool set = false;
+
+	memset(maps, 0, sizeof(maps));
+	for (i = 0; i < NR_MAPS; i++) {
+		for (nr = 0; nr < size; nr++) {
+			if (pat->percent) {
+				set = rnd(100) < pat->percent;
+			} else if (!run--) {
+				run = rnd(32);
+				set = !set;
+			}
+			if (set)
+				f2fs_set_bit(nr, (char *)maps[i]);
+		}
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* the loop of add_discard_addrs() over the set runs of a map */
+#define DEFINE_SCAN(name, next_bit, next_zero_bit)			\
+static unsigned long name(const unsigned long *map, unsigned int size)	\
+{									\
+	unsigned long start, end = 0, sum = 0;				\
+									\
+	while (1) {							\
+		start = next_bit(map, size, end + 1);			\
+		if (start >= size)					\
+			break;						\
+		end = next_zero_bit(map, size, start + 1);		\
+		sum += end - start;					\
+	}								\
+	return sum;							\
+}
+
+DEFINE_SCAN(scan_old, old_find_rev_next_bit, old_find_rev_next_zero_bit)
+DEFINE_SCAN(scan_new, __find_rev_next_bit, __find_rev_next_zero_bit)
+
+static unsigned long count_old(const unsigned long *map, unsigned int size)
+{
+	return old_count_bits(map, 0, size) + old_count_bits(map, 5, size - 11);
+}
+
+static unsigned long count_new(const unsigned long *map, unsigned int size)
+{
+	return count_bits(map, 0, size) + count_bits(map, 5, size - 11);
+}
+
+/* ns per map of @fn over all maps */
+static double timed(unsigned long (*fn)(const unsigned long *, unsigned int),
+				unsigned int size, unsigned int loops)
+{
+	unsigned long sum = 0;
+	unsigned int i, l;
+	double start = now_ns();
+
+	for (l = 0; l < loops; l++)
+		for (i = 0; i < NR_MAPS; i++)
+			sum += fn(maps[i], size);
+	sink = sum;
+	return (now_ns() - start) / ((double)loops * NR_MAPS);
+}
+
+static unsigned long nr_checks, nr_errors;
+
+static void check(const char *what, unsigned int size, unsigned int map,
+		unsigned int offset, unsigned long old, unsigned long new)
+{
+	nr_checks++;
+	if (old == new)
+		return;
+	if (nr_errors++ < 10)
+		fprintf(stderr, "bitbench: %s of map %u/%u at %u: old %lu, "
+			"new %lu\n", what, map, size, offset, old, new);
+}
+
+/*
+ * Every offset of every map for the find routines, and every range with
+ * a stride of @stride for count_bits().
+ */
+static void cross_check(unsigned int size, unsigned int stride)
+{
+	unsigned int i, off, len;
+
+	for (i = 0; i < NR_MAPS; i++) {
+		const unsigned long *m = maps[i];
+
+		for (off = 0; off <= size; off++) {
+			check("next_bit", size, i, off,
+				old_find_rev_next_bit(m, size, off),
+				__find_rev_next_bit(m, size, off));
+			check("next_zero_bit", size, i, off,
+				old_find_rev_next_zero_bit(m, size, off),
+				__find_rev_next_zero_bit(m, size, off));
+		}
+
+		for (off = 0; off < size; off += stride)
+			for (len = 0; off + len <= size; len += stride)
+				check("count_bits", size, i, off,
+					old_count_bits(m, off, len),
+					count_bits(m, off, len));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int loops = argc > 1 ? atoi(argv[1]) : 2000;
+	unsigned int s, p;
+
+	if (!loops) {
+		fprintf(stderr, "usage: bitbench [loops]\n");
+		return 1;
+	}
+
+	printf("%-5s %-7s %9s %9s %7s %9s %9s %7s\n", "bits", "pattern",
+		"scan_old", "scan_new", "speedup",
+		"count_old", "count_new", "speedup");
+	for (s = 0; s < NR_SIZES; s++) {
+		for (p = 0; p < NR_PATTERNS; p++) {
+			unsigned int size = sizes[s];
+			double so, sn, co, cn;
+
+			fill_maps(&patterns[p], size);
+			cross_check(size, size > 512 ? 7 : 1);
+
+			so = timed(scan_old, size, loops);
+			sn = timed(scan_new, size, loops);
+			co = timed(count_old, size, loops);
+			cn = timed(count_new, size, loops);
+			printf("%-5u %-7s %9.1f %9.1f %6.2fx %9.1f %9.1f "
+				"%6.2fx\n", size, patterns[p].name,
+				so, sn, so / sn, co, cn, co / cn);
+		}
+	}
+	printf("(ns per map) cross-check: %lu comparisons, %lu mismatches\n",
+		nr_checks, nr_errors);
+	return nr_errors ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * bitops.h - userspace stand-ins for the kernel helpers that the SIT bitmap
+ * routines of f2fs.h, segment.c and gc.c use.
+ */
+#ifndef _BITBENCH_BITOPS_H
+#define _BITBENCH_BITOPS_H
+
+#include <endian.h>
+#include <stdint.h>
+
+typedef uint32_t __be32;
+typedef uint64_t __be64;
+
+#define BITS_PER_BYTE		8
+#define BITS_PER_LONG		(__SIZEOF_LONG__ * BITS_PER_BYTE)
+#define BIT_WORD(nr)		((nr) / BITS_PER_LONG)
+#define BIT_MASK(nr)		(1UL << ((nr) % BITS_PER_LONG))
+
+#define min(a, b)		((a) < (b) ? (a) : (b))
+#define min_t(t, a, b)		((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+
+#define be32_to_cpu(x)		be32toh(x)
+#define be64_to_cpu(x)		be64toh(x)
+#define hweight_long(w)		__builtin_popcountl(w)
+#define __fls(w)		(BITS_PER_LONG - 1 - __builtin_clzl(w))
+
+static inline int test_bit(unsigned int nr, const unsigned long *addr)
+{
+	return !!(addr[BIT_WORD(nr)] & BIT_MASK(nr));
+}
+
+/* f2fs bitmaps are MSB first in each byte */
+static inline void f2fs_set_bit(unsigned int nr, char *addr)
+{
+	addr[nr >> 3] |= 1 << (7 - (nr & 0x07));
+}
+
+#endif /* _BITBENCH_BITOPS_H */
@@ -0,0 +1,42 @@
+#
+# extract.awk - copy the definitions of the functions named in NAMES out of
+# a kernel source file, in source order, with #line markers so that the
+# compiler reports errors against the original file.
+#
+# Kernel style puts the return type and the name of a function on its first
+# line at column 0, and the closing brace alone on the last one.
+#
+BEGIN {
+	n = split(NAMES, list, " ")
+	for (i = 1; i <= n; i++)
+		want[list[i]] = 1
+}
+
+!body && /^[A-Za-z_]/ && !/;[ \t]*$/ {
+	for (name in want) {
+		if ($0 ~ ("(^|[^A-Za-z0-9_])" name "\\(")) {
+			body = 1
+			found[name] = 1
+			printf("#line %d \"%s\"\n", FNR, FILENAME)
+			break
+		}
+	}
+}
+
+body {
+	print
+	if ($0 == "}") {
+		body = 0
+		print ""
+	}
+}
+
+END {
+	for (name in want) {
+		if (!(name in found)) {
+			printf("%s: %s() not found\n", FILENAME, name) > "/dev/stderr"
+			err = 1
+		}
+	}
+	exit err
+}
@@ -0,0 +1,1018 @@
+/*
+ * gcsim - offline GC/allocation policy simulator for f2fs
+ *
+ * Replays a block write trace on a simulated main area, either empty or
+ * seeded from a SIT snapshot, and runs victim selection for GC and SSR
+ * through the functions of gc.c and segment.c of this tree (see policy.gen.c
+ * in the Makefile). The main area, SIT cache,
+ * free segmap and dirty seglists are modelled in memory; everything else,
+ * i.e. node blocks, the page cache and I/O, is left out.
+ *
+ * For every policy it reports write amplification, the cost of GC as the
+ * valid blocks moved per victim, and the CPU time spent selecting victims.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "sim.h"
+#include "policy.gen.c"
+
+#define INVALID_BLK		((unsigned int)~0)
+
+/* f2fs defaults, see build_gc_manager() and super.c */
+#define DEF_MAX_VICTIM_SEARCH	4096
+#define DEF_CP_INTERVAL		60	/* secs */
+
+struct sim_config {
+	unsigned int main_segs;
+	unsigned int log_blocks_per_seg;
+	unsigned int segs_per_sec;
+	unsigned int ovp_ratio;		/* overprovision in percent */
+	unsigned int age_threshold;	/* gc_age_threshold in secs */
+	bool no_index;			/* scan dirty segmaps instead */
+	bool bg_gc;			/* run BG_GC at 'T' records */
+};
+
+struct sim_policy {
+	const char *name;
+	unsigned int gc_idle;		/* gc_mode, see select_gc_type() */
+	bool ssr;
+};
+
+static const struct sim_policy sim_policies[] = {
+	{ "cb",		1, false },
+	{ "greedy",	2, false },
+	{ "at",		3, false },
+	{ "cb+ssr",	1, true },
+	{ "greedy+ssr",	2, true },
+	{ "at+ssr",	3, true },
+};
+#define NR_SIM_POLICIES	(sizeof(sim_policies) / sizeof(sim_policies[0]))
+
+enum sim_hint {
+	HINT_NONE,
+	HINT_HOT,
+	HINT_COLD,
+	NR_HINTS
+};
+
+struct sim_record {
+	char op;			/* W(rite), D(iscard), T(ime), C(kpt) */
+	unsigned char hint;
+	unsigned int lba;
+	unsigned int len;
+};
+
+struct sim_trace {
+	struct sim_record *recs;
+	unsigned int nr_recs;
+	unsigned int max_lba;
+};
+
+#define MAX_MAP_SIZE		(512 / 8)	/* valid map of 512 blocks */
+
+/* a segment in use when the snapshot was taken */
+struct snap_seg {
+	unsigned int segno;
+	unsigned int type;
+	unsigned long long mtime;
+	unsigned char map[MAX_MAP_SIZE];	/* as in f2fs_sit_entry */
+};
+
+struct sim_snapshot {
+	struct snap_seg *segs;
+	unsigned int nr_segs;
+};
+
+struct sim_stats {
+	u64 user_blocks;
+	u64 gc_blocks;			/* valid blocks moved by GC */
+	u64 ssr_blocks;			/* blocks written in SSR segments */
+	u64 victims;
+	u64 selects[2];			/* get_victim calls, LFS and SSR */
+	u64 select_ns[2];
+	u64 checkpoints;
+};
+
+struct sim {
+	struct f2fs_sb_info sbi;
+	struct f2fs_sm_info sm;
+	struct sit_info sit;
+	struct free_segmap_info free;
+	struct dirty_seglist_info dirty;
+	struct curseg_info curseg[NR_CURSEG_TYPE];
+	struct f2fs_gc_kthread gc_th;
+	struct inode inodes[NR_HINTS];
+	struct address_space mappings[NR_HINTS];
+	unsigned char *maps;		/* arena of SIT bitmaps */
+	unsigned int *l2p;		/* lba to block address */
+	unsigned int *p2l;		/* block address to lba */
+	unsigned int user_blocks;	/* logical capacity */
+	unsigned long long last_cp;
+	struct sim_stats st;
+};
+
+static struct sim_stats *cur_stats;
+
+static void *zalloc(size_t size)
+{
+	void *p = calloc(1, size);
+
+	if (!p) {
+		fprintf(stderr, "gcsim: out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+static u64 cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* accounts every victim selection, including those of get_ssr_segment() */
+static int timed_get_victim(struct f2fs_sb_info *sbi, unsigned int *result,
+			int gc_type, int type, char alloc_mode)
+{
+	u64 start = cpu_ns();
+	int ret;
+
+	ret = get_victim_by_default(sbi, result, gc_type, type, alloc_mode);
+	cur_stats->select_ns[alloc_mode == SSR] += cpu_ns() - start;
+	cur_stats->selects[alloc_mode == SSR]++;
+	return ret;
+}
+
+static const struct victim_selection sim_v_ops = {
+	.get_victim = timed_get_victim,
+};
+
+static void init_victim_index(struct victim_index *vi,
+				unsigned int nr_buckets,
+				struct victim_entry *entries,
+				unsigned int nr_entries)
+{
+	unsigned int i;
+
+	vi->nr_buckets = nr_buckets;
+	vi->buckets = zalloc(nr_buckets * sizeof(struct list_head));
+	vi->bucket_map = zalloc(BITS_TO_LONGS(nr_buckets) * sizeof(long));
+	for (i = 0; i < nr_buckets; i++)
+		INIT_LIST_HEAD(&vi->buckets[i]);
+	vi->entries = entries;
+	for (i = 0; entries && i < nr_entries; i++)
+		INIT_LIST_HEAD(&entries[i].list);
+}
+
+static int sim_init(struct sim *s, const struct sim_config *cfg,
+				const struct sim_policy *pol)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	unsigned int main_segs, nr_secs, map_size, i;
+	u64 main_count, resv_count, ovp_count;
+
+	memset(s, 0, sizeof(*s));
+	cur_stats = &s->st;
+
+	sbi->sm_info = &s->sm;
+	sbi->gc_thread = &s->gc_th;
+	s->sm.sit_info = &s->sit;
+	s->sm.free_info = &s->free;
+	s->sm.dirty_info = &s->dirty;
+	s->sm.curseg_array = s->curseg;
+
+	sbi->log_blocks_per_seg = cfg->log_blocks_per_seg;
+	sbi->blocks_per_seg = 1 << cfg->log_blocks_per_seg;
+	sbi->segs_per_sec = cfg->segs_per_sec;
+	nr_secs = cfg->main_segs / cfg->segs_per_sec;
+	main_segs = nr_secs * cfg->segs_per_sec;
+	sbi->total_sections = nr_secs;
+	s->sm.main_segments = main_segs;
+
+	/* as mkfs.f2fs sizes the overprovision and reserved areas */
+	s->sm.ovp_segments = main_segs * cfg->ovp_ratio / 100;
+	s->sm.reserved_segments = (2 * (100 / cfg->ovp_ratio + 1) + 6) *
+							cfg->segs_per_sec;
+	if (s->sm.reserved_segments >= s->sm.ovp_segments) {
+		fprintf(stderr, "gcsim: %u%% overprovision of %u segments "
+			"leaves no room above %u reserved segments\n",
+			cfg->ovp_ratio, main_segs, s->sm.reserved_segments);
+		return -EINVAL;
+	}
+	s->sm.min_ssr_sections = reserved_sections(sbi);
+	s->user_blocks = (main_segs - s->sm.ovp_segments) <<
+						cfg->log_blocks_per_seg;
+
+	main_count = (u64)main_segs << sbi->log_blocks_per_seg;
+	resv_count = (u64)s->sm.reserved_segments << sbi->log_blocks_per_seg;
+	ovp_count = (u64)s->sm.ovp_segments << sbi->log_blocks_per_seg;
+	sbi->fggc_threshold = div64_u64((main_count - ovp_count) *
+				BLKS_PER_SEC(sbi), (main_count - resv_count));
+
+	sbi->cur_victim_sec = NULL_SEGNO;
+	sbi->max_victim_search = DEF_MAX_VICTIM_SEARCH;
+	sbi->gc_victim_index = !cfg->no_index;
+	sbi->ssr_victim_index = !cfg->no_index;
+	sbi->gc_age_threshold = cfg->age_threshold;
+	if (!pol->ssr)
+		sbi->mount_opt |= F2FS_MOUNT_LFS;
+	s->gc_th.gc_idle = pol->gc_idle;
+
+	/* SIT cache, starting with an empty main area */
+	map_size = sbi->blocks_per_seg / 8;
+	s->sit.sentries = zalloc(main_segs * sizeof(struct seg_entry));
+	s->sit.sec_entries = zalloc(nr_secs * sizeof(struct sec_entry));
+	s->maps = zalloc((size_t)main_segs * map_size * 2);
+	for (i = 0; i < main_segs; i++) {
+		s->sit.sentries[i].cur_valid_map = s->maps + 2 * i * map_size;
+		s->sit.sentries[i].ckpt_valid_map =
+				s->maps + (2 * i + 1) * map_size;
+	}
+	s->sit.elapsed_time = 1;
+
+	s->free.free_segments = main_segs;
+	s->free.free_sections = nr_secs;
+	s->free.free_segmap = zalloc(BITS_TO_LONGS(main_segs) * sizeof(long));
+	s->free.free_secmap = zalloc(BITS_TO_LONGS(nr_secs) * sizeof(long));
+
+	s->dirty.v_ops = &sim_v_ops;
+	for (i = 0; i < NR_DIRTY_TYPE; i++)
+		s->dirty.dirty_segmap[i] =
+			zalloc(BITS_TO_LONGS(main_segs) * sizeof(long));
+	s->dirty.victim_secmap = zalloc(BITS_TO_LONGS(nr_secs) * sizeof(long));
+	s->dirty.cur_victim_secmap =
+			zalloc(BITS_TO_LONGS(nr_secs) * sizeof(long));
+	init_victim_index(&s->dirty.vindex, BLKS_PER_SEC(sbi) + 1,
+			zalloc(nr_secs * sizeof(struct victim_entry)),
+			nr_secs);
+	s->dirty.ssr_entries = zalloc(main_segs * sizeof(struct victim_entry));
+	for (i = 0; i < main_segs; i++)
+		INIT_LIST_HEAD(&s->dirty.ssr_entries[i].list);
+	s->dirty.stale_segmap = zalloc(BITS_TO_LONGS(main_segs) * sizeof(long));
+	for (i = 0; i < DIRTY; i++)
+		init_victim_index(&s->dirty.ssr_index[i],
+				sbi->blocks_per_seg + 1, NULL, 0);
+
+	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+		s->curseg[i].segno = NULL_SEGNO;
+		s->curseg[i].next_segno = NULL_SEGNO;
+	}
+
+	/* one regular file per trace hint */
+	for (i = 0; i < NR_HINTS; i++) {
+		s->inodes[i].sbi = sbi;
+		s->inodes[i].i_mode = S_IFREG | 0644;
+		s->mappings[i].host = &s->inodes[i];
+	}
+	s->inodes[HINT_HOT].i_advise = SIM_ADVISE_HOT;
+	s->inodes[HINT_COLD].i_advise = SIM_ADVISE_COLD;
+
+	s->l2p = malloc(s->user_blocks * sizeof(unsigned int));
+	s->p2l = malloc(((size_t)main_segs << cfg->log_blocks_per_seg) *
+						sizeof(unsigned int));
+	if (!s->l2p || !s->p2l) {
+		fprintf(stderr, "gcsim: out of memory\n");
+		exit(1);
+	}
+	memset(s->l2p, 0xff, s->user_blocks * sizeof(unsigned int));
+	memset(s->p2l, 0xff, ((size_t)main_segs << cfg->log_blocks_per_seg) *
+						sizeof(unsigned int));
+	return 0;
+}
+
+static void sim_exit(struct sim *s)
+{
+	unsigned int i;
+
+	free(s->l2p);
+	free(s->p2l);
+	for (i = 0; i < DIRTY; i++) {
+		free(s->dirty.ssr_index[i].buckets);
+		free(s->dirty.ssr_index[i].bucket_map);
+	}
+	free(s->dirty.ssr_entries);
+	free(s->dirty.stale_segmap);
+	free(s->dirty.vindex.entries);
+	free(s->dirty.vindex.buckets);
+	free(s->dirty.vindex.bucket_map);
+	free(s->dirty.cur_victim_secmap);
+	free(s->dirty.victim_secmap);
+	for (i = 0; i < NR_DIRTY_TYPE; i++)
+		free(s->dirty.dirty_segmap[i]);
+	free(s->free.free_secmap);
+	free(s->free.free_segmap);
+	free(s->maps);
+	free(s->sit.sec_entries);
+	free(s->sit.sentries);
+}
+
+/* the part of update_sit_entry() victim selection depends on */
+static void sim_update_sit(struct sim *s, unsigned int blkaddr, int del)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	unsigned int segno = blkaddr >> sbi->log_blocks_per_seg;
+	unsigned int offset = blkaddr & (sbi->blocks_per_seg - 1);
+	struct seg_entry *se = get_seg_entry(sbi, segno);
+
+	se->valid_blocks += del;
+	se->mtime = get_mtime(sbi);
+	update_max_mtime(SIT_I(sbi), se->mtime);
+
+	if (del > 0)
+		f2fs_bug_on(sbi, f2fs_test_and_set_bit(offset,
+					(char *)se->cur_valid_map));
+	else
+		f2fs_bug_on(sbi, !f2fs_test_and_clear_bit(offset,
+					(char *)se->cur_valid_map));
+
+	if (sbi->segs_per_sec > 1)
+		get_sec_entry(sbi, segno)->valid_blocks += del;
+}
+
+/* __set_inuse() */
+static void sim_set_inuse(struct sim *s, unsigned int segno)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
+
+	set_bit(segno, s->free.free_segmap);
+	s->free.free_segments--;
+	if (!test_and_set_bit(secno, s->free.free_secmap))
+		s->free.free_sections--;
+}
+
+/* __set_test_and_free() */
+static void sim_set_free(struct sim *s, unsigned int segno)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
+	unsigned int start = GET_SEG_FROM_SEC(sbi, secno);
+
+	if (!test_and_clear_bit(segno, s->free.free_segmap))
+		return;
+	s->free.free_segments++;
+	if (find_next_bit(s->free.free_segmap, start + sbi->segs_per_sec,
+				start) >= start + sbi->segs_per_sec &&
+			test_and_clear_bit(secno, s->free.free_secmap))
+		s->free.free_sections++;
+}
+
+/*
+ * get_new_segment(), always allocating to the right: the next free segment
+ * of the current section, or else the next free section.
+ */
+static int sim_new_curseg(struct sim *s, int type)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	struct curseg_info *curseg = CURSEG_I(sbi, type);
+	unsigned int hint = curseg->segno, segno, secno;
+
+	if (hint != NULL_SEGNO && (hint + 1) % sbi->segs_per_sec) {
+		unsigned int end = GET_SEG_FROM_SEC(sbi,
+					GET_SEC_FROM_SEG(sbi, hint) + 1);
+
+		segno = find_next_zero_bit(s->free.free_segmap, end, hint + 1);
+		if (segno < end)
+			goto got_it;
+	}
+
+	secno = hint == NULL_SEGNO ? 0 : GET_SEC_FROM_SEG(sbi, hint);
+	secno = find_next_zero_bit(s->free.free_secmap, MAIN_SECS(sbi), secno);
+	if (secno >= MAIN_SECS(sbi))
+		secno = find_next_zero_bit(s->free.free_secmap,
+						MAIN_SECS(sbi), 0);
+	if (secno >= MAIN_SECS(sbi))
+		return -ENOSPC;
+	segno = GET_SEG_FROM_SEC(sbi, secno);
+got_it:
+	sim_set_inuse(s, segno);
+	curseg->segno = segno;
+	curseg->next_blkoff = 0;
+	curseg->alloc_type = LFS;
+	get_seg_entry(sbi, segno)->type = curseg_sit_type(type);
+	return 0;
+}
+
+/* __next_free_blkoff(): SSR writes to blocks free in both bitmaps */
+static unsigned int sim_next_free_blkoff(struct sim *s, unsigned int segno,
+						unsigned int start)
+{
+	struct seg_entry *se = get_seg_entry(&s->sbi, segno);
+
+	for (; start < s->sbi.blocks_per_seg; start++)
+		if (!f2fs_test_bit(start, (char *)se->cur_valid_map) &&
+			!f2fs_test_bit(start, (char *)se->ckpt_valid_map))
+			break;
+	return start;
+}
+
+/* change_curseg() */
+static void sim_change_curseg(struct sim *s, int type)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	struct curseg_info *curseg = CURSEG_I(sbi, type);
+	unsigned int segno = curseg->next_segno;
+
+	__remove_dirty_segment(sbi, segno, PRE);
+	__remove_dirty_segment(sbi, segno, DIRTY);
+
+	curseg->segno = segno;
+	curseg->next_segno = NULL_SEGNO;
+	curseg->alloc_type = SSR;
+	curseg->next_blkoff = sim_next_free_blkoff(s, segno, 0);
+	get_seg_entry(sbi, segno)->type = curseg_sit_type(type);
+}
+
+/* allocate_segment_by_default(), once the current segment is full */
+static int sim_allocate_segment(struct sim *s, int type)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	struct curseg_info *curseg = CURSEG_I(sbi, type);
+	unsigned int old_segno = curseg->segno;
+	unsigned int next = old_segno + 1;
+	int err = 0;
+
+	if (curseg->alloc_type == LFS && next < MAIN_SEGS(sbi) &&
+			next % sbi->segs_per_sec &&
+			!test_bit(next, s->free.free_segmap)) {
+		err = sim_new_curseg(s, type);
+	} else if (need_SSR(sbi) && get_ssr_segment(sbi, type)) {
+		sim_change_curseg(s, type);
+		/* a fully reused segment gives nothing, go on with LFS */
+		if (curseg->next_blkoff >= sbi->blocks_per_seg) {
+			unsigned int segno = curseg->segno;
+
+			err = sim_new_curseg(s, type);
+			locate_dirty_segment(sbi, segno);
+		}
+	} else {
+		err = sim_new_curseg(s, type);
+	}
+
+	locate_dirty_segment(sbi, old_segno);
+	return err;
+}
+
+static void sim_invalidate(struct sim *s, unsigned int lba)
+{
+	unsigned int old = s->l2p[lba];
+
+	if (old == INVALID_BLK)
+		return;
+	s->l2p[lba] = INVALID_BLK;
+	s->p2l[old] = INVALID_BLK;
+	sim_update_sit(s, old, -1);
+	locate_dirty_segment(&s->sbi, old >> s->sbi.log_blocks_per_seg);
+}
+
+/* f2fs_allocate_data_block() for a block of @lba written by users or GC */
+static int sim_write(struct sim *s, unsigned int lba, int hint, bool gc)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	struct page page = {
+		.mapping = &s->mappings[hint],
+		.cold = gc,
+	};
+	struct f2fs_io_info fio = {
+		.sbi = sbi,
+		.type = DATA,
+		.page = &page,
+		.old_blkaddr = s->l2p[lba],
+	};
+	struct curseg_info *curseg;
+	unsigned int segno, blkaddr;
+	int type, err;
+
+	type = __get_segment_type_6(&fio);
+	curseg = CURSEG_I(sbi, type);
+	if (curseg->segno == NULL_SEGNO) {
+		err = sim_new_curseg(s, type);
+		if (err)
+			return err;
+	}
+
+	segno = curseg->segno;
+	blkaddr = (segno << sbi->log_blocks_per_seg) + curseg->next_blkoff;
+	if (curseg->alloc_type == SSR)
+		s->st.ssr_blocks++;
+
+	sim_update_sit(s, blkaddr, 1);
+	sim_invalidate(s, lba);
+	s->l2p[lba] = blkaddr;
+	s->p2l[blkaddr] = lba;
+
+	if (curseg->alloc_type == SSR)
+		curseg->next_blkoff = sim_next_free_blkoff(s, segno,
+						curseg->next_blkoff + 1);
+	else
+		curseg->next_blkoff++;
+
+	err = 0;
+	if (curseg->next_blkoff >= sbi->blocks_per_seg)
+		err = sim_allocate_segment(s, type);
+	locate_dirty_segment(sbi, segno);
+	return err;
+}
+
+/* flush_sit_entries() and clear_prefree_segments() of a checkpoint */
+static void sim_checkpoint(struct sim *s)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	unsigned int map_size = sbi->blocks_per_seg / 8;
+	unsigned int segno;
+
+	for (segno = 0; segno < MAIN_SEGS(sbi); segno++) {
+		struct seg_entry *se = get_seg_entry(sbi, segno);
+
+		memcpy(se->ckpt_valid_map, se->cur_valid_map, map_size);
+		if (se->ckpt_valid_blocks == se->valid_blocks)
+			continue;
+		se->ckpt_valid_blocks = se->valid_blocks;
+		__refresh_ssr_entry(sbi, segno);
+	}
+
+	for_each_set_bit(segno, DIRTY_I(sbi)->dirty_segmap[PRE],
+							MAIN_SEGS(sbi)) {
+		sim_set_free(s, segno);
+		clear_bit(segno, DIRTY_I(sbi)->dirty_segmap[PRE]);
+		DIRTY_I(sbi)->nr_dirty[PRE]--;
+	}
+
+	s->last_cp = get_mtime(sbi);
+	s->st.checkpoints++;
+}
+
+/* do_garbage_collect() of a victim section, moving blocks to the cold log */
+static int sim_collect(struct sim *s, unsigned int segno)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
+	unsigned int start = GET_SEG_FROM_SEC(sbi, secno);
+	unsigned int end = start + sbi->segs_per_sec, off;
+	int err;
+
+	s->st.victims++;
+	for (segno = start; segno < end; segno++) {
+		struct seg_entry *se = get_seg_entry(sbi, segno);
+
+		for (off = 0; off < sbi->blocks_per_seg; off++) {
+			unsigned int blkaddr;
+
+			if (!f2fs_test_bit(off, (char *)se->cur_valid_map))
+				continue;
+			blkaddr = (segno << sbi->log_blocks_per_seg) + off;
+			err = sim_write(s, s->p2l[blkaddr], HINT_NONE, true);
+			if (err)
+				return err;
+			s->st.gc_blocks++;
+		}
+	}
+	return 0;
+}
+
+/* f2fs_balance_fs(): FG_GC until the reserved sections are free again */
+static int sim_balance(struct sim *s)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	unsigned int sec_freed = 0, segno, secno;
+	int err;
+
+	if (free_sections(sbi) > reserved_sections(sbi))
+		return 0;
+
+	while (free_sections(sbi) + sec_freed <= reserved_sections(sbi)) {
+		segno = NULL_SEGNO;
+		if (!DIRTY_I(sbi)->v_ops->get_victim(sbi, &segno, FG_GC,
+							NO_CHECK_TYPE, LFS))
+			return -ENOSPC;
+		secno = GET_SEC_FROM_SEG(sbi, segno);
+
+		err = sim_collect(s, segno);
+		clear_bit(secno, DIRTY_I(sbi)->cur_victim_secmap);
+		sbi->cur_victim_sec = NULL_SEGNO;
+		if (err)
+			return err;
+		if (!get_valid_blocks(sbi, segno, true))
+			sec_freed++;
+	}
+	sim_checkpoint(s);
+	return 0;
+}
+
+/* an idle point: the periodic checkpoint and one round of BG_GC */
+static int sim_idle(struct sim *s, const struct sim_config *cfg)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	unsigned int segno = NULL_SEGNO;
+	int err = 0;
+
+	if (cfg->bg_gc && DIRTY_I(sbi)->v_ops->get_victim(sbi, &segno, BG_GC,
+							NO_CHECK_TYPE, LFS))
+		err = sim_collect(s, segno);
+
+	if (get_mtime(sbi) >= s->last_cp + DEF_CP_INTERVAL)
+		sim_checkpoint(s);
+	return err;
+}
+
+/*
+ * Seed the SIT cache from @snap as build_sit_entries(), init_free_segmap()
+ * and init_dirty_segmap() do at mount. The valid blocks are given lbas 0,
+ * 1, ... in block address order, so that the trace can overwrite them, and
+ * the clock continues from the latest mtime.
+ */
+static int sim_load_snapshot(struct sim *s, const struct sim_snapshot *snap)
+{
+	struct f2fs_sb_info *sbi = &s->sbi;
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned int map_size = sbi->blocks_per_seg / 8;
+	unsigned int i, segno, off, lba = 0;
+	bool seeded = false;
+
+	for (i = 0; i < snap->nr_segs; i++) {
+		const struct snap_seg *ss = &snap->segs[i];
+		struct seg_entry *se;
+		unsigned int valid = 0;
+
+		if (ss->segno >= MAIN_SEGS(sbi)) {
+			fprintf(stderr, "gcsim: snapshot segment %u is out of "
+				"the %u main segments\n", ss->segno,
+				MAIN_SEGS(sbi));
+			return -EINVAL;
+		}
+
+		for (off = 0; off < sbi->blocks_per_seg; off++)
+			if (f2fs_test_bit(off, (char *)ss->map))
+				valid++;
+		if (!valid)
+			continue;
+
+		se = get_seg_entry(sbi, ss->segno);
+		se->type = ss->type;
+		se->valid_blocks = valid;
+		se->ckpt_valid_blocks = valid;
+		se->mtime = ss->mtime;
+		memcpy(se->cur_valid_map, ss->map, map_size);
+		memcpy(se->ckpt_valid_map, ss->map, map_size);
+		if (sbi->segs_per_sec > 1)
+			get_sec_entry(sbi, ss->segno)->valid_blocks += valid;
+
+		if (!seeded || ss->mtime < sit_i->min_mtime)
+			sit_i->min_mtime = ss->mtime;
+		update_max_mtime(sit_i, ss->mtime);
+		seeded = true;
+	}
+	if (sit_i->elapsed_time < sit_i->max_mtime)
+		sit_i->elapsed_time = sit_i->max_mtime;
+
+	for (segno = 0; segno < MAIN_SEGS(sbi); segno++) {
+		struct seg_entry *se = get_seg_entry(sbi, segno);
+
+		if (!se->valid_blocks)
+			continue;
+		sim_set_inuse(s, segno);
+
+		for (off = 0; off < sbi->blocks_per_seg; off++) {
+			unsigned int blkaddr;
+
+			if (!f2fs_test_bit(off, (char *)se->cur_valid_map))
+				continue;
+			if (lba >= s->user_blocks) {
+				fprintf(stderr, "gcsim: snapshot holds more "
+					"than the %u user blocks\n",
+					s->user_blocks);
+				return -ENOSPC;
+			}
+			blkaddr = (segno << sbi->log_blocks_per_seg) + off;
+			s->l2p[lba] = blkaddr;
+			s->p2l[blkaddr] = lba++;
+		}
+		locate_dirty_segment(sbi, segno);
+	}
+	return 0;
+}
+
+static int sim_replay(struct sim *s, const struct sim_config *cfg,
+				const struct sim_trace *trace)
+{
+	unsigned int i, lba;
+	int err = 0;
+
+	for (i = 0; i < trace->nr_recs && !err; i++) {
+		const struct sim_record *r = &trace->recs[i];
+
+		switch (r->op) {
+		case 'W':
+			for (lba = r->lba; lba < r->lba + r->len && !err;
+								lba++) {
+				err = sim_balance(s);
+				if (!err)
+					err = sim_write(s, lba, r->hint, false);
+				s->st.user_blocks++;
+			}
+			break;
+		case 'D':
+			for (lba = r->lba; lba < r->lba + r->len; lba++)
+				sim_invalidate(s, lba);
+			break;
+		case 'T':
+			SIT_I(&s->sbi)->elapsed_time += r->len;
+			err = sim_idle(s, cfg);
+			break;
+		case 'C':
+			sim_checkpoint(s);
+			break;
+		}
+	}
+	return err;
+}
+
+static int parse_trace(const char *path, struct sim_trace *trace)
+{
+	unsigned int size = 0, lineno = 0;
+	char line[256], op, hint[16];
+	FILE *fp;
+	int n;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "gcsim: %s: %s\n", path, strerror(errno));
+		return -errno;
+	}
+
+	memset(trace, 0, sizeof(*trace));
+	while (fgets(line, sizeof(line), fp)) {
+		struct sim_record r = { 0 };
+
+		lineno++;
+		if (sscanf(line, " %c", &op) != 1 || op == '#')
+			continue;
+
+		r.op = op;
+		hint[0] = '\0';
+		switch (op) {
+		case 'W':
+		case 'D':
+			n = sscanf(line, " %*c %u %u %15s",
+						&r.lba, &r.len, hint);
+			if (n < 2 || !r.len)
+				goto bad;
+			if (!strcmp(hint, "hot"))
+				r.hint = HINT_HOT;
+			else if (!strcmp(hint, "cold"))
+				r.hint = HINT_COLD;
+			else if (hint[0])
+				goto bad;
+			if (r.lba + r.len > trace->max_lba)
+				trace->max_lba = r.lba + r.len;
+			break;
+		case 'T':
+			if (sscanf(line, " %*c %u", &r.len) != 1)
+				goto bad;
+			break;
+		case 'C':
+			break;
+		default:
+			goto bad;
+		}
+
+		if (trace->nr_recs == size) {
+			size = size ? size * 2 : 1024;
+			trace->recs = realloc(trace->recs,
+					size * sizeof(struct sim_record));
+			if (!trace->recs) {
+				fprintf(stderr, "gcsim: out of memory\n");
+				exit(1);
+			}
+		}
+		trace->recs[trace->nr_recs++] = r;
+	}
+	fclose(fp);
+	return 0;
+bad:
+	fprintf(stderr, "gcsim: %s:%u: bad record: %s", path, lineno, line);
+	fclose(fp);
+	return -EINVAL;
+}
+
+/* snapshot lines are "segno type mtime valid_map", segments ascending */
+static int parse_snapshot(const char *path, unsigned int map_size,
+					struct sim_snapshot *snap)
+{
+	unsigned int size = 0, lineno = 0, i;
+	char line[256], map[2 * MAX_MAP_SIZE + 2];
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "gcsim: %s: %s\n", path, strerror(errno));
+		return -errno;
+	}
+
+	memset(snap, 0, sizeof(*snap));
+	while (fgets(line, sizeof(line), fp)) {
+		struct snap_seg ss = { 0 };
+		char c;
+
+		lineno++;
+		if (sscanf(line, " %c", &c) != 1 || c == '#')
+			continue;
+
+		if (sscanf(line, "%u %u %llu %129s", &ss.segno, &ss.type,
+					&ss.mtime, map) != 4 ||
+				ss.type > CURSEG_COLD_NODE ||
+				strlen(map) != 2 * map_size ||
+				(snap->nr_segs &&
+				ss.segno <= snap->segs[snap->nr_segs - 1].segno))
+			goto bad;
+		for (i = 0; i < map_size; i++)
+			if (sscanf(map + 2 * i, "%2hhx", &ss.map[i]) != 1)
+				goto bad;
+
+		if (snap->nr_segs == size) {
+			size = size ? size * 2 : 1024;
+			snap->segs = realloc(snap->segs,
+					size * sizeof(struct snap_seg));
+			if (!snap->segs) {
+				fprintf(stderr, "gcsim: out of memory\n");
+				exit(1);
+			}
+		}
+		snap->segs[snap->nr_segs++] = ss;
+	}
+	fclose(fp);
+	return 0;
+bad:
+	fprintf(stderr, "gcsim: %s:%u: bad segment: %s", path, lineno, line);
+	fclose(fp);
+	return -EINVAL;
+}
+
+static void report(const struct sim_policy *pol, const struct sim_stats *st,
+							int err)
+{
+	u64 selects = st->selects[0] + st->selects[1];
+	u64 select_ns = st->select_ns[0] + st->select_ns[1];
+
+	printf("%-11s %10llu %10llu %6.3f %8llu %9.1f %10llu %9llu %9.3f %7.2f%s\n",
+		pol->name,
+		(unsigned long long)st->user_blocks,
+		(unsigned long long)st->gc_blocks,
+		st->user_blocks ? (double)(st->user_blocks + st->gc_blocks) /
+						st->user_blocks : 0.0,
+		(unsigned long long)st->victims,
+		st->victims ? (double)st->gc_blocks / st->victims : 0.0,
+		(unsigned long long)st->ssr_blocks,
+		(unsigned long long)selects,
+		select_ns / 1e6,
+		selects ? select_ns / 1e3 / selects : 0.0,
+		err ? "  (out of space)" : "");
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+"usage: gcsim [options] trace\n"
+"  -S snapshot     seed the main area from a SIT snapshot\n"
+"  -n segments     main area segments (default 1024)\n"
+"  -l log_blocks   log2 of blocks per segment (default 6)\n"
+"  -s segs         segments per section (default 1)\n"
+"  -o percent      overprovision ratio (default 7)\n"
+"  -a secs         gc_age_threshold of the at policies (default 600)\n"
+"  -p list         comma separated policies, of cb, greedy, at and the\n"
+"                  same with +ssr (default all)\n"
+"  -b              run BG_GC at every 'T' record\n"
+"  -I              scan dirty segmaps instead of the victim indexes\n"
+"\n"
+"trace records, one per line:\n"
+"  W lba len [hot|cold]  write len blocks, optionally of a hot/cold file\n"
+"  D lba len             discard len blocks\n"
+"  T secs                advance the clock, an idle point\n"
+"  C                     checkpoint\n"
+"\n"
+"snapshot lines, one per segment in use, in ascending segno order:\n"
+"  segno type mtime map  type 0-5 as CURSEG_XXX, mtime in secs, and the\n"
+"                        valid map of f2fs_sit_entry in hex\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct sim_config cfg = {
+		.main_segs = 1024,
+		.log_blocks_per_seg = 6,
+		.segs_per_sec = 1,
+		.ovp_ratio = 7,
+		.age_threshold = 600,
+	};
+	const char *policies = NULL, *snapshot = NULL;
+	struct sim_snapshot snap = { 0 };
+	struct sim_trace trace;
+	struct sim *s;
+	unsigned int i, header = 0;
+	int c, err;
+
+	while ((c = getopt(argc, argv, "S:n:l:s:o:a:p:bI")) != -1) {
+		switch (c) {
+		case 'S':
+			snapshot = optarg;
+			break;
+		case 'n':
+			cfg.main_segs = atoi(optarg);
+			break;
+		case 'l':
+			cfg.log_blocks_per_seg = atoi(optarg);
+			break;
+		case 's':
+			cfg.segs_per_sec = atoi(optarg);
+			break;
+		case 'o':
+			cfg.ovp_ratio = atoi(optarg);
+			break;
+		case 'a':
+			cfg.age_threshold = atoi(optarg);
+			break;
+		case 'p':
+			policies = optarg;
+			break;
+		case 'b':
+			cfg.bg_gc = true;
+			break;
+		case 'I':
+			cfg.no_index = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+
+	/* valid_blocks of seg_entry is 10 bits wide */
+	if (cfg.log_blocks_per_seg < 3 || cfg.log_blocks_per_seg > 9 ||
+			!cfg.segs_per_sec || !cfg.ovp_ratio ||
+			cfg.ovp_ratio >= 100 ||
+			cfg.main_segs < cfg.segs_per_sec) {
+		fprintf(stderr, "gcsim: bad geometry\n");
+		return 1;
+	}
+	/* as the gc_age_threshold sysfs entry */
+	if (cfg.age_threshold < MIN_GC_AGE_THRESHOLD) {
+		fprintf(stderr, "gcsim: age threshold below %u\n",
+						MIN_GC_AGE_THRESHOLD);
+		return 1;
+	}
+
+	if (snapshot && parse_snapshot(snapshot,
+				(1 << cfg.log_blocks_per_seg) / 8, &snap))
+		return 1;
+	err = parse_trace(argv[optind], &trace);
+	if (err)
+		return 1;
+
+	s = zalloc(sizeof(*s));
+	for (i = 0; i < NR_SIM_POLICIES; i++) {
+		const struct sim_policy *pol = &sim_policies[i];
+
+		if (policies) {
+			char list[256];
+			char *tok, *save;
+			bool found = false;
+
+			snprintf(list, sizeof(list), "%s", policies);
+			for (tok = strtok_r(list, ",", &save); tok;
+					tok = strtok_r(NULL, ",", &save))
+				if (!strcmp(tok, pol->name))
+					found = true;
+			if (!found)
+				continue;
+		}
+
+		if (sim_init(s, &cfg, pol) ||
+				(snapshot && sim_load_snapshot(s, &snap)))
+			return 1;
+		if (trace.max_lba > s->user_blocks) {
+			fprintf(stderr, "gcsim: trace addresses %u blocks, "
+				"the volume holds %u\n",
+				trace.max_lba, s->user_blocks);
+			return 1;
+		}
+		if (!header++)
+			printf("%-11s %10s %10s %6s %8s %9s %10s %9s %9s %7s\n",
+				"policy", "user_blks", "gc_blks", "WAF",
+				"victims", "cost/vic", "ssr_blks", "selects",
+				"sel_ms", "us/sel");
+		err = sim_replay(s, &cfg, &trace);
+		report(pol, &s->st, err);
+		sim_exit(s);
+	}
+
+	free(s);
+	free(snap.segs);
+	free(trace.recs);
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * gentrace - generates the gcsim fixtures used by "make check"
+ *
+ *   gentrace trace	hot/cold overwrite trace
+ *   gentrace snapshot	SIT snapshot of an aged volume
+ *
+ * Both fit the default gcsim geometry, 1024 segments of 64 blocks with 7%
+ * overprovision, and use their own PRNG so that every host generates the
+ * same files.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#define MAIN_SEGS		1024
+#define BLOCKS_PER_SEG		64
+
+/* trace: regions of the 60992 user blocks */
+#define HOT_END			11200
+#define WARM_END		50400
+#define COLD_END		56000
+#define FILL_EXTENT		64
+#define NR_OVERWRITES		6000
+#define MAX_OVERWRITE		24
+#define HOT_PERCENT		80
+#define WRITES_PER_TICK		50
+#define TICK_SECS		10
+
+/* snapshot: in-use segments and their age */
+#define SNAP_SEGS		800
+#define SNAP_MAX_AGE		(7 * 24 * 60 * 60)
+
+static unsigned int seed = 2463534242U;
+
+/* xorshift32 */
+static unsigned int rnd(unsigned int n)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed % n;
+}
+
+static void write_rec(unsigned int lba, unsigned int len, const char *hint)
+{
+	static unsigned int nr_writes;
+
+	printf("W %u %u%s%s\n", lba, len, hint ? " " : "", hint ? hint : "");
+	if (!(++nr_writes % WRITES_PER_TICK))
+		printf("T %u\n", TICK_SECS);
+}
+
+static void fill(unsigned int start, unsigned int end, const char *hint)
+{
+	unsigned int lba, len;
+
+	for (lba = start; lba < end; lba += len) {
+		len = end - lba < FILL_EXTENT ? end - lba : FILL_EXTENT;
+		write_rec(lba, len, hint);
+	}
+}
+
+static void gen_trace(void)
+{
+	unsigned int i, len;
+
+	printf("# hotcold.trace - generated by gentrace for gcsim "
+		"(1024 segments of 64 blocks, 7%% OP)\n"
+		"#\n"
+		"# Fills %u of the 60992 user blocks, in %u block extents, "
+		"then issues\n"
+		"# %u random overwrites of 1-%u blocks: %u%% of them to the "
+		"hot region\n"
+		"# [0, %u) through a hot file, the rest to the warm region "
+		"[%u, %u).\n"
+		"# The archive region [%u, %u) is written once through a "
+		"cold file.\n"
+		"# A checkpoint follows the first half of the overwrites, "
+		"and a 'T %u'\n"
+		"# record every %u writes.\n"
+		"#\n",
+		COLD_END, FILL_EXTENT, NR_OVERWRITES, MAX_OVERWRITE,
+		HOT_PERCENT, HOT_END, HOT_END, WARM_END, WARM_END, COLD_END,
+		TICK_SECS, WRITES_PER_TICK);
+
+	fill(0, HOT_END, "hot");
+	fill(HOT_END, WARM_END, NULL);
+	fill(WARM_END, COLD_END, "cold");
+
+	for (i = 0; i < NR_OVERWRITES; i++) {
+		if (i == NR_OVERWRITES / 2)
+			printf("C\n");
+		len = rnd(MAX_OVERWRITE) + 1;
+		if (rnd(100) < HOT_PERCENT)
+			write_rec(rnd(HOT_END - len + 1), len, "hot");
+		else
+			write_rec(HOT_END + rnd(WARM_END - HOT_END - len + 1),
+								len, NULL);
+	}
+}
+
+/*
+ * SNAP_SEGS segments spread over the main area, of every data temperature,
+ * each holding a uniformly random share of valid blocks.
+ */
+static void gen_snapshot(void)
+{
+	unsigned char map[BLOCKS_PER_SEG / 8];
+	unsigned int segno, off, i, util;
+
+	printf("# aged.snap - generated by gentrace for gcsim "
+		"(1024 segments of 64 blocks)\n"
+		"#\n"
+		"# %u of the segments in use, with up to %u secs old mtimes.\n"
+		"# segno type mtime valid_map\n",
+		SNAP_SEGS, SNAP_MAX_AGE);
+
+	for (segno = 0; segno < MAIN_SEGS; segno++) {
+		if (rnd(MAIN_SEGS) >= SNAP_SEGS)
+			continue;
+
+		util = rnd(BLOCKS_PER_SEG + 1);
+		memset(map, 0, sizeof(map));
+		for (off = 0; off < BLOCKS_PER_SEG; off++)
+			if (rnd(BLOCKS_PER_SEG) < util)
+				map[off >> 3] |= 0x80 >> (off & 7);
+
+		printf("%u %u %u ", segno, rnd(3), rnd(SNAP_MAX_AGE));
+		for (i = 0; i < sizeof(map); i++)
+			printf("%02x", map[i]);
+		printf("\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 2 && !strcmp(argv[1], "trace"))
+		gen_trace();
+	else if (argc == 2 && !strcmp(argv[1], "snapshot"))
+		gen_snapshot();
+	else {
+		fprintf(stderr, "usage: gentrace trace|snapshot\n");
+		return 1;
+	}
+	return 0;
+}
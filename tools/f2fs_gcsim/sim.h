@@ -0,0 +1,556 @@
+/*
+ * sim.h - userspace stand-ins for the kernel and f2fs definitions that the
+ * victim selection code of gc.c and segment.c needs.
+ *
+ * Only the fields and helpers used by the functions listed in the Makefile
+ * are modelled. Structures keep the f2fs names and field names, so that the
+ * extracted code compiles unchanged; locks are no-ops since the simulator
+ * is single threaded.
+ */
+#ifndef _GCSIM_SIM_H
+#define _GCSIM_SIM_H
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* kernel basics */
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t s64;
+typedef uint32_t block_t;
+typedef uint32_t nid_t;
+
+#define likely(x)		__builtin_expect(!!(x), 1)
+#define unlikely(x)		__builtin_expect(!!(x), 0)
+
+#define min(a, b)		((a) < (b) ? (a) : (b))
+#define max(a, b)		((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)		((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b)		((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define div_u64(a, b)		((u64)(a) / (b))
+#define div64_u64(a, b)		((u64)(a) / (u64)(b))
+
+#define BITS_PER_LONG		(8 * (int)sizeof(long))
+#define BIT_WORD(nr)		((nr) / BITS_PER_LONG)
+#define BIT_MASK(nr)		(1UL << ((nr) % BITS_PER_LONG))
+#define BITS_TO_LONGS(nr)	(((nr) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define hweight_long(w)		__builtin_popcountl(w)
+
+static inline int test_bit(unsigned int nr, const unsigned long *addr)
+{
+	return !!(addr[BIT_WORD(nr)] & BIT_MASK(nr));
+}
+
+static inline void set_bit(unsigned int nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] |= BIT_MASK(nr);
+}
+
+static inline void clear_bit(unsigned int nr, unsigned long *addr)
+{
+	addr[BIT_WORD(nr)] &= ~BIT_MASK(nr);
+}
+
+static inline int test_and_set_bit(unsigned int nr, unsigned long *addr)
+{
+	int old = test_bit(nr, addr);
+
+	set_bit(nr, addr);
+	return old;
+}
+
+static inline int test_and_clear_bit(unsigned int nr, unsigned long *addr)
+{
+	int old = test_bit(nr, addr);
+
+	clear_bit(nr, addr);
+	return old;
+}
+
+static inline unsigned int find_next_bit(const unsigned long *addr,
+				unsigned int size, unsigned int offset)
+{
+	unsigned long word;
+
+	if (offset >= size)
+		return size;
+	word = addr[BIT_WORD(offset)] & (~0UL << (offset % BITS_PER_LONG));
+	offset -= offset % BITS_PER_LONG;
+	while (!word) {
+		offset += BITS_PER_LONG;
+		if (offset >= size)
+			return size;
+		word = addr[BIT_WORD(offset)];
+	}
+	return min(offset + __builtin_ctzl(word), size);
+}
+
+static inline unsigned int find_next_zero_bit(const unsigned long *addr,
+				unsigned int size, unsigned int offset)
+{
+	for (; offset < size; offset++)
+		if (!test_bit(offset, addr))
+			return offset;
+	return size;
+}
+
+#define for_each_set_bit(bit, addr, size)				\
+	for ((bit) = find_next_bit((addr), (size), 0);			\
+	     (bit) < (size);						\
+	     (bit) = find_next_bit((addr), (size), (bit) + 1))
+
+/* f2fs bitmaps are MSB first in each byte */
+static inline int f2fs_test_bit(unsigned int nr, char *addr)
+{
+	return addr[nr >> 3] & (1 << (7 - (nr & 0x07)));
+}
+
+static inline int f2fs_test_and_set_bit(unsigned int nr, char *addr)
+{
+	int old = f2fs_test_bit(nr, addr);
+
+	addr[nr >> 3] |= 1 << (7 - (nr & 0x07));
+	return old;
+}
+
+static inline int f2fs_test_and_clear_bit(unsigned int nr, char *addr)
+{
+	int old = f2fs_test_bit(nr, addr);
+
+	addr[nr >> 3] &= ~(1 << (7 - (nr & 0x07)));
+	return old;
+}
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define container_of(ptr, type, member)					\
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#define list_entry(ptr, type, member)	container_of(ptr, type, member)
+#define list_for_each_entry(pos, head, member)				\
+	for (pos = list_entry((head)->next, __typeof__(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+	return head->next == head;
+}
+
+static inline void list_add_tail(struct list_head *new,
+					struct list_head *head)
+{
+	new->prev = head->prev;
+	new->next = head;
+	head->prev->next = new;
+	head->prev = new;
+}
+
+static inline void list_del_init(struct list_head *entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	INIT_LIST_HEAD(entry);
+}
+
+struct mutex {
+	int unused;
+};
+static inline void mutex_lock(struct mutex *lock) { }
+static inline void mutex_unlock(struct mutex *lock) { }
+
+#define READ_ONCE(x)		(x)
+
+#define f2fs_bug_on(sbi, cond)	assert(!(cond))
+#define trace_f2fs_get_victim(...)	do { } while (0)
+
+/* f2fs.h */
+#define MAX_STREAM_LOGS		8
+#define MAX_ALLOC_SHARDS	8
+#define NR_CURSEG_DATA_TYPE	3
+#define NR_CURSEG_NODE_TYPE	3
+#define NR_CURSEG_TYPE		(NR_CURSEG_DATA_TYPE + NR_CURSEG_NODE_TYPE)
+
+enum {
+	CURSEG_HOT_DATA = 0,
+	CURSEG_WARM_DATA,
+	CURSEG_COLD_DATA,
+	CURSEG_HOT_NODE,
+	CURSEG_WARM_NODE,
+	CURSEG_COLD_NODE,
+	CURSEG_STREAM_DATA,
+	CURSEG_SHARD_DATA = CURSEG_STREAM_DATA + MAX_STREAM_LOGS,
+	NO_CHECK_TYPE = CURSEG_SHARD_DATA + MAX_ALLOC_SHARDS,
+};
+
+enum page_type {
+	DATA,
+	NODE,
+};
+
+enum rw_hint {
+	WRITE_LIFE_NOT_SET = 0,
+	WRITE_LIFE_NONE,
+	WRITE_LIFE_SHORT,
+	WRITE_LIFE_MEDIUM,
+	WRITE_LIFE_LONG,
+	WRITE_LIFE_EXTREME,
+};
+
+#define GC_AGE_HIST_BUCKETS	8
+#define GC_AGE_HIST_YOUNG	3
+
+/* gc.h */
+#define MIN_GC_AGE_THRESHOLD	(1 << (GC_AGE_HIST_YOUNG - 1))
+#define GC_AGE_HIST_INTERVAL	60
+
+#define F2FS_MOUNT_LFS		0x00000001
+#define test_opt(sbi, option)	((sbi)->mount_opt & F2FS_MOUNT_##option)
+
+/* segment.h */
+#define NULL_SEGNO		((unsigned int)(~0))
+
+enum {
+	LFS = 0,
+	SSR
+};
+
+enum {
+	GC_CB = 0,
+	GC_GREEDY,
+	GC_AT,
+	ALLOC_NEXT,
+	FLUSH_DEVICE,
+	MAX_GC_POLICY,
+};
+
+enum {
+	BG_GC = 0,
+	FG_GC,
+	FORCE_FG_GC,
+};
+
+enum dirty_type {
+	DIRTY_HOT_DATA,
+	DIRTY_WARM_DATA,
+	DIRTY_COLD_DATA,
+	DIRTY_HOT_NODE,
+	DIRTY_WARM_NODE,
+	DIRTY_COLD_NODE,
+	DIRTY,
+	PRE,
+	NR_DIRTY_TYPE
+};
+
+struct victim_sel_policy {
+	int alloc_mode;
+	int gc_mode;
+	unsigned long *dirty_segmap;
+	unsigned int max_search;
+	unsigned int offset;
+	unsigned int ofs_unit;
+	unsigned int min_cost;
+	unsigned int min_segno;
+};
+
+struct seg_entry {
+	unsigned int type:6;
+	unsigned int valid_blocks:10;
+	unsigned int ckpt_valid_blocks:10;
+	unsigned int padding:6;
+	unsigned char *cur_valid_map;
+	unsigned char *ckpt_valid_map;
+	unsigned long long mtime;
+};
+
+struct sec_entry {
+	unsigned int valid_blocks;
+};
+
+struct sit_info {
+	struct seg_entry *sentries;
+	struct sec_entry *sec_entries;
+	unsigned long long elapsed_time;
+	unsigned long long min_mtime;
+	unsigned long long max_mtime;
+	unsigned int last_victim[MAX_GC_POLICY];
+};
+
+struct free_segmap_info {
+	unsigned int free_segments;
+	unsigned int free_sections;
+	unsigned long *free_segmap;
+	unsigned long *free_secmap;
+};
+
+struct victim_entry {
+	struct list_head list;
+	unsigned int vblocks;
+};
+
+struct victim_index {
+	struct list_head *buckets;
+	unsigned long *bucket_map;
+	struct victim_entry *entries;
+	unsigned int nr_buckets;
+	unsigned int nr_entries;
+};
+
+struct f2fs_sb_info;
+
+struct victim_selection {
+	int (*get_victim)(struct f2fs_sb_info *, unsigned int *,
+							int, int, char);
+};
+
+struct dirty_seglist_info {
+	const struct victim_selection *v_ops;
+	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
+	struct mutex seglist_lock;
+	int nr_dirty[NR_DIRTY_TYPE];
+	unsigned long *victim_secmap;
+	unsigned long *cur_victim_secmap;
+	struct victim_index vindex;
+	struct victim_index ssr_index[DIRTY];
+	struct victim_entry *ssr_entries;
+	unsigned long *stale_segmap;
+};
+
+struct curseg_info {
+	unsigned char alloc_type;
+	unsigned int segno;
+	unsigned short next_blkoff;
+	unsigned int next_segno;
+};
+
+struct f2fs_sm_info {
+	struct sit_info *sit_info;
+	struct free_segmap_info *free_info;
+	struct dirty_seglist_info *dirty_info;
+	struct curseg_info *curseg_array;
+	unsigned int main_segments;
+	unsigned int reserved_segments;
+	unsigned int ovp_segments;
+	unsigned int min_ssr_sections;
+};
+
+struct f2fs_gc_kthread {
+	unsigned int gc_idle;
+	unsigned int gc_urgent;
+};
+
+struct f2fs_sb_info {
+	void *sb;
+	struct f2fs_sm_info *sm_info;
+	struct f2fs_gc_kthread *gc_thread;
+	unsigned int mount_opt;
+	unsigned int log_blocks_per_seg;
+	unsigned int blocks_per_seg;
+	unsigned int segs_per_sec;
+	unsigned int total_sections;
+	unsigned int cur_victim_sec;
+	u64 fggc_threshold;
+	unsigned int max_victim_search;
+	unsigned int gc_victim_index;
+	unsigned int ssr_victim_index;
+	unsigned int gc_age_threshold;
+	unsigned int gc_age_hist[GC_AGE_HIST_BUCKETS];
+	unsigned long long gc_age_hist_time;
+	unsigned int nr_stream_logs;
+	unsigned int nr_alloc_shards;
+	unsigned int temp_classify;
+};
+
+#define SM_I(sbi)		((sbi)->sm_info)
+#define SIT_I(sbi)		(SM_I(sbi)->sit_info)
+#define FREE_I(sbi)		(SM_I(sbi)->free_info)
+#define DIRTY_I(sbi)		(SM_I(sbi)->dirty_info)
+
+#define IS_VOLATILE_LOG(t)	\
+	((t) >= CURSEG_STREAM_DATA && (t) < NO_CHECK_TYPE)
+#define IS_DATASEG(t)	((t) <= CURSEG_COLD_DATA || IS_VOLATILE_LOG(t))
+#define IS_NODESEG(t)	((t) >= CURSEG_HOT_NODE && (t) <= CURSEG_COLD_NODE)
+
+#define MAIN_SEGS(sbi)		(SM_I(sbi)->main_segments)
+#define MAIN_SECS(sbi)		((sbi)->total_sections)
+#define BLKS_PER_SEC(sbi)	((sbi)->segs_per_sec * (sbi)->blocks_per_seg)
+#define GET_SEC_FROM_SEG(sbi, segno)	((segno) / (sbi)->segs_per_sec)
+#define GET_SEG_FROM_SEC(sbi, secno)	((secno) * (sbi)->segs_per_sec)
+
+static inline struct curseg_info *CURSEG_I(struct f2fs_sb_info *sbi, int type)
+{
+	return SM_I(sbi)->curseg_array + type;
+}
+
+/* the simulator has no volatile logs, see nr_stream_logs/nr_alloc_shards */
+static inline bool IS_CURSEG(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	int i;
+
+	for (i = 0; i < NR_CURSEG_TYPE; i++)
+		if (CURSEG_I(sbi, i)->segno == segno)
+			return true;
+	return false;
+}
+
+static inline bool IS_CURSEC(struct f2fs_sb_info *sbi, unsigned int secno)
+{
+	int i;
+
+	for (i = 0; i < NR_CURSEG_TYPE; i++)
+		if (CURSEG_I(sbi, i)->segno != NULL_SEGNO &&
+			CURSEG_I(sbi, i)->segno / sbi->segs_per_sec == secno)
+			return true;
+	return false;
+}
+
+static inline int curseg_sit_type(int type)
+{
+	return IS_VOLATILE_LOG(type) ? CURSEG_WARM_DATA : type;
+}
+
+static inline struct seg_entry *get_seg_entry(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	return &SIT_I(sbi)->sentries[segno];
+}
+
+static inline struct sec_entry *get_sec_entry(struct f2fs_sb_info *sbi,
+						unsigned int segno)
+{
+	return &SIT_I(sbi)->sec_entries[GET_SEC_FROM_SEG(sbi, segno)];
+}
+
+static inline unsigned int get_valid_blocks(struct f2fs_sb_info *sbi,
+				unsigned int segno, bool use_section)
+{
+	if (use_section && sbi->segs_per_sec > 1)
+		return get_sec_entry(sbi, segno)->valid_blocks;
+	return get_seg_entry(sbi, segno)->valid_blocks;
+}
+
+/* the simulated clock, advanced by 'T' trace records */
+static inline unsigned long long get_mtime(struct f2fs_sb_info *sbi)
+{
+	return SIT_I(sbi)->elapsed_time;
+}
+
+static inline void update_max_mtime(struct sit_info *sit_i,
+					unsigned long long mtime)
+{
+	if (sit_i->max_mtime < mtime)
+		sit_i->max_mtime = mtime;
+}
+
+static inline unsigned int free_segments(struct f2fs_sb_info *sbi)
+{
+	return FREE_I(sbi)->free_segments;
+}
+
+static inline unsigned int free_sections(struct f2fs_sb_info *sbi)
+{
+	return FREE_I(sbi)->free_sections;
+}
+
+static inline unsigned int prefree_segments(struct f2fs_sb_info *sbi)
+{
+	return DIRTY_I(sbi)->nr_dirty[PRE];
+}
+
+static inline int reserved_segments(struct f2fs_sb_info *sbi)
+{
+	return SM_I(sbi)->reserved_segments;
+}
+
+static inline int reserved_sections(struct f2fs_sb_info *sbi)
+{
+	return GET_SEC_FROM_SEG(sbi, (unsigned int)reserved_segments(sbi));
+}
+
+/* no dirty page cache is modelled */
+#define get_blocktype_secs(sbi, type)	0
+
+static inline bool sec_usage_check(struct f2fs_sb_info *sbi,
+						unsigned int secno)
+{
+	return IS_CURSEC(sbi, secno) || sbi->cur_victim_sec == secno ||
+			test_bit(secno, DIRTY_I(sbi)->cur_victim_secmap);
+}
+
+static inline bool no_fggc_candidate(struct f2fs_sb_info *sbi,
+						unsigned int secno)
+{
+	return get_valid_blocks(sbi, GET_SEG_FROM_SEC(sbi, secno), true) >
+							sbi->fggc_threshold;
+}
+
+/* inodes and pages, as far as __get_segment_type_6() looks at them */
+#define SIM_ADVISE_COLD		0x01
+#define SIM_ADVISE_HOT		0x02
+#define FI_HOT_DATA		0
+
+struct inode {
+	struct f2fs_sb_info *sbi;
+	mode_t i_mode;
+	enum rw_hint i_write_hint;
+	unsigned char i_advise;
+	unsigned long flags;
+	unsigned int i_stream;
+};
+
+struct address_space {
+	struct inode *host;
+};
+
+struct page {
+	struct address_space *mapping;
+	bool cold;
+};
+
+struct f2fs_io_info {
+	struct f2fs_sb_info *sbi;
+	enum page_type type;
+	struct page *page;
+	block_t old_blkaddr;
+};
+
+#define F2FS_I(inode)		(inode)
+#define F2FS_I_SB(inode)	((inode)->sbi)
+#define file_is_cold(inode)	((inode)->i_advise & SIM_ADVISE_COLD)
+#define file_is_hot(inode)	((inode)->i_advise & SIM_ADVISE_HOT)
+#define is_inode_flag_set(inode, flag)	(!!((inode)->flags & (1UL << (flag))))
+#define is_cold_data(page)	((page)->cold)
+#define IS_DNODE(page)		0
+#define is_cold_node(page)	0
+
+/* GC moves every block to the cold log, see sim_collect() */
+static inline int get_gc_data_type(struct inode *inode)
+{
+	return CURSEG_COLD_DATA;
+}
+
+/* temp_classify is not modelled, the simulator keeps it off */
+static inline int __classify_data_type(struct f2fs_io_info *fio)
+{
+	return CURSEG_WARM_DATA;
+}
+
+/* extracted from segment.c, called by get_victim_by_default() */
+void refresh_stale_victims(struct f2fs_sb_info *sbi);
+
+#endif /* _GCSIM_SIM_H */
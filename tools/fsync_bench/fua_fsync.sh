@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# fua_fsync.sh - compare fsync latency of fua_fsync with flush_merge
+#
+# Creates a memory backed null_blk device with a volatile write cache, so
+# that cache flushes and FUA writes are honoured and accounted by the
+# block layer, and runs the same fsync heavy fio job on f2fs mounted with
+# each option set in turn. Needs root, configfs, null_blk, mkfs.f2fs and
+# fio; the f2fs module under test must already be loaded.
+#
+# usage: fua_fsync.sh [size_mb] [jobs] [runtime_secs]
+#
+set -e
+
+SIZE_MB=${1:-4096}
+JOBS=${2:-4}
+RUNTIME=${3:-30}
+NULLB=/sys/kernel/config/nullb/f2fs_fua
+MNT=$(mktemp -d)
+DEV=
+
+cleanup()
+{
+	umount "$MNT" 2>/dev/null || true
+	rmdir "$MNT"
+	if [ -d "$NULLB" ]; then
+		echo 0 > "$NULLB/power"
+		rmdir "$NULLB"
+	fi
+}
+trap cleanup EXIT
+
+modprobe null_blk nr_devices=0
+mkdir "$NULLB"
+echo 4096 > "$NULLB/blocksize"
+echo "$SIZE_MB" > "$NULLB/size"
+echo 1 > "$NULLB/memory_backed"
+# a volatile cache of a quarter of the device, written back on flush/FUA
+echo $((SIZE_MB / 4)) > "$NULLB/cache_size"
+echo 1 > "$NULLB/power"
+DEV=/dev/nullb$(cat "$NULLB/index")
+
+run()
+{
+	opts=$1
+
+	mkfs.f2fs -q -f "$DEV"
+	mount -t f2fs -o "$opts" "$DEV" "$MNT"
+	flushes_before=$(awk '{ print $15 }' "/sys/block/${DEV#/dev/}/stat")
+
+	fio --name=fsync --directory="$MNT" --ioengine=psync --rw=randwrite \
+		--bs=4k --size=256m --numjobs="$JOBS" --fsync=1 \
+		--time_based --runtime="$RUNTIME" --group_reporting \
+		--output-format=terse --terse-version=3 > "$MNT.out"
+
+	flushes=$(($(awk '{ print $15 }' "/sys/block/${DEV#/dev/}/stat") -
+			flushes_before))
+	umount "$MNT"
+
+	# terse v3 write fields: 49 iops, 57/58 clat mean/stdev in usecs.
+	# Every write is followed by its fsync, so iops is the fsync rate.
+	awk -F';' -v opts="$opts" -v flushes="$flushes" '{
+		printf("%-24s %10d %12.1f %12.1f %10d\n", opts, $49,
+			$57, $58, flushes)
+	}' "$MNT.out"
+	rm -f "$MNT.out"
+}
+
+printf "%-24s %10s %12s %12s %10s\n" "options" "iops" "clat_mean_us" \
+	"clat_std_us" "flushes"
+run "flush_merge"
+run "flush_merge,fua_fsync"